@@ -49,11 +49,25 @@ public:
 
     void setVerbose(bool verbose);
 
+    // threads of the ceres solver, 0 to follow the OpenCV thread pool that
+    // runs the per view passes
+    void setNumThreads(int numThreads);
+
+    // analytic jacobian costs for the models that have one, autodiff otherwise
+    void setAnalyticJacobians(bool analyticJacobians);
+
+    // ceres iterations of the last calibrate() call
+    int solverIterations(void) const;
+
 private:
+    int numThreads(void) const;
+
     bool calibrateHelper(CameraPtr& camera,
-                         std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const;
+                         std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs,
+                         int& iterations) const;
 
-    void optimize(CameraPtr& camera,
+    // returns the number of ceres iterations
+    int optimize(CameraPtr& camera,
                   std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const;
 
     template<typename T>
@@ -74,6 +88,9 @@ private:
     Eigen::Matrix2d m_measurementCovariance;
 
     bool m_verbose;
+    int m_numThreads;
+    int m_solverIterations;
+    bool m_analyticJacobians;
 };
 
 }
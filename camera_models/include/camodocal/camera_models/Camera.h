@@ -4,6 +4,7 @@
 #include <boost/shared_ptr.hpp>
 #include <eigen3/Eigen/Dense>
 #include <opencv2/core/core.hpp>
+#include <opencv2/core/utility.hpp>
 #include <vector>
 
 namespace camodocal
@@ -83,6 +84,23 @@ class Camera
         int m_imageHeight;
     };
 
+    // Reprojection statistics over a set of views. Residuals are observed
+    // minus projected points, errors are the residual norms in pixels.
+    struct ReprojectionStats
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        size_t pointCount;
+        double meanError;
+        double maxError;
+        double medianError;
+        double percentile90Error;
+        double percentile99Error;
+        Eigen::Vector2d meanResidual;
+        Eigen::Matrix2d residualCovariance;
+        // mean error of each view
+        std::vector< double > perViewErrors;
+    };
+
     virtual ModelType modelType( void ) const           = 0;
     virtual const std::string& cameraName( void ) const = 0;
     virtual int imageWidth( void ) const                = 0;
@@ -122,6 +140,16 @@ class Camera
     virtual void undistToPlane( const Eigen::Vector2d& p_u, Eigen::Vector2d& p ) const = 0;
     //%output p
 
+    // Batched versions of liftProjective and spaceToPlane over n points stored
+    // contiguously, image points as (u, v) pairs and space points as (x, y, z).
+    // The default loops over the single point functions, models override them
+    // with loops free of virtual calls.
+    virtual void liftProjectiveBatch( const double* p, double* P, int n ) const;
+    //%output P
+
+    virtual void spaceToPlaneBatch( const double* P, double* p, int n ) const;
+    //%output p
+
     // virtual void initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale = 1.0)
     // const = 0;
     virtual cv::Mat initUndistortRectifyMap( cv::Mat& map1,
@@ -142,6 +170,13 @@ class Camera
 
     virtual std::string parametersToString( void ) const = 0;
 
+    // Binary snapshot of the parameters together with the tables derived
+    // from them, used by CameraFactory to skip rebuilding the tables when the
+    // same camera file is loaded again. Models without precomputed tables
+    // keep the default, which returns false, and are always read from yaml.
+    virtual bool writeState( std::ostream& out ) const;
+    virtual bool readState( std::istream& in );
+
     /**
      * \brief Calculates the reprojection distance between points
      *
@@ -157,6 +192,14 @@ class Camera
                               const std::vector< cv::Mat >& tvecs,
                               cv::OutputArray perViewErrors = cv::noArray( ) ) const;
 
+    // Views are projected in parallel with spaceToPlaneBatch, the statistics
+    // are reduced serially so they do not depend on the thread count
+    void reprojectionStatistics( const std::vector< std::vector< cv::Point3f > >& objectPoints,
+                                 const std::vector< std::vector< cv::Point2f > >& imagePoints,
+                                 const std::vector< cv::Mat >& rvecs,
+                                 const std::vector< cv::Mat >& tvecs,
+                                 ReprojectionStats& stats ) const;
+
     double reprojectionError( const Eigen::Vector3d& P,
                               const Eigen::Quaterniond& camera_q,
                               const Eigen::Vector3d& camera_t,
@@ -168,11 +211,41 @@ class Camera
                         std::vector< cv::Point2f >& imagePoints ) const;
 
     protected:
+    // Fill the CV_32F maps with the projection of rayOfPixel(u, v) for every
+    // pixel. Rows are built in parallel and projected with spaceToPlaneBatch.
+    template< typename RayFunc >
+    void projectRayMap( cv::Mat& mapX, cv::Mat& mapY, RayFunc rayOfPixel ) const;
+
     cv::Mat m_mask;
 };
 
 typedef boost::shared_ptr< Camera > CameraPtr;
 typedef boost::shared_ptr< const Camera > CameraConstPtr;
+
+template< typename RayFunc >
+void
+Camera::projectRayMap( cv::Mat& mapX, cv::Mat& mapY, RayFunc rayOfPixel ) const
+{
+    cv::parallel_for_( cv::Range( 0, mapX.rows ), [&]( const cv::Range& range ) {
+        Eigen::Matrix3Xd P( 3, mapX.cols );
+        Eigen::Matrix2Xd p( 2, mapX.cols );
+        for ( int v = range.start; v < range.end; ++v )
+        {
+            for ( int u = 0; u < mapX.cols; ++u )
+                P.col( u ) = rayOfPixel( u, v );
+
+            spaceToPlaneBatch( P.data( ), p.data( ), mapX.cols );
+
+            float* mapX_row = mapX.ptr< float >( v );
+            float* mapY_row = mapY.ptr< float >( v );
+            for ( int u = 0; u < mapX.cols; ++u )
+            {
+                mapX_row[u] = p( 0, u );
+                mapY_row[u] = p( 1, u );
+            }
+        }
+    } );
+}
 }
 
 #endif
@@ -2,7 +2,10 @@
 #define CAMERAFACTORY_H
 
 #include <boost/shared_ptr.hpp>
+#include <map>
+#include <mutex>
 #include <opencv2/core/core.hpp>
+#include <stdint.h>
 
 #include "camodocal/camera_models/Camera.h"
 
@@ -21,10 +24,32 @@ public:
                              const std::string& cameraName,
                              cv::Size imageSize) const;
 
+    // Camera files are cached on a hash of their content: the parameters and
+    // the lift tables of models that precompute them (KANNALA_BRANDT,
+    // POLYFISHEYE) are kept in memory and, when a cache directory is set, on
+    // disk so that a restart restores the tables instead of rebuilding them.
+    // Every call returns a new camera.
     CameraPtr generateCameraFromYamlFile(const std::string& filename);
 
+    // Defaults to $CAMODOCAL_CACHE_DIR, an empty directory disables the disk cache
+    void setCacheDirectory(const std::string& directory);
+    std::string cacheDirectory(void) const;
+
 private:
+    CameraPtr readCameraFromYamlFile(const std::string& filename) const;
+
+    CameraPtr cameraFromState(const std::string& state, uint64_t key) const;
+    bool stateFromCamera(const Camera& camera, uint64_t key, std::string& state) const;
+
+    bool loadState(uint64_t key, std::string& state);
+    void storeState(uint64_t key, const std::string& state);
+    std::string stateFilename(uint64_t key) const;
+
     static boost::shared_ptr<CameraFactory> m_instance;
+
+    mutable std::mutex m_cacheMutex;
+    std::string m_cacheDirectory;
+    std::map<uint64_t, std::string> m_stateCache;
 };
 
 }
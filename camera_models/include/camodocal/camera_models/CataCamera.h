@@ -111,6 +111,9 @@ public:
     void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const;
     //%output p
 
+    void liftProjectiveBatch(const double* p, double* P, int n) const;
+    void spaceToPlaneBatch(const double* P, double* p, int n) const;
+
     template <typename T>
     static void spaceToPlane(const T* const params,
                              const T* const q, const T* const t,
@@ -120,6 +123,8 @@ public:
     void distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u) const;
     void distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u,
                     Eigen::Matrix2d& J) const;
+    // Inverse of distortion(), returns the residual norm on the normalised plane
+    double undistortion(const Eigen::Vector2d& p_d, Eigen::Vector2d& p_u) const;
 
     void initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale = 1.0) const;
     cv::Mat initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
@@ -22,7 +22,10 @@ enum
     ODOMETRY_INTRINSICS =       1 << 3,
     ODOMETRY_3D_POSE =          1 << 4,
     ODOMETRY_6D_POSE =          1 << 5,
-    CAMERA_ODOMETRY_TRANSFORM = 1 << 6
+    CAMERA_ODOMETRY_TRANSFORM = 1 << 6,
+    // with CAMERA_INTRINSICS | CAMERA_POSE, use the analytic jacobian cost of
+    // the Cata, Equidistant and Pinhole models instead of autodiff
+    ANALYTIC_JACOBIAN =         1 << 7
 };
 
 class CostFunctionFactory
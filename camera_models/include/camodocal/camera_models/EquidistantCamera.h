@@ -6,6 +6,7 @@
 
 #include "ceres/rotation.h"
 #include "Camera.h"
+#include "RadialInverseTable.h"
 
 namespace camodocal
 {
@@ -111,6 +112,9 @@ public:
     void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const;
     //%output p
 
+    void liftProjectiveBatch(const double* p, double* P, int n) const;
+    void spaceToPlaneBatch(const double* P, double* p, int n) const;
+
     template <typename T>
     static void spaceToPlane(const T* const params,
                              const T* const q, const T* const t,
@@ -136,6 +140,13 @@ public:
 
     std::string parametersToString(void) const;
 
+    bool writeState(std::ostream& out) const;
+    bool readState(std::istream& in);
+
+    // exact inverse of r(theta) through the roots of the companion matrix,
+    // reference for the lift table
+    double solveTheta(double p_u_norm) const;
+
 private:
     template<typename T>
     static T r(T k2, T k3, T k4, T k5, T theta);
@@ -147,9 +158,15 @@ private:
     void backprojectSymmetric(const Eigen::Vector2d& p_u,
                               double& theta, double& phi) const;
 
+    void updateInverseK(void);
+    void buildInverseTable(void);
+
     Parameters mParameters;
 
     double m_inv_K11, m_inv_K13, m_inv_K22, m_inv_K23;
+
+    // default lift path, solveTheta is only used outside the table
+    RadialInverseTable m_inverseTable;
 };
 
 typedef boost::shared_ptr<EquidistantCamera> EquidistantCameraPtr;
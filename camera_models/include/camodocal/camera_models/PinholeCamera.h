@@ -103,6 +103,9 @@ public:
     void undistToPlane(const Eigen::Vector2d& p_u, Eigen::Vector2d& p) const;
     //%output p
 
+    void liftProjectiveBatch(const double* p, double* P, int n) const;
+    void spaceToPlaneBatch(const double* P, double* p, int n) const;
+
     template <typename T>
     static void spaceToPlane(const T* const params,
                              const T* const q, const T* const t,
@@ -7,6 +7,7 @@
 #include "ceres/rotation.h"
 
 #include "Camera.h"
+#include "RadialInverseTable.h"
 
 #include <camodocal/code_utils/math_utils/Polynomial.h>
 
@@ -149,6 +150,7 @@ class PolyFisheyeCamera : public Camera
     class FastCalcTABLE
     {
         public:
+        FastCalcTABLE( );
         FastCalcTABLE( eigen_utils::Vector& poly_coeff, int num_diff_angle, double max_angle );
 
         void backprojectSymmetric( const Eigen::Vector2d& p_u,
@@ -171,6 +173,10 @@ class PolyFisheyeCamera : public Camera
         double getDiffAngle( );
         double getDiffR( );
 
+        // Binary snapshot of the tables, restored without solving for the roots
+        void write( std::ostream& out ) const;
+        bool read( std::istream& in );
+
         private:
         void resetFastCalc( );
         bool calcAngleToR( eigen_utils::Matrix& _angleToR, const int _numDiffAngle, const double _diffAngle );
@@ -275,6 +281,9 @@ class PolyFisheyeCamera : public Camera
 
     void undistToPlane( const Eigen::Vector2d& p_u, Eigen::Vector2d& p ) const;
 
+    void liftProjectiveBatch( const double* p, double* P, int n ) const;
+    void spaceToPlaneBatch( const double* P, double* p, int n ) const;
+
     template< typename T >
     static void spaceToPlane( const T* const params,
                               const T* const q,
@@ -308,6 +317,9 @@ class PolyFisheyeCamera : public Camera
 
     std::string parametersToString( void ) const;
 
+    bool writeState( std::ostream& out ) const;
+    bool readState( std::istream& in );
+
     math_utils::Polynomial* getPoly( ) const;
     void setPoly( math_utils::Polynomial* value );
 
@@ -330,6 +342,7 @@ class PolyFisheyeCamera : public Camera
                                double& cos_phi,
                                double& sin_phi ) const;
     bool calcKinvese( double a11, double a12, double a22, double u0, double v0 );
+    void buildInverseTable( );
 
     Parameters mParameters;
 
@@ -337,6 +350,8 @@ class PolyFisheyeCamera : public Camera
     math_utils::Polynomial* poly;
     //    FastCalcPOLY*           fastCalc;
     FastCalcTABLE* fastCalc;
+    // default lift path, exact root solver is only used outside the table
+    RadialInverseTable inverseTable;
 
     double m_inv_K11, m_inv_K12, m_inv_K13, m_inv_K22, m_inv_K23;
 };
@@ -0,0 +1,51 @@
+#ifndef RADIALINVERSETABLE_H
+#define RADIALINVERSETABLE_H
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#define RADIAL_TABLE_SIZE 1024
+#define RADIAL_TABLE_NEWTON_ITERATIONS 8
+#define RADIAL_TABLE_NEWTON_TOLERANCE 1e-12
+
+namespace camodocal
+{
+
+// Inverse of a radial projection polynomial r(theta) = sum coeff[i] * theta^i.
+// theta(r) is sampled on a uniform grid of r over the monotone part of the
+// polynomial, looked up with linear interpolation and refined by Newton steps
+// on the polynomial itself. One or two steps converge except close to the end
+// of the monotone part, where the derivative vanishes.
+class RadialInverseTable
+{
+    public:
+    RadialInverseTable( );
+
+    // coeff: polynomial coefficients in theta, lowest order first
+    // maxTheta: upper bound of the incident angle in rad
+    void build( const std::vector< double >& coeff, double maxTheta, int tableSize = RADIAL_TABLE_SIZE );
+
+    // Return false when r is outside the table, the caller falls back to the exact solver
+    bool theta( double r, double& theta ) const;
+
+    bool valid( void ) const;
+    double maxR( void ) const;
+    double maxTheta( void ) const;
+
+    // Binary snapshot of the table, restored without running the bisection
+    void write( std::ostream& out ) const;
+    bool read( std::istream& in );
+
+    private:
+    void evaluate( double theta, double& r, double& dr ) const;
+
+    std::vector< double > m_coeff;
+    std::vector< double > m_rToTheta;
+    double m_maxTheta;
+    double m_maxR;
+    double m_invDiffR;
+};
+}
+
+#endif // RADIALINVERSETABLE_H
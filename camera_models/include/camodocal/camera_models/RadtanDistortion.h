@@ -0,0 +1,24 @@
+#ifndef RADTANDISTORTION_H
+#define RADTANDISTORTION_H
+
+namespace camodocal
+{
+
+// Radial-tangential distortion of a point on the normalised plane, the same
+// expressions as distortion() of the pinhole and cata models on scalars so
+// that batch loops vectorize.
+inline void
+radtanDistortion( double k1, double k2, double p1, double p2,
+                  double mx_u, double my_u, double& dx_u, double& dy_u )
+{
+    double mx2_u      = mx_u * mx_u;
+    double my2_u      = my_u * my_u;
+    double mxy_u      = mx_u * my_u;
+    double rho2_u     = mx2_u + my2_u;
+    double rad_dist_u = k1 * rho2_u + k2 * rho2_u * rho2_u;
+    dx_u              = mx_u * rad_dist_u + 2.0 * p1 * mxy_u + p2 * ( rho2_u + 2.0 * mx2_u );
+    dy_u              = my_u * rad_dist_u + 2.0 * p2 * mxy_u + p1 * ( rho2_u + 2.0 * my2_u );
+}
+}
+
+#endif // RADTANDISTORTION_H
@@ -0,0 +1,73 @@
+#ifndef STATEIO_H
+#define STATEIO_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// upper bound on string and vector sizes, guards against corrupt cache files
+#define STATE_IO_MAX_ELEMENTS ( 1 << 24 )
+
+namespace camodocal
+{
+
+// Raw binary helpers for the camera state cache. Values are stored in host
+// byte order, a cache file is only read back by the machine that wrote it.
+
+template< typename T >
+inline void
+writeBinary( std::ostream& out, const T& value )
+{
+    out.write( reinterpret_cast< const char* >( &value ), sizeof( T ) );
+}
+
+template< typename T >
+inline bool
+readBinary( std::istream& in, T& value )
+{
+    in.read( reinterpret_cast< char* >( &value ), sizeof( T ) );
+    return in.good( );
+}
+
+inline void
+writeBinary( std::ostream& out, const std::string& value )
+{
+    writeBinary( out, static_cast< uint64_t >( value.size( ) ) );
+    out.write( value.data( ), value.size( ) );
+}
+
+inline bool
+readBinary( std::istream& in, std::string& value )
+{
+    uint64_t size;
+    if ( !readBinary( in, size ) || size > STATE_IO_MAX_ELEMENTS )
+        return false;
+
+    value.resize( size );
+    in.read( &value[0], size );
+    return in.good( );
+}
+
+inline void
+writeBinary( std::ostream& out, const std::vector< double >& value )
+{
+    writeBinary( out, static_cast< uint64_t >( value.size( ) ) );
+    out.write( reinterpret_cast< const char* >( value.data( ) ), value.size( ) * sizeof( double ) );
+}
+
+inline bool
+readBinary( std::istream& in, std::vector< double >& value )
+{
+    uint64_t size;
+    if ( !readBinary( in, size ) || size > STATE_IO_MAX_ELEMENTS )
+        return false;
+
+    value.resize( size );
+    in.read( reinterpret_cast< char* >( value.data( ) ), size * sizeof( double ) );
+    return in.good( );
+}
+}
+
+#endif // STATEIO_H
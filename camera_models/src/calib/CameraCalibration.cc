@@ -16,6 +16,7 @@
 #include "camodocal/gpl/EigenQuaternionParameterization.h"
 #include "camodocal/gpl/EigenUtils.h"
 #include "camodocal/camera_models/CostFunctionFactory.h"
+#include "camodocal/code_utils/sys_utils.h"
 
 #include "ceres/ceres.h"
 namespace camodocal
@@ -25,6 +26,9 @@ CameraCalibration::CameraCalibration()
  : m_boardSize(cv::Size(0,0))
  , m_squareSize(0.0f)
  , m_verbose(false)
+ , m_numThreads(0)
+ , m_solverIterations(0)
+ , m_analyticJacobians(false)
 {
 
 }
@@ -37,6 +41,9 @@ CameraCalibration::CameraCalibration(const Camera::ModelType modelType,
  : m_boardSize(boardSize)
  , m_squareSize(squareSize)
  , m_verbose(false)
+ , m_numThreads(0)
+ , m_solverIterations(0)
+ , m_analyticJacobians(false)
 {
     m_camera = CameraFactory::instance()->generateCamera(modelType, cameraName, imageSize);
 }
@@ -72,7 +79,7 @@ CameraCalibration::calibrate(void)
     // compute intrinsic camera parameters and extrinsic parameters for each of the views
     std::vector<cv::Mat> rvecs;
     std::vector<cv::Mat> tvecs;
-    bool ret = calibrateHelper(m_camera, rvecs, tvecs);
+    bool ret = calibrateHelper(m_camera, rvecs, tvecs, m_solverIterations);
 
     m_cameraPoses = cv::Mat(imageCount, 6, CV_64F);
     for (int i = 0; i < imageCount; ++i)
@@ -86,50 +93,18 @@ CameraCalibration::calibrate(void)
     }
 
     // Compute measurement covariance.
-    std::vector<std::vector<cv::Point2f> > errVec(m_imagePoints.size());
-    Eigen::Vector2d errSum = Eigen::Vector2d::Zero();
-    size_t errCount = 0;
-    for (size_t i = 0; i < m_imagePoints.size(); ++i)
-    {
-        std::vector<cv::Point2f> estImagePoints;
-        m_camera->projectPoints(m_scenePoints.at(i), rvecs.at(i), tvecs.at(i),
-                                estImagePoints);
-
-        for (size_t j = 0; j < m_imagePoints.at(i).size(); ++j)
-        {
-            cv::Point2f pObs = m_imagePoints.at(i).at(j);
-            cv::Point2f pEst = estImagePoints.at(j);
-
-            cv::Point2f err = pObs - pEst;
-
-            errVec.at(i).push_back(err);
-
-            errSum += Eigen::Vector2d(err.x, err.y);
-        }
+    Camera::ReprojectionStats stats;
+    m_camera->reprojectionStatistics(m_scenePoints, m_imagePoints, rvecs, tvecs, stats);
 
-        errCount += m_imagePoints.at(i).size();
-    }
-
-    Eigen::Vector2d errMean = errSum / static_cast<double>(errCount);
-
-    Eigen::Matrix2d measurementCovariance = Eigen::Matrix2d::Zero();
-    for (size_t i = 0; i < errVec.size(); ++i)
+    if (m_verbose)
     {
-        for (size_t j = 0; j < errVec.at(i).size(); ++j)
-        {
-            cv::Point2f err = errVec.at(i).at(j);
-            double d0 = err.x - errMean(0);
-            double d1 = err.y - errMean(1);
-
-            measurementCovariance(0,0) += d0 * d0;
-            measurementCovariance(0,1) += d0 * d1;
-            measurementCovariance(1,1) += d1 * d1;
-        }
+        std::cout << "[" << m_camera->cameraName() << "] " << "# INFO: Reprojection error mean "
+                  << stats.meanError << ", median " << stats.medianError
+                  << ", 90% " << stats.percentile90Error << ", 99% " << stats.percentile99Error
+                  << ", max " << stats.maxError << " pixels" << std::endl;
     }
-    measurementCovariance /= static_cast<double>(errCount);
-    measurementCovariance(1,0) = measurementCovariance(0,1);
 
-    m_measurementCovariance = measurementCovariance;
+    m_measurementCovariance = stats.residualCovariance;
 
     return ret;
 }
@@ -421,21 +396,52 @@ CameraCalibration::setVerbose(bool verbose)
     m_verbose = verbose;
 }
 
+void
+CameraCalibration::setNumThreads(int numThreads)
+{
+    m_numThreads = numThreads;
+}
+
+void
+CameraCalibration::setAnalyticJacobians(bool analyticJacobians)
+{
+    m_analyticJacobians = analyticJacobians;
+}
+
+int
+CameraCalibration::solverIterations(void) const
+{
+    return m_solverIterations;
+}
+
+int
+CameraCalibration::numThreads(void) const
+{
+    return m_numThreads > 0 ? m_numThreads : cv::getNumThreads();
+}
+
 bool
 CameraCalibration::calibrateHelper(CameraPtr& camera,
-                                   std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const
+                                   std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs,
+                                   int& iterations) const
 {
     rvecs.assign(m_scenePoints.size(), cv::Mat());
     tvecs.assign(m_scenePoints.size(), cv::Mat());
 
     // STEP 1: Estimate intrinsics
+    double t_start = sys_utils::timeInSeconds();
     camera->estimateIntrinsics(m_boardSize, m_scenePoints, m_imagePoints);
 
-    // STEP 2: Estimate extrinsics
-    for (size_t i = 0; i < m_scenePoints.size(); ++i)
+    // STEP 2: Estimate extrinsics, views are independent
+    double t_intrinsics = sys_utils::timeInSeconds();
+    cv::parallel_for_(cv::Range(0, m_scenePoints.size()), [&](const cv::Range& range)
     {
-        camera->estimateExtrinsics(m_scenePoints.at(i), m_imagePoints.at(i), rvecs.at(i), tvecs.at(i));
-    }
+        for (int i = range.start; i < range.end; ++i)
+        {
+            camera->estimateExtrinsics(m_scenePoints.at(i), m_imagePoints.at(i), rvecs.at(i), tvecs.at(i));
+        }
+    });
+    double t_extrinsics = sys_utils::timeInSeconds();
 
     if (m_verbose)
     {
@@ -447,13 +453,20 @@ CameraCalibration::calibrateHelper(CameraPtr& camera,
     }
 
     // STEP 3: optimization using ceres
-    optimize(camera, rvecs, tvecs);
+    double t_optimize = sys_utils::timeInSeconds();
+    iterations = optimize(camera, rvecs, tvecs);
+    double t_end = sys_utils::timeInSeconds();
 
     if (m_verbose)
     {
         double err = camera->reprojectionError(m_scenePoints, m_imagePoints, rvecs, tvecs);
         std::cout << "[" << camera->cameraName() << "] " << "# INFO: Final reprojection error: "
                   << err << " pixels" << std::endl;
+        std::cout << "[" << camera->cameraName() << "] " << "# INFO: "
+                  << m_scenePoints.size() << " views with " << numThreads() << " threads, "
+                  << "intrinsics " << t_intrinsics - t_start << " s, "
+                  << "extrinsics " << t_extrinsics - t_intrinsics << " s, "
+                  << "optimization " << t_end - t_optimize << " s" << std::endl;
         std::cout << "[" << camera->cameraName() << "] " << "# INFO: "
                   << camera->parametersToString() << std::endl;
     }
@@ -461,7 +474,7 @@ CameraCalibration::calibrateHelper(CameraPtr& camera,
     return true;
 }
 
-void
+int
 CameraCalibration::optimize(CameraPtr& camera,
                             std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const
 {
@@ -483,6 +496,12 @@ CameraCalibration::optimize(CameraPtr& camera,
     std::vector<double> intrinsicCameraParams;
     m_camera->writeParameters(intrinsicCameraParams);
 
+    int flags = CAMERA_INTRINSICS | CAMERA_POSE;
+    if (m_analyticJacobians)
+    {
+        flags |= ANALYTIC_JACOBIAN;
+    }
+
     // create residuals for each observation
     for (size_t i = 0; i < m_imagePoints.size(); ++i)
     {
@@ -495,7 +514,7 @@ CameraCalibration::optimize(CameraPtr& camera,
                 CostFunctionFactory::instance()->generateCostFunction(camera,
                                                                       Eigen::Vector3d(spt.x, spt.y, spt.z),
                                                                       Eigen::Vector2d(ipt.x, ipt.y),
-                                                                      CAMERA_INTRINSICS | CAMERA_POSE);
+                                                                      flags);
 
             ceres::LossFunction* lossFunction = new ceres::CauchyLoss(1.0);
             problem.AddResidualBlock(costFunction, lossFunction,
@@ -514,7 +533,31 @@ CameraCalibration::optimize(CameraPtr& camera,
     std::cout << "begin ceres" << std::endl;
     ceres::Solver::Options options;
     options.max_num_iterations = 1000;
-    options.num_threads = 1;
+    options.num_threads = numThreads();
+    // Every residual touches the intrinsics and both the rotation and the
+    // translation of its view, so a view cannot be eliminated as a whole.
+    // Rotations of different views never share a residual: they form the
+    // elimination group, and the reduced system couples the intrinsics with
+    // each translation but is block diagonal otherwise. A sparse factorization
+    // of it scales linearly with the number of views where a dense one grows
+    // by 3 rows per view.
+    ceres::ParameterBlockOrdering* ordering = new ceres::ParameterBlockOrdering;
+    ordering->AddElementToGroup(intrinsicCameraParams.data(), 1);
+    for (size_t i = 0; i < transformVec.size(); ++i)
+    {
+        ordering->AddElementToGroup(transformVec.at(i).rotationData(), 0);
+        ordering->AddElementToGroup(transformVec.at(i).translationData(), 1);
+    }
+    options.linear_solver_ordering.reset(ordering);
+
+    if (ceres::IsSparseLinearAlgebraLibraryTypeAvailable(options.sparse_linear_algebra_library_type))
+    {
+        options.linear_solver_type = ceres::SPARSE_SCHUR;
+    }
+    else
+    {
+        options.linear_solver_type = ceres::DENSE_SCHUR;
+    }
 
     if (m_verbose)
     {
@@ -544,6 +587,8 @@ CameraCalibration::optimize(CameraPtr& camera,
         tvec.at<double>(1) = transformVec.at(i).translation()(1);
         tvec.at<double>(2) = transformVec.at(i).translation()(2);
     }
+
+    return summary.iterations.size();
 }
 
 template<typename T>
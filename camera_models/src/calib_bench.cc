@@ -0,0 +1,1234 @@
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <eigen3/Eigen/Dense>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/utility.hpp>
+#include <random>
+
+#include "ceres/ceres.h"
+
+#include "camodocal/calib/CameraCalibration.h"
+#include "camodocal/camera_models/CameraFactory.h"
+#include "camodocal/camera_models/CataCamera.h"
+#include "camodocal/camera_models/CostFunctionFactory.h"
+#include "camodocal/camera_models/EquidistantCamera.h"
+#include "camodocal/camera_models/PinholeCamera.h"
+#include "camodocal/camera_models/PinholeFullCamera.h"
+#include "camodocal/camera_models/PolyFisheyeCamera.h"
+#include "camodocal/camera_models/RadialInverseTable.h"
+#include "camodocal/chessboard/Chessboard.h"
+#include "camodocal/code_utils/math_utils/math_utils.h"
+#include "camodocal/gpl/gpl.h"
+
+// Synthetic benchmark of CameraCalibration. Chessboard views are generated
+// through a ground truth camera, either as projected corners with gaussian
+// noise or as rendered images that go through corner detection, and the
+// calibrated camera is compared against the ground truth.
+//
+// With --check, the ground truth camera is only used for a numerical check
+// of the camera models, which prints timings and returns non-zero on failure.
+
+// board pose sampling
+#define BENCH_MAX_POSE_TRIALS 1000
+#define BENCH_MAX_TILT 0.7
+#define BENCH_IMAGE_MARGIN 10.0
+// samples per pixel side when rendering
+#define BENCH_RENDER_SUPERSAMPLE 2
+// pixel step of the grid used to compare the calibrated and true models
+#define BENCH_GRID_STEP 4
+// radii sampled by the lift table check
+#define BENCH_LIFT_SAMPLES 200000
+// max difference in rad between the lift table and the exact solver
+#define BENCH_LIFT_TOLERANCE 1e-9
+// max pixel error of lifting the image and projecting it back
+#define BENCH_ROUND_TRIP_TOLERANCE 1e-6
+// max difference between the batched and single point calls, rays and pixels
+#define BENCH_BATCH_TOLERANCE 1e-9
+// steps of the fixed point undistortion that CataCamera used before Newton
+#define BENCH_FIXED_POINT_ITERATIONS 8
+// pixel residual below which an undistortion counts as converged
+#define BENCH_UNDISTORT_TOLERANCE 1e-6
+// max pixel difference of Newton and fixed point where both converged
+#define BENCH_UNDISTORT_AGREEMENT 1e-5
+// max pixel difference of the parallel rectify map and the serial single point
+// one, the maps are float
+#define BENCH_MAP_TOLERANCE 1e-3
+// random poses and points of the analytic against autodiff cost check
+#define BENCH_JACOBIAN_TRIALS 10000
+// max difference of the residuals in px, and of each jacobian block relative
+// to its largest autodiff entry
+#define BENCH_JACOBIAN_TOLERANCE 1e-9
+
+// Default ground truth for the models that have no camera file, close to
+// common 752x480 cameras
+camodocal::CameraPtr
+generateGroundTruth( camodocal::Camera::ModelType modelType, const cv::Size& imageSize )
+{
+    camodocal::CameraPtr camera
+    = camodocal::CameraFactory::instance( )->generateCamera( modelType, "ground_truth", imageSize );
+
+    double u0 = imageSize.width / 2.0 + 3.5;
+    double v0 = imageSize.height / 2.0 - 2.5;
+
+    switch ( modelType )
+    {
+        case camodocal::Camera::KANNALA_BRANDT:
+        {
+            camodocal::EquidistantCamera* equidistant = static_cast< camodocal::EquidistantCamera* >( camera.get( ) );
+            camodocal::EquidistantCamera::Parameters params = equidistant->getParameters( );
+            params.k2( ) = -0.02;
+            params.k3( ) = 0.01;
+            params.k4( ) = -0.004;
+            params.k5( ) = 0.0005;
+            params.mu( ) = 230.0;
+            params.mv( ) = 231.0;
+            params.u0( ) = u0;
+            params.v0( ) = v0;
+            equidistant->setParameters( params );
+            break;
+        }
+        case camodocal::Camera::PINHOLE:
+        {
+            camodocal::PinholeCamera* pinhole = static_cast< camodocal::PinholeCamera* >( camera.get( ) );
+            camodocal::PinholeCamera::Parameters params = pinhole->getParameters( );
+            params.k1( ) = -0.28;
+            params.k2( ) = 0.07;
+            params.p1( ) = 0.0002;
+            params.p2( ) = -0.00015;
+            params.fx( ) = 460.0;
+            params.fy( ) = 458.0;
+            params.cx( ) = u0;
+            params.cy( ) = v0;
+            pinhole->setParameters( params );
+            break;
+        }
+        case camodocal::Camera::PINHOLE_FULL:
+        {
+            camodocal::PinholeFullCamera* pinhole = static_cast< camodocal::PinholeFullCamera* >( camera.get( ) );
+            camodocal::PinholeFullCamera::Parameters params = pinhole->getParameters( );
+            params.k1( ) = -0.28;
+            params.k2( ) = 0.07;
+            params.k3( ) = -0.005;
+            params.p1( ) = 0.0002;
+            params.p2( ) = -0.00015;
+            params.fx( ) = 460.0;
+            params.fy( ) = 458.0;
+            params.cx( ) = u0;
+            params.cy( ) = v0;
+            pinhole->setParameters( params );
+            break;
+        }
+        case camodocal::Camera::MEI:
+        {
+            camodocal::CataCamera* cata = static_cast< camodocal::CataCamera* >( camera.get( ) );
+            camodocal::CataCamera::Parameters params = cata->getParameters( );
+            params.xi( )     = 1.6;
+            params.k1( )     = -0.2;
+            params.k2( )     = 0.06;
+            params.p1( )     = 0.0003;
+            params.p2( )     = -0.0002;
+            params.gamma1( ) = 620.0;
+            params.gamma2( ) = 618.0;
+            params.u0( )     = u0;
+            params.v0( )     = v0;
+            cata->setParameters( params );
+            break;
+        }
+        default:
+            return camodocal::CameraPtr( );
+    }
+
+    return camera;
+}
+
+// Sample a board pose that keeps every corner inside the image
+bool
+generateView( const camodocal::CameraConstPtr& camera,
+              const std::vector< cv::Point3f >& scenePoints,
+              std::mt19937& rng,
+              std::vector< cv::Point2f >& imagePoints,
+              Eigen::Matrix3d& R,
+              Eigen::Vector3d& t )
+{
+    std::uniform_real_distribution< double > uniform( 0.0, 1.0 );
+
+    Eigen::Vector3d center( 0.0, 0.0, 0.0 );
+    double boardRadius = 0.0;
+    for ( size_t i = 0; i < scenePoints.size( ); ++i )
+    {
+        center += Eigen::Vector3d( scenePoints.at( i ).x, scenePoints.at( i ).y, scenePoints.at( i ).z );
+    }
+    center /= scenePoints.size( );
+    for ( size_t i = 0; i < scenePoints.size( ); ++i )
+    {
+        Eigen::Vector3d P( scenePoints.at( i ).x, scenePoints.at( i ).y, scenePoints.at( i ).z );
+        boardRadius = std::max( boardRadius, ( P - center ).norm( ) );
+    }
+
+    for ( int trial = 0; trial < BENCH_MAX_POSE_TRIALS; ++trial )
+    {
+        // aim the board center at a random pixel
+        Eigen::Vector2d target( uniform( rng ) * camera->imageWidth( ), uniform( rng ) * camera->imageHeight( ) );
+        Eigen::Vector3d ray;
+        camera->liftProjective( target, ray );
+        ray.normalize( );
+        if ( ray( 2 ) < 0.3 )
+        {
+            continue;
+        }
+
+        double distance = boardRadius * ( 2.0 + 4.0 * uniform( rng ) );
+
+        R = Eigen::AngleAxisd( 2.0 * M_PI * uniform( rng ), Eigen::Vector3d::UnitZ( ) )
+            * Eigen::AngleAxisd( BENCH_MAX_TILT * ( 2.0 * uniform( rng ) - 1.0 ), Eigen::Vector3d::UnitY( ) )
+            * Eigen::AngleAxisd( BENCH_MAX_TILT * ( 2.0 * uniform( rng ) - 1.0 ), Eigen::Vector3d::UnitX( ) );
+        t = distance * ray - R * center;
+
+        imagePoints.clear( );
+        bool inside = true;
+        for ( size_t i = 0; i < scenePoints.size( ) && inside; ++i )
+        {
+            Eigen::Vector3d P = R * Eigen::Vector3d( scenePoints.at( i ).x, scenePoints.at( i ).y, scenePoints.at( i ).z ) + t;
+            Eigen::Vector2d p;
+            camera->spaceToPlane( P, p );
+
+            inside = P( 2 ) > 0.0 && p( 0 ) > BENCH_IMAGE_MARGIN && p( 1 ) > BENCH_IMAGE_MARGIN
+                     && p( 0 ) < camera->imageWidth( ) - BENCH_IMAGE_MARGIN
+                     && p( 1 ) < camera->imageHeight( ) - BENCH_IMAGE_MARGIN;
+            imagePoints.push_back( cv::Point2f( p( 0 ), p( 1 ) ) );
+        }
+
+        if ( inside )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Render the board seen from pose R, t. Board squares follow the scene
+// points of CameraCalibration: inner corner (i, j) is at (i, j) * squareSize,
+// and the pattern has a white border of one square.
+cv::Mat
+renderView( const camodocal::CameraConstPtr& camera,
+            const cv::Size& boardSize,
+            float squareSize,
+            const Eigen::Matrix3d& R,
+            const Eigen::Vector3d& t,
+            double imageNoise,
+            unsigned int seed )
+{
+    cv::Mat image( camera->imageHeight( ), camera->imageWidth( ), CV_8UC1 );
+
+    const int s = BENCH_RENDER_SUPERSAMPLE;
+    Eigen::Vector3d normal = R.col( 2 );
+    double planeOffset     = normal.dot( t );
+
+    cv::parallel_for_( cv::Range( 0, image.rows ), [&]( const cv::Range& range ) {
+        std::mt19937 rng( seed + range.start );
+        std::normal_distribution< double > noise( 0.0, std::max( imageNoise, 1e-9 ) );
+
+        std::vector< double > p( 2 * image.cols * s * s );
+        std::vector< double > P( 3 * image.cols * s * s );
+        for ( int v = range.start; v < range.end; ++v )
+        {
+            for ( int u = 0; u < image.cols; ++u )
+            {
+                for ( int k = 0; k < s * s; ++k )
+                {
+                    p[2 * ( u * s * s + k )]     = u + ( k % s + 0.5 ) / s - 0.5;
+                    p[2 * ( u * s * s + k ) + 1] = v + ( k / s + 0.5 ) / s - 0.5;
+                }
+            }
+            camera->liftProjectiveBatch( p.data( ), P.data( ), image.cols * s * s );
+
+            uchar* row = image.ptr< uchar >( v );
+            for ( int u = 0; u < image.cols; ++u )
+            {
+                double intensity = 0.0;
+                for ( int k = 0; k < s * s; ++k )
+                {
+                    Eigen::Map< const Eigen::Vector3d > ray( &P[3 * ( u * s * s + k )] );
+
+                    // background
+                    double value = 128.0;
+
+                    double denom = normal.dot( ray );
+                    double depth = denom != 0.0 ? planeOffset / denom : -1.0;
+                    if ( depth > 0.0 )
+                    {
+                        Eigen::Vector3d X = R.transpose( ) * ( depth * ray - t );
+                        double x          = X( 0 ) / squareSize;
+                        double y          = X( 1 ) / squareSize;
+                        if ( x > -2.0 && y > -2.0 && x < boardSize.height + 1.0 && y < boardSize.width + 1.0 )
+                        {
+                            value = 235.0;
+                            if ( x > -1.0 && y > -1.0 && x < boardSize.height && y < boardSize.width
+                                 && ( static_cast< int >( std::floor( x ) ) + static_cast< int >( std::floor( y ) ) ) % 2 == 0 )
+                            {
+                                value = 20.0;
+                            }
+                        }
+                    }
+                    intensity += value;
+                }
+
+                intensity /= s * s;
+                if ( imageNoise > 0.0 )
+                {
+                    intensity += noise( rng );
+                }
+                row[u]    = cv::saturate_cast< uchar >( intensity );
+            }
+        }
+    } );
+
+    return image;
+}
+
+// Distance between the results of two paths for one point, both may be
+// invalid alike where the model is not defined
+template< int N >
+double
+pointDifference( const Eigen::Matrix< double, N, 1 >& a, const Eigen::Matrix< double, N, 1 >& b )
+{
+    if ( !a.allFinite( ) && !b.allFinite( ) )
+    {
+        return 0.0;
+    }
+
+    double diff = ( a - b ).norm( );
+    return diff == diff ? diff : INFINITY;
+}
+
+// Largest difference between two cameras lifting the same pixel grid and
+// projecting the rays of the first one back, used on a reloaded camera file
+void
+compareCameras( const camodocal::CameraConstPtr& camera,
+                const camodocal::CameraConstPtr& other,
+                double& maxLiftDiff,
+                double& maxProjectionDiff )
+{
+    std::vector< double > p;
+    for ( int v = 0; v < camera->imageHeight( ); v += BENCH_GRID_STEP )
+    {
+        for ( int u = 0; u < camera->imageWidth( ); u += BENCH_GRID_STEP )
+        {
+            p.push_back( u );
+            p.push_back( v );
+        }
+    }
+    int n = p.size( ) / 2;
+
+    std::vector< double > P( 3 * n ), P_other( 3 * n );
+    camera->liftProjectiveBatch( p.data( ), P.data( ), n );
+    other->liftProjectiveBatch( p.data( ), P_other.data( ), n );
+
+    std::vector< double > q( 2 * n ), q_other( 2 * n );
+    camera->spaceToPlaneBatch( P.data( ), q.data( ), n );
+    other->spaceToPlaneBatch( P.data( ), q_other.data( ), n );
+
+    maxLiftDiff       = 0.0;
+    maxProjectionDiff = 0.0;
+    for ( int i = 0; i < n; ++i )
+    {
+        maxLiftDiff = std::max( maxLiftDiff,
+                                pointDifference( Eigen::Map< const Eigen::Vector3d >( &P[3 * i] ).eval( ),
+                                                 Eigen::Map< const Eigen::Vector3d >( &P_other[3 * i] ).eval( ) ) );
+        maxProjectionDiff
+        = std::max( maxProjectionDiff,
+                    pointDifference( Eigen::Map< const Eigen::Vector2d >( &q[2 * i] ).eval( ),
+                                     Eigen::Map< const Eigen::Vector2d >( &q_other[2 * i] ).eval( ) ) );
+    }
+}
+
+// Lift table of the fisheye models against their exact solvers over the
+// radii of the table, and lift throughput of the camera over the image
+int
+checkLift( const camodocal::CameraConstPtr& camera )
+{
+    // same polynomial and exact solver as the camera uses outside its table
+    std::vector< double > coeff;
+    double maxTheta;
+    std::function< double( double ) > exactTheta;
+    if ( camera->modelType( ) == camodocal::Camera::KANNALA_BRANDT )
+    {
+        const camodocal::EquidistantCamera* equidistant
+        = static_cast< const camodocal::EquidistantCamera* >( camera.get( ) );
+        const camodocal::EquidistantCamera::Parameters& params = equidistant->getParameters( );
+        coeff.assign( 10, 0.0 );
+        coeff[1]   = 1.0;
+        coeff[3]   = params.k2( );
+        coeff[5]   = params.k3( );
+        coeff[7]   = params.k4( );
+        coeff[9]   = params.k5( );
+        maxTheta   = M_PI;
+        exactTheta = [equidistant]( double r ) { return equidistant->solveTheta( r ); };
+    }
+    else if ( camera->modelType( ) == camodocal::Camera::POLYFISHEYE )
+    {
+        const camodocal::PolyFisheyeCamera* polyFisheye
+        = static_cast< const camodocal::PolyFisheyeCamera* >( camera.get( ) );
+        eigen_utils::Vector polyCoeff = polyFisheye->getPoly( )->getPolyCoeff( );
+        coeff.assign( polyCoeff.data( ), polyCoeff.data( ) + polyCoeff.size( ) );
+        maxTheta   = MAX_INCIDENT_ANGLE_DEGREE / RAD2DEG;
+        exactTheta = [polyFisheye, maxTheta]( double r ) {
+            return polyFisheye->getPoly( )->getOneRealRoot( r, 0.0, maxTheta );
+        };
+    }
+    else
+    {
+        std::cerr << "# ERROR: The lift check needs a kannala-brandt or polyfisheye camera." << std::endl;
+        return 1;
+    }
+
+    camodocal::RadialInverseTable table;
+    table.build( coeff, maxTheta );
+    if ( !table.valid( ) )
+    {
+        std::cerr << "# ERROR: No lift table for this camera." << std::endl;
+        return 1;
+    }
+
+    std::vector< double > radii( BENCH_LIFT_SAMPLES );
+    for ( int i = 0; i < BENCH_LIFT_SAMPLES; ++i )
+    {
+        radii[i] = table.maxR( ) * ( i + 0.5 ) / BENCH_LIFT_SAMPLES;
+    }
+
+    std::vector< double > thetaTable( BENCH_LIFT_SAMPLES ), thetaExact( BENCH_LIFT_SAMPLES );
+    double startTime = camodocal::timeInSeconds( );
+    for ( int i = 0; i < BENCH_LIFT_SAMPLES; ++i )
+    {
+        table.theta( radii[i], thetaTable[i] );
+    }
+    double tableTime = camodocal::timeInSeconds( ) - startTime;
+
+    startTime = camodocal::timeInSeconds( );
+    for ( int i = 0; i < BENCH_LIFT_SAMPLES; ++i )
+    {
+        thetaExact[i] = exactTheta( radii[i] );
+    }
+    double exactTime = camodocal::timeInSeconds( ) - startTime;
+
+    double maxThetaDiff = 0.0;
+    for ( int i = 0; i < BENCH_LIFT_SAMPLES; ++i )
+    {
+        maxThetaDiff = std::max( maxThetaDiff, std::abs( thetaTable[i] - thetaExact[i] ) );
+    }
+
+    std::cout << "# INFO: Lift table up to " << table.maxTheta( ) * RAD2DEG << " deg, max difference to the exact solver "
+              << maxThetaDiff << " rad over " << BENCH_LIFT_SAMPLES << " radii, table "
+              << BENCH_LIFT_SAMPLES / tableTime * 1e-6 << " M points/sec, exact "
+              << BENCH_LIFT_SAMPLES / exactTime * 1e-6 << " M points/sec." << std::endl;
+
+    // every pixel of the image through the camera
+    std::vector< double > p;
+    for ( int v = 0; v < camera->imageHeight( ); ++v )
+    {
+        for ( int u = 0; u < camera->imageWidth( ); ++u )
+        {
+            p.push_back( u );
+            p.push_back( v );
+        }
+    }
+    int n = p.size( ) / 2;
+
+    std::vector< double > P( 3 * n ), q( 2 * n );
+    startTime = camodocal::timeInSeconds( );
+    camera->liftProjectiveBatch( p.data( ), P.data( ), n );
+    double liftTime = camodocal::timeInSeconds( ) - startTime;
+    camera->spaceToPlaneBatch( P.data( ), q.data( ), n );
+
+    double maxRoundTrip = 0.0;
+    for ( int i = 0; i < n; ++i )
+    {
+        maxRoundTrip = std::max( maxRoundTrip, std::hypot( q[2 * i] - p[2 * i], q[2 * i + 1] - p[2 * i + 1] ) );
+    }
+
+    std::cout << "# INFO: Lifted " << n << " pixels at " << n / liftTime * 1e-6
+              << " M points/sec, max round trip error " << maxRoundTrip << " px." << std::endl;
+
+    // NaN fails the comparisons as well
+    if ( !( maxThetaDiff <= BENCH_LIFT_TOLERANCE ) || !( maxRoundTrip <= BENCH_ROUND_TRIP_TOLERANCE ) )
+    {
+        std::cerr << "# ERROR: Lift check failed, tolerances " << BENCH_LIFT_TOLERANCE << " rad and "
+                  << BENCH_ROUND_TRIP_TOLERANCE << " px." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Batched lift and projection against the single point calls over
+// increasing point counts, with the throughput of both
+int
+checkBatch( const camodocal::CameraConstPtr& camera )
+{
+    const int pointCounts[] = { 100, 1000, 10000, 100000, 1000000 };
+
+    std::mt19937 rng( 0 );
+    std::uniform_real_distribution< double > uniform( 0.0, 1.0 );
+
+    double maxLiftDiff = 0.0, maxProjectionDiff = 0.0;
+    for ( int n : pointCounts )
+    {
+        std::vector< double > p( 2 * n );
+        for ( int i = 0; i < n; ++i )
+        {
+            p[2 * i]     = uniform( rng ) * ( camera->imageWidth( ) - 1 );
+            p[2 * i + 1] = uniform( rng ) * ( camera->imageHeight( ) - 1 );
+        }
+
+        std::vector< double > P( 3 * n ), P_single( 3 * n );
+        double startTime = camodocal::timeInSeconds( );
+        camera->liftProjectiveBatch( p.data( ), P.data( ), n );
+        double liftBatchTime = camodocal::timeInSeconds( ) - startTime;
+
+        startTime = camodocal::timeInSeconds( );
+        for ( int i = 0; i < n; ++i )
+        {
+            Eigen::Vector3d ray;
+            camera->liftProjective( Eigen::Vector2d( p[2 * i], p[2 * i + 1] ), ray );
+            Eigen::Map< Eigen::Vector3d >( &P_single[3 * i] ) = ray;
+        }
+        double liftSingleTime = camodocal::timeInSeconds( ) - startTime;
+
+        // project the rays of the single point lift so both paths get the same input
+        std::vector< double > q( 2 * n ), q_single( 2 * n );
+        startTime = camodocal::timeInSeconds( );
+        camera->spaceToPlaneBatch( P_single.data( ), q.data( ), n );
+        double projectBatchTime = camodocal::timeInSeconds( ) - startTime;
+
+        startTime = camodocal::timeInSeconds( );
+        for ( int i = 0; i < n; ++i )
+        {
+            Eigen::Vector2d pixel;
+            camera->spaceToPlane( Eigen::Map< const Eigen::Vector3d >( &P_single[3 * i] ), pixel );
+            q_single[2 * i]     = pixel( 0 );
+            q_single[2 * i + 1] = pixel( 1 );
+        }
+        double projectSingleTime = camodocal::timeInSeconds( ) - startTime;
+
+        // rays of the single point lift may have any scale, compare directions
+        for ( int i = 0; i < n; ++i )
+        {
+            Eigen::Vector3d ray        = Eigen::Map< const Eigen::Vector3d >( &P[3 * i] ).normalized( );
+            Eigen::Vector3d ray_single = Eigen::Map< const Eigen::Vector3d >( &P_single[3 * i] ).normalized( );
+            maxLiftDiff                = std::max( maxLiftDiff, pointDifference( ray, ray_single ) );
+        }
+        for ( int i = 0; i < n; ++i )
+        {
+            Eigen::Vector2d pixel        = Eigen::Map< const Eigen::Vector2d >( &q[2 * i] );
+            Eigen::Vector2d pixel_single = Eigen::Map< const Eigen::Vector2d >( &q_single[2 * i] );
+            maxProjectionDiff            = std::max( maxProjectionDiff, pointDifference( pixel, pixel_single ) );
+        }
+
+        std::cout << "# INFO: " << std::setw( 7 ) << n << " points, lift batch " << n / liftBatchTime * 1e-6
+                  << " single " << n / liftSingleTime * 1e-6 << ", projection batch "
+                  << n / projectBatchTime * 1e-6 << " single " << n / projectSingleTime * 1e-6
+                  << " M points/sec." << std::endl;
+    }
+
+    std::cout << "# INFO: Batch against single point calls, max ray difference " << maxLiftDiff
+              << ", max projection difference " << maxProjectionDiff << " px." << std::endl;
+
+    if ( maxLiftDiff > BENCH_BATCH_TOLERANCE || maxProjectionDiff > BENCH_BATCH_TOLERANCE )
+    {
+        std::cerr << "# ERROR: Batch check failed, tolerance " << BENCH_BATCH_TOLERANCE << "." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Analytic reprojection cost against the autodiff one on random poses and
+// points, residual and all three jacobian blocks, with the throughput of both
+int
+checkJacobian( const camodocal::CameraConstPtr& camera )
+{
+    if ( camera->modelType( ) != camodocal::Camera::KANNALA_BRANDT
+         && camera->modelType( ) != camodocal::Camera::PINHOLE && camera->modelType( ) != camodocal::Camera::MEI )
+    {
+        std::cerr << "# ERROR: There is no analytic cost function for this camera model." << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng( 0 );
+    std::uniform_real_distribution< double > uniform( -1.0, 1.0 );
+
+    std::vector< double > intrinsics;
+    camera->writeParameters( intrinsics );
+
+    std::vector< ceres::CostFunction* > analyticCosts, autodiffCosts;
+    std::vector< std::vector< double > > poses;
+    for ( int i = 0; i < BENCH_JACOBIAN_TRIALS; ++i )
+    {
+        // point in front of the camera inside a moderate field of view, so
+        // that every model projects it
+        Eigen::Vector3d P_c( uniform( rng ), uniform( rng ), 3.0 + uniform( rng ) );
+        Eigen::Vector3d P( uniform( rng ), uniform( rng ), uniform( rng ) );
+
+        Eigen::Quaterniond q( Eigen::AngleAxisd( M_PI * uniform( rng ),
+                                                 Eigen::Vector3d( uniform( rng ), uniform( rng ), uniform( rng ) )
+                                                 .normalized( ) ) );
+        Eigen::Vector3d t = P_c - q * P;
+
+        Eigen::Vector2d p;
+        camera->spaceToPlane( P_c, p );
+        p += Eigen::Vector2d( uniform( rng ), uniform( rng ) ) * 2.0;
+
+        // the costs normalize the quaternion, keep its scale off 1 to check that too
+        double scale = 1.0 + 0.5 * uniform( rng );
+        poses.push_back( { scale * q.x( ), scale * q.y( ), scale * q.z( ), scale * q.w( ), t( 0 ), t( 1 ), t( 2 ) } );
+
+        analyticCosts.push_back( camodocal::CostFunctionFactory::instance( )->generateCostFunction(
+        camera, P, p, camodocal::CAMERA_INTRINSICS | camodocal::CAMERA_POSE | camodocal::ANALYTIC_JACOBIAN ) );
+        autodiffCosts.push_back( camodocal::CostFunctionFactory::instance( )->generateCostFunction(
+        camera, P, p, camodocal::CAMERA_INTRINSICS | camodocal::CAMERA_POSE ) );
+    }
+
+    const std::vector< int32_t >& sizes = autodiffCosts[0]->parameter_block_sizes( );
+    const char* blockNames[] = { "intrinsics", "rotation", "translation" };
+
+    // evaluates a cost of trial i into the residual and the row major jacobians
+    auto evaluate = [&]( ceres::CostFunction* cost, int i, double* residual, std::vector< double >* jacobians ) {
+        double* parameters[] = { intrinsics.data( ), &poses[i][0], &poses[i][4] };
+        double* jacobianPtrs[] = { jacobians[0].data( ), jacobians[1].data( ), jacobians[2].data( ) };
+        return cost->Evaluate( parameters, residual, jacobianPtrs );
+    };
+
+    double maxResidualDiff = 0.0, maxJacobianDiff[3] = { 0.0, 0.0, 0.0 };
+    bool evaluated = true;
+    for ( int i = 0; i < BENCH_JACOBIAN_TRIALS; ++i )
+    {
+        double residualAnalytic[2], residualAutodiff[2];
+        std::vector< double > jacobiansAnalytic[3], jacobiansAutodiff[3];
+        for ( int b = 0; b < 3; ++b )
+        {
+            jacobiansAnalytic[b].resize( 2 * sizes[b] );
+            jacobiansAutodiff[b].resize( 2 * sizes[b] );
+        }
+        evaluated &= evaluate( analyticCosts[i], i, residualAnalytic, jacobiansAnalytic );
+        evaluated &= evaluate( autodiffCosts[i], i, residualAutodiff, jacobiansAutodiff );
+
+        double residualDiff = std::hypot( residualAnalytic[0] - residualAutodiff[0],
+                                          residualAnalytic[1] - residualAutodiff[1] );
+        maxResidualDiff     = std::max( maxResidualDiff, residualDiff == residualDiff ? residualDiff : INFINITY );
+
+        for ( int b = 0; b < 3; ++b )
+        {
+            double scale = 0.0, diff = 0.0;
+            for ( size_t k = 0; k < jacobiansAutodiff[b].size( ); ++k )
+            {
+                scale = std::max( scale, std::abs( jacobiansAutodiff[b][k] ) );
+                diff  = std::max( diff, std::abs( jacobiansAnalytic[b][k] - jacobiansAutodiff[b][k] ) );
+            }
+            // NaN fails the tolerance below as well
+            diff               = scale > 0.0 ? diff / scale : diff;
+            maxJacobianDiff[b] = std::max( maxJacobianDiff[b], diff == diff ? diff : INFINITY );
+        }
+    }
+
+    std::vector< double > jacobians[3];
+    for ( int b = 0; b < 3; ++b )
+    {
+        jacobians[b].resize( 2 * sizes[b] );
+    }
+    double residual[2];
+
+    double startTime = camodocal::timeInSeconds( );
+    for ( int i = 0; i < BENCH_JACOBIAN_TRIALS; ++i )
+    {
+        evaluate( analyticCosts[i], i, residual, jacobians );
+    }
+    double analyticTime = camodocal::timeInSeconds( ) - startTime;
+
+    startTime = camodocal::timeInSeconds( );
+    for ( int i = 0; i < BENCH_JACOBIAN_TRIALS; ++i )
+    {
+        evaluate( autodiffCosts[i], i, residual, jacobians );
+    }
+    double autodiffTime = camodocal::timeInSeconds( ) - startTime;
+
+    for ( int i = 0; i < BENCH_JACOBIAN_TRIALS; ++i )
+    {
+        delete analyticCosts[i];
+        delete autodiffCosts[i];
+    }
+
+    std::cout << "# INFO: Evaluated " << BENCH_JACOBIAN_TRIALS << " costs with jacobians, analytic "
+              << BENCH_JACOBIAN_TRIALS / analyticTime * 1e-6 << " autodiff "
+              << BENCH_JACOBIAN_TRIALS / autodiffTime * 1e-6 << " M evaluations/sec." << std::endl;
+    std::cout << "# INFO: Analytic against autodiff, max residual difference " << maxResidualDiff << " px";
+    for ( int b = 0; b < 3; ++b )
+    {
+        std::cout << ", " << blockNames[b] << " jacobian " << maxJacobianDiff[b];
+    }
+    std::cout << "." << std::endl;
+
+    if ( !evaluated || !( maxResidualDiff <= BENCH_JACOBIAN_TOLERANCE )
+         || !( maxJacobianDiff[0] <= BENCH_JACOBIAN_TOLERANCE ) || !( maxJacobianDiff[1] <= BENCH_JACOBIAN_TOLERANCE )
+         || !( maxJacobianDiff[2] <= BENCH_JACOBIAN_TOLERANCE ) )
+    {
+        std::cerr << "# ERROR: Jacobian check failed, tolerance " << BENCH_JACOBIAN_TOLERANCE << "." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Newton undistortion of CataCamera against the fixed point loop it replaced,
+// over every pixel of the image, with the throughput of both
+int
+checkUndistortion( const camodocal::CameraConstPtr& camera )
+{
+    if ( camera->modelType( ) != camodocal::Camera::MEI )
+    {
+        std::cerr << "# ERROR: The undistortion check needs a mei camera." << std::endl;
+        return 1;
+    }
+
+    const camodocal::CataCamera* cata = static_cast< const camodocal::CataCamera* >( camera.get( ) );
+    const camodocal::CataCamera::Parameters& params = cata->getParameters( );
+
+    std::vector< Eigen::Vector2d > p_d;
+    for ( int v = 0; v < camera->imageHeight( ); ++v )
+    {
+        for ( int u = 0; u < camera->imageWidth( ); ++u )
+        {
+            p_d.push_back( Eigen::Vector2d( ( u - params.u0( ) ) / params.gamma1( ),
+                                            ( v - params.v0( ) ) / params.gamma2( ) ) );
+        }
+    }
+    size_t n = p_d.size( );
+
+    std::vector< Eigen::Vector2d > p_fixed( n ), p_newton( n );
+    std::vector< double > reported( n );
+    double startTime = camodocal::timeInSeconds( );
+    for ( size_t i = 0; i < n; ++i )
+    {
+        Eigen::Vector2d d_u;
+        cata->distortion( p_d[i], d_u );
+        p_fixed[i] = p_d[i] - d_u;
+        for ( int iter = 1; iter < BENCH_FIXED_POINT_ITERATIONS; ++iter )
+        {
+            cata->distortion( p_fixed[i], d_u );
+            p_fixed[i] = p_d[i] - d_u;
+        }
+    }
+    double fixedTime = camodocal::timeInSeconds( ) - startTime;
+
+    startTime = camodocal::timeInSeconds( );
+    for ( size_t i = 0; i < n; ++i )
+    {
+        reported[i] = cata->undistortion( p_d[i], p_newton[i] );
+    }
+    double newtonTime = camodocal::timeInSeconds( ) - startTime;
+
+    // residual of a solution in pixels
+    auto pixelResidual = [&]( const Eigen::Vector2d& p_u, const Eigen::Vector2d& p_d, double& residual ) {
+        Eigen::Vector2d d_u;
+        cata->distortion( p_u, d_u );
+        Eigen::Vector2d r = p_u + d_u - p_d;
+        residual          = r.norm( );
+        return std::hypot( r( 0 ) * params.gamma1( ), r( 1 ) * params.gamma2( ) );
+    };
+
+    double maxFixed = 0.0, maxNewton = 0.0, maxNewtonConverged = 0.0, maxDiff = 0.0, maxBoundError = 0.0;
+    size_t converged = 0;
+    for ( size_t i = 0; i < n; ++i )
+    {
+        double residualFixed, residualNewton;
+        double errFixed  = pixelResidual( p_fixed[i], p_d[i], residualFixed );
+        double errNewton = pixelResidual( p_newton[i], p_d[i], residualNewton );
+        if ( errFixed == errFixed )
+        {
+            maxFixed = std::max( maxFixed, errFixed );
+        }
+        maxNewton = std::max( maxNewton, errNewton != errNewton ? INFINITY : errNewton );
+
+        // the reported residual has to be the residual of the returned point
+        double boundError = std::abs( reported[i] - residualNewton );
+        maxBoundError     = std::max( maxBoundError, boundError != boundError ? INFINITY : boundError );
+
+        // where the old loop converged Newton has to converge to the same point
+        if ( errFixed < BENCH_UNDISTORT_TOLERANCE )
+        {
+            ++converged;
+            maxNewtonConverged = std::max( maxNewtonConverged, errNewton != errNewton ? INFINITY : errNewton );
+            Eigen::Vector2d diff = p_newton[i] - p_fixed[i];
+            maxDiff = std::max( maxDiff, std::hypot( diff( 0 ) * params.gamma1( ), diff( 1 ) * params.gamma2( ) ) );
+        }
+    }
+
+    std::cout << "# INFO: Undistorted " << n << " pixels, fixed point " << n / fixedTime * 1e-6
+              << " M points/sec, Newton " << n / newtonTime * 1e-6 << " M points/sec." << std::endl;
+    std::cout << "# INFO: Max residual fixed point " << maxFixed << " px, Newton " << maxNewton
+              << " px, Newton where the fixed point converged (" << converged << " pixels) " << maxNewtonConverged
+              << " px, max difference there " << maxDiff << " px, max error of the reported residual "
+              << maxBoundError << "." << std::endl;
+
+    if ( !( maxNewtonConverged <= BENCH_UNDISTORT_TOLERANCE ) || !( maxDiff <= BENCH_UNDISTORT_AGREEMENT )
+         || !( maxBoundError <= 1e-12 ) )
+    {
+        std::cerr << "# ERROR: Undistortion check failed, tolerances " << BENCH_UNDISTORT_TOLERANCE << " px residual, "
+                  << BENCH_UNDISTORT_AGREEMENT << " px difference, 1e-12 reported residual." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Rectify map built with parallel rows and the batched projection against a
+// serial build with the single point projection, at the virtual camera sizes
+// of the fisheye front end and larger, with the build time of both
+int
+checkMap( const camodocal::CameraConstPtr& camera )
+{
+    const cv::Size mapSizes[] = { cv::Size( 1280, 1024 ), cv::Size( 2048, 1536 ), cv::Size( 3840, 2160 ) };
+
+    double maxDiff = 0.0;
+    for ( const cv::Size& mapSize : mapSizes )
+    {
+        // the rays of all models are R^-1 K_rect^-1 (u, v, 1) in float
+        float f = mapSize.width / 3.0f, cx = mapSize.width / 2.0f, cy = mapSize.height / 2.0f;
+        Eigen::Matrix3f K_rect;
+        K_rect << f, 0, cx, 0, f, cy, 0, 0, 1;
+        Eigen::Matrix3f K_rect_inv = Eigen::Matrix3f::Identity( ).inverse( ) * K_rect.inverse( );
+
+        cv::Mat map1, map2;
+        double startTime = camodocal::timeInSeconds( );
+        camera->initUndistortRectifyMap( map1, map2, f, f, mapSize, cx, cy );
+        double parallelTime = camodocal::timeInSeconds( ) - startTime;
+
+        cv::Mat mapX( mapSize, CV_32F ), mapY( mapSize, CV_32F );
+        startTime = camodocal::timeInSeconds( );
+        for ( int v = 0; v < mapSize.height; ++v )
+        {
+            for ( int u = 0; u < mapSize.width; ++u )
+            {
+                Eigen::Vector3f uo = K_rect_inv * Eigen::Vector3f( u, v, 1 );
+                Eigen::Vector2d pixel;
+                camera->spaceToPlane( uo.cast< double >( ), pixel );
+                mapX.at< float >( v, u ) = pixel( 0 );
+                mapY.at< float >( v, u ) = pixel( 1 );
+            }
+        }
+        double serialTime = camodocal::timeInSeconds( ) - startTime;
+
+        for ( int v = 0; v < mapSize.height; ++v )
+        {
+            for ( int u = 0; u < mapSize.width; ++u )
+            {
+                Eigen::Vector2d pixel( map1.at< float >( v, u ), map2.at< float >( v, u ) );
+                Eigen::Vector2d pixel_serial( mapX.at< float >( v, u ), mapY.at< float >( v, u ) );
+                maxDiff = std::max( maxDiff, pointDifference( pixel, pixel_serial ) );
+            }
+        }
+
+        std::cout << "# INFO: " << mapSize.width << "x" << mapSize.height << " rectify map, parallel "
+                  << parallelTime * 1e3 << " ms, serial " << serialTime * 1e3 << " ms." << std::endl;
+    }
+
+    std::cout << "# INFO: Parallel against serial map, max difference " << maxDiff << " px." << std::endl;
+
+    if ( !( maxDiff <= BENCH_MAP_TOLERANCE ) )
+    {
+        std::cerr << "# ERROR: Map check failed, tolerance " << BENCH_MAP_TOLERANCE << " px." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int
+main( int argc, char** argv )
+{
+    cv::Size boardSize;
+    cv::Size imageSize;
+    float squareSize;
+    std::string cameraModel;
+    std::string cameraFile;
+    int viewCount;
+    double noise;
+    unsigned int seed;
+    int numThreads;
+    bool render;
+    bool analytic;
+    bool useOpenCV;
+    bool verbose;
+    std::string check;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc( "Allowed options" );
+    desc.add_options( )( "help", "produce help message" )(
+    "width,w",
+    boost::program_options::value< int >( &boardSize.width )->default_value( 8 ),
+    "Number of inner corners on the chessboard pattern in x direction" )(
+    "height,h",
+    boost::program_options::value< int >( &boardSize.height )->default_value( 12 ),
+    "Number of inner corners on the chessboard pattern in y direction" )(
+    "size,s",
+    boost::program_options::value< float >( &squareSize )->default_value( 7.f ),
+    "Size of one square in mm" )(
+    "image-width",
+    boost::program_options::value< int >( &imageSize.width )->default_value( 752 ),
+    "Image width of the default ground truth cameras" )(
+    "image-height",
+    boost::program_options::value< int >( &imageSize.height )->default_value( 480 ),
+    "Image height of the default ground truth cameras" )(
+    "camera-model",
+    boost::program_options::value< std::string >( &cameraModel )->default_value( "mei" ),
+    "Camera model: kannala-brandt | mei | pinhole | pinhole_full | scaramuzza" )(
+    "camera-file",
+    boost::program_options::value< std::string >( &cameraFile )->default_value( "" ),
+    "Ground truth camera yaml file, overrides the camera model" )(
+    "views,n",
+    boost::program_options::value< int >( &viewCount )->default_value( 40 ),
+    "Number of chessboard views" )(
+    "noise",
+    boost::program_options::value< double >( &noise )->default_value( 0.2 ),
+    "Corner noise in pixels, image noise in gray levels when rendering" )(
+    "seed",
+    boost::program_options::value< unsigned int >( &seed )->default_value( 1 ),
+    "Random seed" )(
+    "threads",
+    boost::program_options::value< int >( &numThreads )->default_value( 0 ),
+    "Number of threads, 0 for the OpenCV default" )(
+    "render",
+    boost::program_options::bool_switch( &render )->default_value( false ),
+    "Render the views and detect the corners instead of projecting them" )(
+    "analytic",
+    boost::program_options::bool_switch( &analytic )->default_value( false ),
+    "Use the analytic jacobian cost functions instead of autodiff" )(
+    "opencv",
+    boost::program_options::bool_switch( &useOpenCV )->default_value( false ),
+    "Use OpenCV to detect corners when rendering" )(
+    "verbose,v",
+    boost::program_options::bool_switch( &verbose )->default_value( false ),
+    "Verbose output" )(
+    "check",
+    boost::program_options::value< std::string >( &check )->default_value( "" ),
+    "Run a check of the ground truth camera instead of a calibration: lift | batch | undistort | map | jacobian" );
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store( boost::program_options::parse_command_line( argc, argv, desc ), vm );
+    boost::program_options::notify( vm );
+
+    if ( vm.count( "help" ) )
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    if ( numThreads > 0 )
+    {
+        cv::setNumThreads( numThreads );
+    }
+
+    //========= Ground truth camera =========
+    camodocal::CameraPtr groundTruth;
+    if ( !cameraFile.empty( ) )
+    {
+        double loadStartTime = camodocal::timeInSeconds( );
+        groundTruth = camodocal::CameraFactory::instance( )->generateCameraFromYamlFile( cameraFile );
+        double loadTime = camodocal::timeInSeconds( ) - loadStartTime;
+        if ( groundTruth.get( ) == 0 )
+        {
+            std::cerr << "# ERROR: Cannot read camera file " << cameraFile << "." << std::endl;
+            return 1;
+        }
+
+        // the second load comes from the CameraFactory cache for the models
+        // with lift tables, it has to behave exactly like the first one
+        loadStartTime = camodocal::timeInSeconds( );
+        camodocal::CameraPtr reloaded
+        = camodocal::CameraFactory::instance( )->generateCameraFromYamlFile( cameraFile );
+        double reloadTime = camodocal::timeInSeconds( ) - loadStartTime;
+
+        double maxLiftDiff, maxProjectionDiff;
+        compareCameras( groundTruth, reloaded, maxLiftDiff, maxProjectionDiff );
+
+        std::cout << "# INFO: Camera file loaded in " << loadTime * 1000.0 << " ms, reloaded in "
+                  << reloadTime * 1000.0 << " ms, max lift difference " << maxLiftDiff
+                  << ", max projection difference " << maxProjectionDiff << " px." << std::endl;
+
+        // the cache stores the exact state, any difference is a bug
+        if ( maxLiftDiff != 0.0 || maxProjectionDiff != 0.0 )
+        {
+            std::cerr << "# ERROR: The cached camera differs from the parsed one." << std::endl;
+            return 1;
+        }
+        imageSize = cv::Size( groundTruth->imageWidth( ), groundTruth->imageHeight( ) );
+    }
+    else
+    {
+        camodocal::Camera::ModelType modelType;
+        if ( boost::iequals( cameraModel, "kannala-brandt" ) )
+        {
+            modelType = camodocal::Camera::KANNALA_BRANDT;
+        }
+        else if ( boost::iequals( cameraModel, "mei" ) )
+        {
+            modelType = camodocal::Camera::MEI;
+        }
+        else if ( boost::iequals( cameraModel, "pinhole" ) )
+        {
+            modelType = camodocal::Camera::PINHOLE;
+        }
+        else if ( boost::iequals( cameraModel, "pinhole_full" ) )
+        {
+            modelType = camodocal::Camera::PINHOLE_FULL;
+        }
+        else if ( boost::iequals( cameraModel, "scaramuzza" ) )
+        {
+            std::cerr << "# ERROR: Scaramuzza ground truth needs a camera file." << std::endl;
+            return 1;
+        }
+        else
+        {
+            std::cerr << "# ERROR: Unknown camera model: " << cameraModel << std::endl;
+            return 1;
+        }
+
+        groundTruth = generateGroundTruth( modelType, imageSize );
+    }
+
+    if ( !check.empty( ) )
+    {
+        if ( boost::iequals( check, "lift" ) )
+        {
+            return checkLift( groundTruth );
+        }
+        if ( boost::iequals( check, "batch" ) )
+        {
+            return checkBatch( groundTruth );
+        }
+        if ( boost::iequals( check, "undistort" ) )
+        {
+            return checkUndistortion( groundTruth );
+        }
+        if ( boost::iequals( check, "map" ) )
+        {
+            return checkMap( groundTruth );
+        }
+        if ( boost::iequals( check, "jacobian" ) )
+        {
+            return checkJacobian( groundTruth );
+        }
+
+        std::cerr << "# ERROR: Unknown check: " << check << std::endl;
+        return 1;
+    }
+
+    // CameraCalibration builds its camera with CameraFactory::generateCamera
+    // and CostFunctionFactory, which only know these models
+    camodocal::Camera::ModelType modelType = groundTruth->modelType( );
+    if ( modelType != camodocal::Camera::KANNALA_BRANDT && modelType != camodocal::Camera::MEI
+         && modelType != camodocal::Camera::PINHOLE && modelType != camodocal::Camera::PINHOLE_FULL
+         && modelType != camodocal::Camera::SCARAMUZZA )
+    {
+        std::cerr << "# ERROR: CameraCalibration does not support this camera model." << std::endl;
+        return 1;
+    }
+
+    std::cout << "# INFO: Ground truth " << groundTruth->parametersToString( ) << std::endl;
+
+    camodocal::CameraCalibration calibration( modelType, "camera", imageSize, boardSize, squareSize );
+    calibration.setVerbose( verbose );
+    calibration.setNumThreads( numThreads );
+    calibration.setAnalyticJacobians( analytic );
+
+    std::vector< cv::Point3f > scenePoints;
+    for ( int i = 0; i < boardSize.height; ++i )
+    {
+        for ( int j = 0; j < boardSize.width; ++j )
+        {
+            scenePoints.push_back( cv::Point3f( i * squareSize, j * squareSize, 0.0 ) );
+        }
+    }
+
+    //========= Chessboard observations =========
+    std::mt19937 rng( seed );
+    std::normal_distribution< double > cornerNoise( 0.0, std::max( noise, 1e-9 ) );
+
+    std::vector< std::vector< cv::Point2f > > trueCorners( viewCount );
+    std::vector< Eigen::Matrix3d, Eigen::aligned_allocator< Eigen::Matrix3d > > rotations( viewCount );
+    std::vector< Eigen::Vector3d, Eigen::aligned_allocator< Eigen::Vector3d > > translations( viewCount );
+    for ( int i = 0; i < viewCount; ++i )
+    {
+        if ( !generateView( groundTruth, scenePoints, rng, trueCorners.at( i ), rotations.at( i ), translations.at( i ) ) )
+        {
+            std::cerr << "# ERROR: Cannot fit the board in the image, use a smaller board." << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector< std::vector< cv::Point2f > > corners( viewCount );
+    if ( render )
+    {
+        double renderStartTime = camodocal::timeInSeconds( );
+        std::vector< cv::Mat > images( viewCount );
+        for ( int i = 0; i < viewCount; ++i )
+        {
+            images.at( i ) = renderView( groundTruth, boardSize, squareSize, rotations.at( i ),
+                                         translations.at( i ), noise, seed + i * imageSize.height );
+        }
+
+        // same parallel detection as intrinsic_calib
+        double detectStartTime = camodocal::timeInSeconds( );
+        cv::parallel_for_( cv::Range( 0, viewCount ), [&]( const cv::Range& range ) {
+            for ( int i = range.start; i < range.end; ++i )
+            {
+                camodocal::Chessboard chessboard( boardSize, images.at( i ) );
+
+                chessboard.findCorners( useOpenCV );
+                if ( chessboard.cornersFound( ) )
+                {
+                    corners.at( i ) = chessboard.getCorners( );
+                }
+            }
+        } );
+        double detectEndTime = camodocal::timeInSeconds( );
+
+        // detected corners may come in any board orientation, match them to
+        // the closest true corner
+        int found = 0;
+        double errSum = 0.0, errMax = 0.0;
+        size_t errCount = 0;
+        for ( int i = 0; i < viewCount; ++i )
+        {
+            if ( corners.at( i ).empty( ) )
+            {
+                continue;
+            }
+
+            ++found;
+            for ( size_t j = 0; j < corners.at( i ).size( ); ++j )
+            {
+                double err = 1e10;
+                for ( size_t k = 0; k < trueCorners.at( i ).size( ); ++k )
+                {
+                    err = std::min( err, cv::norm( corners.at( i ).at( j ) - trueCorners.at( i ).at( k ) ) );
+                }
+                errSum += err;
+                errMax = std::max( errMax, err );
+                ++errCount;
+            }
+        }
+
+        std::cout << "# INFO: Rendering " << viewCount << " views took " << detectStartTime - renderStartTime
+                  << " sec." << std::endl;
+        std::cout << "# INFO: Detected " << found << " of " << viewCount << " boards in "
+                  << detectEndTime - detectStartTime << " sec, corner error mean "
+                  << ( errCount > 0 ? errSum / errCount : 0.0 ) << " max " << errMax << " pixels." << std::endl;
+    }
+    else
+    {
+        for ( int i = 0; i < viewCount; ++i )
+        {
+            for ( size_t j = 0; j < trueCorners.at( i ).size( ); ++j )
+            {
+                cv::Point2f corner = trueCorners.at( i ).at( j );
+                if ( noise > 0.0 )
+                {
+                    corner.x += cornerNoise( rng );
+                    corner.y += cornerNoise( rng );
+                }
+                corners.at( i ).push_back( corner );
+            }
+        }
+    }
+
+    for ( int i = 0; i < viewCount; ++i )
+    {
+        if ( !corners.at( i ).empty( ) )
+        {
+            calibration.addChessboardData( corners.at( i ) );
+        }
+    }
+
+    if ( calibration.sampleCount( ) < 3 )
+    {
+        std::cerr << "# ERROR: Too few chessboards for calibration." << std::endl;
+        return 1;
+    }
+
+    //========= Calibration =========
+    double startTime = camodocal::timeInSeconds( );
+    calibration.calibrate( );
+    double calibrationTime = camodocal::timeInSeconds( ) - startTime;
+
+    const camodocal::CameraConstPtr camera = calibration.camera( );
+
+    std::vector< double > trueParams, estimatedParams;
+    groundTruth->writeParameters( trueParams );
+    camera->writeParameters( estimatedParams );
+
+    std::cout << "# INFO: Estimated " << camera->parametersToString( ) << std::endl;
+    std::cout << "# INFO: Calibration of " << calibration.sampleCount( ) << " views took " << calibrationTime
+              << " sec, " << calibration.solverIterations( ) << " solver iterations." << std::endl;
+
+    // reprojection statistics of the calibrated views
+    std::vector< cv::Mat > rvecs, tvecs;
+    for ( int i = 0; i < calibration.sampleCount( ); ++i )
+    {
+        rvecs.push_back( calibration.cameraPoses( ).row( i ).colRange( 0, 3 ).t( ) );
+        tvecs.push_back( calibration.cameraPoses( ).row( i ).colRange( 3, 6 ).t( ) );
+    }
+
+    camodocal::Camera::ReprojectionStats stats;
+    startTime = camodocal::timeInSeconds( );
+    camera->reprojectionStatistics( calibration.scenePoints( ), calibration.imagePoints( ), rvecs, tvecs, stats );
+    double statsTime = camodocal::timeInSeconds( ) - startTime;
+
+    std::cout << "# INFO: Reprojection error mean " << stats.meanError << " median " << stats.medianError
+              << " 90% " << stats.percentile90Error << " 99% " << stats.percentile99Error << " max "
+              << stats.maxError << " pixels over " << stats.pointCount << " points in " << statsTime
+              << " sec." << std::endl;
+    std::cout << "# INFO: Parameter errors (estimated - true):" << std::endl;
+    for ( size_t i = 0; i < trueParams.size( ); ++i )
+    {
+        std::cout << "  " << std::setw( 2 ) << i << std::setw( 14 ) << trueParams.at( i ) << std::setw( 14 )
+                  << estimatedParams.at( i ) - trueParams.at( i ) << std::endl;
+    }
+
+    // Model error in pixels over the area covered by the boards: lift with the
+    // true camera and project with the estimated one
+    cv::Rect covered;
+    for ( int i = 0; i < viewCount; ++i )
+    {
+        if ( corners.at( i ).empty( ) )
+        {
+            continue;
+        }
+
+        cv::Rect viewRect = cv::boundingRect( corners.at( i ) );
+        covered           = covered.area( ) > 0 ? ( covered | viewRect ) : viewRect;
+    }
+
+    double modelErrSum = 0.0, modelErrMax = 0.0;
+    size_t modelErrCount = 0;
+    for ( int v = covered.y; v < covered.y + covered.height; v += BENCH_GRID_STEP )
+    {
+        for ( int u = covered.x; u < covered.x + covered.width; u += BENCH_GRID_STEP )
+        {
+            Eigen::Vector3d P;
+            Eigen::Vector2d p;
+            groundTruth->liftProjective( Eigen::Vector2d( u, v ), P );
+            camera->spaceToPlane( P, p );
+
+            double err = ( p - Eigen::Vector2d( u, v ) ).norm( );
+            modelErrSum += err;
+            modelErrMax = std::max( modelErrMax, err );
+            ++modelErrCount;
+        }
+    }
+
+    std::cout << "# INFO: Model error over the observed area mean " << modelErrSum / modelErrCount << " max "
+              << modelErrMax << " pixels." << std::endl;
+
+    return 0;
+}
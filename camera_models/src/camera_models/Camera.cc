@@ -1,11 +1,25 @@
 #include "camodocal/camera_models/Camera.h"
 #include "camodocal/camera_models/ScaramuzzaCamera.h"
 
+#include <algorithm>
 #include <opencv2/calib3d/calib3d.hpp>
 
 namespace camodocal
 {
 
+// rotation matrix and translation of a rvec, tvec pair
+static void
+poseToEigen(const cv::Mat& rvec, const cv::Mat& tvec, Eigen::Matrix3d& R, Eigen::Vector3d& t)
+{
+    cv::Mat R0;
+    cv::Rodrigues(rvec, R0);
+
+    R << R0.at<double>(0,0), R0.at<double>(0,1), R0.at<double>(0,2),
+         R0.at<double>(1,0), R0.at<double>(1,1), R0.at<double>(1,2),
+         R0.at<double>(2,0), R0.at<double>(2,1), R0.at<double>(2,2);
+    t << tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2);
+}
+
 Camera::Parameters::Parameters(ModelType modelType)
  : m_modelType(modelType)
  , m_imageWidth(0)
@@ -140,6 +154,43 @@ Camera::estimateExtrinsics(const std::vector<cv::Point3f>& objectPoints,
     cv::solvePnP(objectPoints, Ms, cv::Mat::eye(3, 3, CV_64F), cv::noArray(), rvec, tvec);
 }
 
+void
+Camera::liftProjectiveBatch(const double* p, double* P, int n) const
+{
+    Eigen::Vector3d P_i;
+    for (int i = 0; i < n; ++i)
+    {
+        liftProjective(Eigen::Vector2d(p[2 * i], p[2 * i + 1]), P_i);
+        P[3 * i] = P_i(0);
+        P[3 * i + 1] = P_i(1);
+        P[3 * i + 2] = P_i(2);
+    }
+}
+
+void
+Camera::spaceToPlaneBatch(const double* P, double* p, int n) const
+{
+    Eigen::Vector2d p_i;
+    for (int i = 0; i < n; ++i)
+    {
+        spaceToPlane(Eigen::Vector3d(P[3 * i], P[3 * i + 1], P[3 * i + 2]), p_i);
+        p[2 * i] = p_i(0);
+        p[2 * i + 1] = p_i(1);
+    }
+}
+
+bool
+Camera::writeState(std::ostream& out) const
+{
+    return false;
+}
+
+bool
+Camera::readState(std::istream& in)
+{
+    return false;
+}
+
 double
 Camera::reprojectionDist(const Eigen::Vector3d& P1, const Eigen::Vector3d& P2) const
 {
@@ -158,43 +209,124 @@ Camera::reprojectionError(const std::vector< std::vector<cv::Point3f> >& objectP
                           const std::vector<cv::Mat>& tvecs,
                           cv::OutputArray _perViewErrors) const
 {
-    int imageCount = objectPoints.size();
-    size_t pointsSoFar = 0;
-    double totalErr = 0.0;
+    ReprojectionStats stats;
+    reprojectionStatistics(objectPoints, imagePoints, rvecs, tvecs, stats);
 
-    bool computePerViewErrors = _perViewErrors.needed();
-    cv::Mat perViewErrors;
-    if (computePerViewErrors)
+    if (_perViewErrors.needed())
     {
-        _perViewErrors.create(imageCount, 1, CV_64F);
-        perViewErrors = _perViewErrors.getMat();
+        _perViewErrors.create(stats.perViewErrors.size(), 1, CV_64F);
+        cv::Mat perViewErrors = _perViewErrors.getMat();
+        for (size_t i = 0; i < stats.perViewErrors.size(); ++i)
+        {
+            perViewErrors.at<double>(i) = stats.perViewErrors.at(i);
+        }
     }
 
-    for (int i = 0; i < imageCount; ++i)
-    {
-        size_t pointCount = imagePoints.at(i).size();
+    return stats.meanError;
+}
 
-        pointsSoFar += pointCount;
+void
+Camera::reprojectionStatistics(const std::vector< std::vector<cv::Point3f> >& objectPoints,
+                               const std::vector< std::vector<cv::Point2f> >& imagePoints,
+                               const std::vector<cv::Mat>& rvecs,
+                               const std::vector<cv::Mat>& tvecs,
+                               ReprojectionStats& stats) const
+{
+    int imageCount = objectPoints.size();
 
-        std::vector<cv::Point2f> estImagePoints;
-        projectPoints(objectPoints.at(i), rvecs.at(i), tvecs.at(i),
-                      estImagePoints);
+    std::vector<Eigen::Matrix2Xd> residuals(imageCount);
+    cv::parallel_for_(cv::Range(0, imageCount), [&](const cv::Range& range)
+    {
+        Eigen::Matrix3Xd P;
+        Eigen::Matrix2Xd p;
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const std::vector<cv::Point3f>& viewObjectPoints = objectPoints.at(i);
+            const std::vector<cv::Point2f>& viewImagePoints = imagePoints.at(i);
+            int pointCount = viewImagePoints.size();
+
+            Eigen::Matrix3d R;
+            Eigen::Vector3d t;
+            poseToEigen(rvecs.at(i), tvecs.at(i), R, t);
+
+            P.resize(3, pointCount);
+            p.resize(2, pointCount);
+            for (int j = 0; j < pointCount; ++j)
+            {
+                const cv::Point3f& objectPoint = viewObjectPoints.at(j);
+                P.col(j) = R * Eigen::Vector3d(objectPoint.x, objectPoint.y, objectPoint.z) + t;
+            }
+            spaceToPlaneBatch(P.data(), p.data(), pointCount);
+
+            residuals.at(i).resize(2, pointCount);
+            for (int j = 0; j < pointCount; ++j)
+            {
+                const cv::Point2f& imagePoint = viewImagePoints.at(j);
+                residuals.at(i).col(j) = Eigen::Vector2d(imagePoint.x, imagePoint.y) - p.col(j);
+            }
+        }
+    });
 
-        double err = 0.0;
-        for (size_t j = 0; j < imagePoints.at(i).size(); ++j)
+    stats.pointCount = 0;
+    stats.perViewErrors.assign(imageCount, 0.0);
+    std::vector<double> errors;
+    double errSum = 0.0;
+    Eigen::Vector2d residualSum = Eigen::Vector2d::Zero();
+    for (int i = 0; i < imageCount; ++i)
+    {
+        double viewErrSum = 0.0;
+        for (int j = 0; j < residuals.at(i).cols(); ++j)
         {
-            err += cv::norm(imagePoints.at(i).at(j) - estImagePoints.at(j));
+            double err = residuals.at(i).col(j).norm();
+            errors.push_back(err);
+            viewErrSum += err;
+            residualSum += residuals.at(i).col(j);
         }
 
-        if (computePerViewErrors)
+        if (residuals.at(i).cols() > 0)
         {
-            perViewErrors.at<double>(i) = err / pointCount;
+            stats.perViewErrors.at(i) = viewErrSum / residuals.at(i).cols();
         }
+        errSum += viewErrSum;
+        stats.pointCount += residuals.at(i).cols();
+    }
+
+    stats.meanError = 0.0;
+    stats.maxError = 0.0;
+    stats.medianError = 0.0;
+    stats.percentile90Error = 0.0;
+    stats.percentile99Error = 0.0;
+    stats.meanResidual.setZero();
+    stats.residualCovariance.setZero();
+    if (stats.pointCount == 0)
+    {
+        return;
+    }
 
-        totalErr += err;
+    stats.meanError = errSum / static_cast<double>(stats.pointCount);
+    stats.meanResidual = residualSum / static_cast<double>(stats.pointCount);
+    for (int i = 0; i < imageCount; ++i)
+    {
+        for (int j = 0; j < residuals.at(i).cols(); ++j)
+        {
+            Eigen::Vector2d d = residuals.at(i).col(j) - stats.meanResidual;
+            stats.residualCovariance += d * d.transpose();
+        }
     }
+    stats.residualCovariance /= static_cast<double>(stats.pointCount);
 
-    return totalErr / pointsSoFar;
+    // nearest rank percentiles, each nth_element works on what the previous one left
+    std::vector<double>::iterator it = errors.begin();
+    const double ranks[3] = {0.5, 0.9, 0.99};
+    double* values[3] = {&stats.medianError, &stats.percentile90Error, &stats.percentile99Error};
+    for (int k = 0; k < 3; ++k)
+    {
+        std::vector<double>::iterator nth = errors.begin() + static_cast<size_t>(ranks[k] * (errors.size() - 1));
+        std::nth_element(it, nth, errors.end());
+        *values[k] = *nth;
+        it = nth;
+    }
+    stats.maxError = *std::max_element(it, errors.end());
 }
 
 double
@@ -218,34 +350,26 @@ Camera::projectPoints(const std::vector<cv::Point3f>& objectPoints,
                       std::vector<cv::Point2f>& imagePoints) const
 {
     // project 3D object points to the image plane
-    imagePoints.reserve(objectPoints.size());
-
-    //double
-    cv::Mat R0;
-    cv::Rodrigues(rvec, R0);
-
-    Eigen::MatrixXd R(3,3);
-    R << R0.at<double>(0,0), R0.at<double>(0,1), R0.at<double>(0,2),
-         R0.at<double>(1,0), R0.at<double>(1,1), R0.at<double>(1,2),
-         R0.at<double>(2,0), R0.at<double>(2,1), R0.at<double>(2,2);
+    imagePoints.reserve(imagePoints.size() + objectPoints.size());
 
+    Eigen::Matrix3d R;
     Eigen::Vector3d t;
-    t << tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2);
+    poseToEigen(rvec, tvec, R, t);
 
+    // Rotate and translate
+    Eigen::Matrix3Xd P(3, objectPoints.size());
     for (size_t i = 0; i < objectPoints.size(); ++i)
     {
         const cv::Point3f& objectPoint = objectPoints.at(i);
+        P.col(i) = R * Eigen::Vector3d(objectPoint.x, objectPoint.y, objectPoint.z) + t;
+    }
 
-        // Rotate and translate
-        Eigen::Vector3d P;
-        P << objectPoint.x, objectPoint.y, objectPoint.z;
-
-        P = R * P + t;
-
-        Eigen::Vector2d p;
-        spaceToPlane(P, p);
+    Eigen::Matrix2Xd p(2, objectPoints.size());
+    spaceToPlaneBatch(P.data(), p.data(), objectPoints.size());
 
-        imagePoints.push_back(cv::Point2f(p(0), p(1)));
+    for (size_t i = 0; i < objectPoints.size(); ++i)
+    {
+        imagePoints.push_back(cv::Point2f(p(0, i), p(1, i)));
     }
 }
 
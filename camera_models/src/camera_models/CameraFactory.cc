@@ -1,4 +1,11 @@
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
 
 #include "camodocal/camera_models/CameraFactory.h"
 #include "camodocal/camera_models/CataCamera.h"
@@ -7,15 +14,42 @@
 #include "camodocal/camera_models/PinholeFullCamera.h"
 #include "camodocal/camera_models/PolyFisheyeCamera.h"
 #include "camodocal/camera_models/ScaramuzzaCamera.h"
+#include "camodocal/camera_models/StateIO.h"
 
 #include "ceres/ceres.h"
 
+// "CAMS" in the first bytes of a state blob
+#define CAMERA_STATE_MAGIC 0x534d4143
+// bump whenever the layout of a writeState or the way a table is built
+// changes, older cache files are then ignored and rebuilt
+#define CAMERA_STATE_VERSION 1
+
 namespace camodocal
 {
 
 boost::shared_ptr< CameraFactory > CameraFactory::m_instance;
 
-CameraFactory::CameraFactory( ) {}
+// 64 bit FNV-1a, only used to key the cache on the file content
+static uint64_t
+contentHash( const std::string& content )
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for ( size_t i = 0; i < content.size( ); ++i )
+    {
+        hash ^= static_cast< unsigned char >( content[i] );
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+CameraFactory::CameraFactory( )
+{
+    const char* directory = std::getenv( "CAMODOCAL_CACHE_DIR" );
+    if ( directory != NULL )
+    {
+        m_cacheDirectory = directory;
+    }
+}
 
 boost::shared_ptr< CameraFactory >
 CameraFactory::instance( void )
@@ -94,6 +128,179 @@ CameraFactory::generateCamera( Camera::ModelType modelType, const std::string& c
 
 CameraPtr
 CameraFactory::generateCameraFromYamlFile( const std::string& filename )
+{
+    std::ifstream ifs( filename.c_str( ), std::ios::in | std::ios::binary );
+    if ( !ifs.is_open( ) )
+    {
+        return CameraPtr( );
+    }
+
+    std::ostringstream content;
+    content << ifs.rdbuf( );
+    uint64_t key = contentHash( content.str( ) );
+
+    std::string state;
+    if ( loadState( key, state ) )
+    {
+        CameraPtr camera = cameraFromState( state, key );
+        if ( camera.get( ) != 0 )
+        {
+            return camera;
+        }
+    }
+
+    CameraPtr camera = readCameraFromYamlFile( filename );
+    if ( camera.get( ) != 0 && stateFromCamera( *camera, key, state ) )
+    {
+        storeState( key, state );
+    }
+
+    return camera;
+}
+
+void
+CameraFactory::setCacheDirectory( const std::string& directory )
+{
+    std::lock_guard< std::mutex > lock( m_cacheMutex );
+    m_cacheDirectory = directory;
+}
+
+std::string
+CameraFactory::cacheDirectory( void ) const
+{
+    std::lock_guard< std::mutex > lock( m_cacheMutex );
+    return m_cacheDirectory;
+}
+
+CameraPtr
+CameraFactory::cameraFromState( const std::string& state, uint64_t key ) const
+{
+    std::istringstream iss( state );
+
+    uint32_t magic, version;
+    uint64_t stateKey;
+    int modelType;
+    if ( !readBinary( iss, magic ) || magic != CAMERA_STATE_MAGIC || !readBinary( iss, version )
+         || version != CAMERA_STATE_VERSION || !readBinary( iss, stateKey ) || stateKey != key
+         || !readBinary( iss, modelType ) )
+    {
+        return CameraPtr( );
+    }
+
+    CameraPtr camera;
+    switch ( modelType )
+    {
+        case Camera::KANNALA_BRANDT:
+            camera.reset( new EquidistantCamera );
+            break;
+        case Camera::POLYFISHEYE:
+            camera.reset( new PolyFisheyeCamera );
+            break;
+        default:
+            return CameraPtr( );
+    }
+
+    if ( !camera->readState( iss ) )
+    {
+        return CameraPtr( );
+    }
+
+    return camera;
+}
+
+bool
+CameraFactory::stateFromCamera( const Camera& camera, uint64_t key, std::string& state ) const
+{
+    std::ostringstream oss;
+
+    writeBinary( oss, static_cast< uint32_t >( CAMERA_STATE_MAGIC ) );
+    writeBinary( oss, static_cast< uint32_t >( CAMERA_STATE_VERSION ) );
+    writeBinary( oss, key );
+    writeBinary( oss, static_cast< int >( camera.modelType( ) ) );
+
+    if ( !camera.writeState( oss ) )
+    {
+        return false;
+    }
+
+    state = oss.str( );
+    return true;
+}
+
+bool
+CameraFactory::loadState( uint64_t key, std::string& state )
+{
+    std::lock_guard< std::mutex > lock( m_cacheMutex );
+
+    std::map< uint64_t, std::string >::const_iterator it = m_stateCache.find( key );
+    if ( it != m_stateCache.end( ) )
+    {
+        state = it->second;
+        return true;
+    }
+
+    if ( m_cacheDirectory.empty( ) )
+    {
+        return false;
+    }
+
+    std::ifstream ifs( stateFilename( key ).c_str( ), std::ios::in | std::ios::binary );
+    if ( !ifs.is_open( ) )
+    {
+        return false;
+    }
+
+    std::ostringstream content;
+    content << ifs.rdbuf( );
+    state = content.str( );
+
+    // a stale or corrupt file is rejected by cameraFromState and overwritten
+    m_stateCache[key] = state;
+    return true;
+}
+
+void
+CameraFactory::storeState( uint64_t key, const std::string& state )
+{
+    std::lock_guard< std::mutex > lock( m_cacheMutex );
+
+    m_stateCache[key] = state;
+
+    if ( m_cacheDirectory.empty( ) )
+    {
+        return;
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories( m_cacheDirectory, ec );
+
+    // write next to the target and rename, concurrent readers never see a partial file
+    std::string filename = stateFilename( key );
+    std::ostringstream tmpFilename;
+    tmpFilename << filename << ".tmp" << getpid( );
+
+    std::ofstream ofs( tmpFilename.str( ).c_str( ), std::ios::out | std::ios::binary );
+    ofs.write( state.data( ), state.size( ) );
+    ofs.close( );
+
+    if ( !ofs.good( ) || std::rename( tmpFilename.str( ).c_str( ), filename.c_str( ) ) != 0 )
+    {
+        std::cerr << "# WARNING: Cannot write camera cache " << filename << std::endl;
+        std::remove( tmpFilename.str( ).c_str( ) );
+    }
+}
+
+std::string
+CameraFactory::stateFilename( uint64_t key ) const
+{
+    std::ostringstream oss;
+    oss << m_cacheDirectory << "/camera_" << std::hex << std::setw( 16 ) << std::setfill( '0' )
+        << key << ".bin";
+    return oss.str( );
+}
+
+CameraPtr
+CameraFactory::readCameraFromYamlFile( const std::string& filename ) const
 {
     cv::FileStorage fs( filename, cv::FileStorage::READ );
 
@@ -9,11 +9,74 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "camodocal/camera_models/RadtanDistortion.h"
 #include "camodocal/gpl/gpl.h"
 
+// Newton solver for the inverse of the radial-tangential distortion
+#define CATA_UNDISTORT_MAX_ITERATIONS 8
+#define CATA_UNDISTORT_TOLERANCE 1e-10
+
 namespace camodocal
 {
 
+// Solve m_u + d(m_u) = m_d for the undistorted point with Newton steps on the
+// analytic jacobian of distortion(), starting from the first fixed point step.
+// Returns the norm of the remaining residual in normalised coordinates.
+static inline double
+radtanUndistortion(double k1, double k2, double p1, double p2,
+                   double mx_d, double my_d, double& mx_u, double& my_u)
+{
+    double dx_u, dy_u;
+    radtanDistortion(k1, k2, p1, p2, mx_d, my_d, dx_u, dy_u);
+    mx_u = mx_d - dx_u;
+    my_u = my_d - dy_u;
+
+    double best_x = mx_u, best_y = my_u;
+    double best_err2 = -1.0;
+    for (int i = 0; i < CATA_UNDISTORT_MAX_ITERATIONS; ++i)
+    {
+        double mx2_u = mx_u * mx_u;
+        double my2_u = my_u * my_u;
+        double mxy_u = mx_u * my_u;
+        double rho2_u = mx2_u + my2_u;
+        double rad_dist_u = k1 * rho2_u + k2 * rho2_u * rho2_u;
+
+        double fx = mx_u + mx_u * rad_dist_u + 2.0 * p1 * mxy_u + p2 * (rho2_u + 2.0 * mx2_u) - mx_d;
+        double fy = my_u + my_u * rad_dist_u + 2.0 * p2 * mxy_u + p1 * (rho2_u + 2.0 * my2_u) - my_d;
+        double err2 = fx * fx + fy * fy;
+
+        // Keep the best iterate, Newton can overshoot where the model folds over
+        if (best_err2 >= 0.0 && err2 >= best_err2)
+        {
+            break;
+        }
+        best_x = mx_u;
+        best_y = my_u;
+        best_err2 = err2;
+        if (err2 < CATA_UNDISTORT_TOLERANCE * CATA_UNDISTORT_TOLERANCE)
+        {
+            break;
+        }
+
+        // Same jacobian as distortion(p_u, d_u, J)
+        double dxdmx = 1.0 + rad_dist_u + k1 * 2.0 * mx2_u + k2 * rho2_u * 4.0 * mx2_u + 2.0 * p1 * my_u + 6.0 * p2 * mx_u;
+        double dxdmy = k1 * 2.0 * mxy_u + k2 * 4.0 * rho2_u * mxy_u + p1 * 2.0 * mx_u + 2.0 * p2 * my_u;
+        double dydmy = 1.0 + rad_dist_u + k1 * 2.0 * my2_u + k2 * rho2_u * 4.0 * my2_u + 6.0 * p1 * my_u + 2.0 * p2 * mx_u;
+        double det = dxdmx * dydmy - dxdmy * dxdmy;
+        if (std::abs(det) < 1e-12)
+        {
+            break;
+        }
+
+        mx_u -= (dydmy * fx - dxdmy * fy) / det;
+        my_u -= (dxdmx * fy - dxdmy * fx) / det;
+    }
+
+    mx_u = best_x;
+    my_u = best_y;
+    return sqrt(best_err2);
+}
+
 CataCamera::Parameters::Parameters()
  : Camera::Parameters(MEI)
  , m_xi(0.0)
@@ -475,9 +538,9 @@ CataCamera::estimateIntrinsics(const cv::Size& boardSize,
 void
 CataCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
-    double mx_d, my_d,mx2_d, mxy_d, my2_d, mx_u, my_u;
-    double rho2_d, rho4_d, radDist_d, Dx_d, Dy_d, inv_denom_d;
+    double mx_d, my_d, mx_u, my_u;
     double lambda;
+    Eigen::Vector2d p_u;
 
     // Lift points to normalised plane
     mx_d = m_inv_K11 * p(0) + m_inv_K13;
@@ -490,46 +553,9 @@ CataCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
     }
     else
     {
-        // Apply inverse distortion model
-        if (0)
-        {
-            double k1 = mParameters.k1();
-            double k2 = mParameters.k2();
-            double p1 = mParameters.p1();
-            double p2 = mParameters.p2();
-
-            // Inverse distortion model
-            // proposed by Heikkila
-            mx2_d = mx_d*mx_d;
-            my2_d = my_d*my_d;
-            mxy_d = mx_d*my_d;
-            rho2_d = mx2_d+my2_d;
-            rho4_d = rho2_d*rho2_d;
-            radDist_d = k1*rho2_d+k2*rho4_d;
-            Dx_d = mx_d*radDist_d + p2*(rho2_d+2*mx2_d) + 2*p1*mxy_d;
-            Dy_d = my_d*radDist_d + p1*(rho2_d+2*my2_d) + 2*p2*mxy_d;
-            inv_denom_d = 1/(1+4*k1*rho2_d+6*k2*rho4_d+8*p1*my_d+8*p2*mx_d);
-
-            mx_u = mx_d - inv_denom_d*Dx_d;
-            my_u = my_d - inv_denom_d*Dy_d;
-        }
-        else
-        {
-            // Recursive distortion model
-            int n = 6;
-            Eigen::Vector2d d_u;
-            distortion(Eigen::Vector2d(mx_d, my_d), d_u);
-            // Approximate value
-            mx_u = mx_d - d_u(0);
-            my_u = my_d - d_u(1);
-
-            for (int i = 1; i < n; ++i)
-            {
-                distortion(Eigen::Vector2d(mx_u, my_u), d_u);
-                mx_u = mx_d - d_u(0);
-                my_u = my_d - d_u(1);
-            }
-        }
+        undistortion(Eigen::Vector2d(mx_d, my_d), p_u);
+        mx_u = p_u(0);
+        my_u = p_u(1);
     }
 
     // Lift normalised points to the sphere (inv_hslash)
@@ -555,9 +581,9 @@ CataCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 void
 CataCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
-    double mx_d, my_d,mx2_d, mxy_d, my2_d, mx_u, my_u;
-    double rho2_d, rho4_d, radDist_d, Dx_d, Dy_d, inv_denom_d;
-    //double lambda;
+    double mx_d, my_d, mx_u, my_u;
+    double rho2_d;
+    Eigen::Vector2d p_u;
 
     // Lift points to normalised plane
     mx_d = m_inv_K11 * p(0) + m_inv_K13;
@@ -570,45 +596,9 @@ CataCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
     }
     else
     {
-        if (0)
-        {
-            double k1 = mParameters.k1();
-            double k2 = mParameters.k2();
-            double p1 = mParameters.p1();
-            double p2 = mParameters.p2();
-
-            // Apply inverse distortion model
-            // proposed by Heikkila
-            mx2_d = mx_d*mx_d;
-            my2_d = my_d*my_d;
-            mxy_d = mx_d*my_d;
-            rho2_d = mx2_d+my2_d;
-            rho4_d = rho2_d*rho2_d;
-            radDist_d = k1*rho2_d+k2*rho4_d;
-            Dx_d = mx_d*radDist_d + p2*(rho2_d+2*mx2_d) + 2*p1*mxy_d;
-            Dy_d = my_d*radDist_d + p1*(rho2_d+2*my2_d) + 2*p2*mxy_d;
-            inv_denom_d = 1/(1+4*k1*rho2_d+6*k2*rho4_d+8*p1*my_d+8*p2*mx_d);
-
-            mx_u = mx_d - inv_denom_d*Dx_d;
-            my_u = my_d - inv_denom_d*Dy_d;
-        }
-        else
-        {
-            // Recursive distortion model
-            int n = 8;
-            Eigen::Vector2d d_u;
-            distortion(Eigen::Vector2d(mx_d, my_d), d_u);
-            // Approximate value
-            mx_u = mx_d - d_u(0);
-            my_u = my_d - d_u(1);
-
-            for (int i = 1; i < n; ++i)
-            {
-                distortion(Eigen::Vector2d(mx_u, my_u), d_u);
-                mx_u = mx_d - d_u(0);
-                my_u = my_d - d_u(1);
-            }
-        }
+        undistortion(Eigen::Vector2d(mx_d, my_d), p_u);
+        mx_u = p_u(0);
+        my_u = p_u(1);
     }
 
     // Obtain a projective ray
@@ -626,6 +616,77 @@ CataCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 }
 
 
+void
+CataCamera::liftProjectiveBatch(const double* p, double* P, int n) const
+{
+    double k1 = mParameters.k1();
+    double k2 = mParameters.k2();
+    double p1 = mParameters.p1();
+    double p2 = mParameters.p2();
+    double xi = mParameters.xi();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double mx_d = m_inv_K11 * p[2 * i] + m_inv_K13;
+        double my_d = m_inv_K22 * p[2 * i + 1] + m_inv_K23;
+
+        double mx_u = mx_d, my_u = my_d;
+        if (!m_noDistortion)
+        {
+            radtanUndistortion(k1, k2, p1, p2, mx_d, my_d, mx_u, my_u);
+        }
+
+        P[3 * i] = mx_u;
+        P[3 * i + 1] = my_u;
+        P[3 * i + 2] = mx_u * mx_u + my_u * my_u;
+    }
+
+    // Obtain projective rays
+    if (xi == 1.0)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            P[3 * i + 2] = (1.0 - P[3 * i + 2]) / 2.0;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            double rho2_d = P[3 * i + 2];
+            P[3 * i + 2] = 1.0 - xi * (rho2_d + 1.0) / (xi + sqrt(1.0 + (1.0 - xi * xi) * rho2_d));
+        }
+    }
+}
+
+void
+CataCamera::spaceToPlaneBatch(const double* P, double* p, int n) const
+{
+    double k1 = m_noDistortion ? 0.0 : mParameters.k1();
+    double k2 = m_noDistortion ? 0.0 : mParameters.k2();
+    double p1 = m_noDistortion ? 0.0 : mParameters.p1();
+    double p2 = m_noDistortion ? 0.0 : mParameters.p2();
+    double xi = mParameters.xi();
+    double gamma1 = mParameters.gamma1();
+    double gamma2 = mParameters.gamma2();
+    double u0 = mParameters.u0();
+    double v0 = mParameters.v0();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double x = P[3 * i], y = P[3 * i + 1], z = P[3 * i + 2];
+        z += xi * sqrt(x * x + y * y + z * z);
+        double mx_u = x / z;
+        double my_u = y / z;
+
+        double dx_u, dy_u;
+        radtanDistortion(k1, k2, p1, p2, mx_u, my_u, dx_u, dy_u);
+
+        p[2 * i] = gamma1 * (mx_u + dx_u) + u0;
+        p[2 * i + 1] = gamma2 * (my_u + dy_u) + v0;
+    }
+}
+
 /** 
  * \brief Project a 3D point (\a x,\a y,\a z) to the image plane in (\a u,\a v)
  *
@@ -816,6 +877,24 @@ CataCamera::distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u,
          dydmx, dydmy;
 }
 
+/**
+ * \brief Inverts the distortion model with Newton iterations
+ *
+ * \param p_d distorted point coordinates on the normalised plane
+ * \param p_u undistorted point coordinates on the normalised plane
+ * \return norm of the residual p_u + d(p_u) - p_d
+ */
+double
+CataCamera::undistortion(const Eigen::Vector2d& p_d, Eigen::Vector2d& p_u) const
+{
+    double mx_u, my_u;
+    double err = radtanUndistortion(mParameters.k1(), mParameters.k2(),
+                                    mParameters.p1(), mParameters.p2(),
+                                    p_d(0), p_d(1), mx_u, my_u);
+    p_u << mx_u, my_u;
+    return err;
+}
+
 void
 CataCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale) const
 {
@@ -824,26 +903,15 @@ CataCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale) const
     cv::Mat mapX = cv::Mat::zeros(imageSize, CV_32F);
     cv::Mat mapY = cv::Mat::zeros(imageSize, CV_32F);
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
-            double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
-
-            double xi = mParameters.xi();
-            double d2 = mx_u * mx_u + my_u * my_u;
-
-            Eigen::Vector3d P;
-            P << mx_u, my_u, 1.0 - xi * (d2 + 1.0) / (xi + sqrt(1.0 + (1.0 - xi * xi) * d2));
+    double xi = mParameters.xi();
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
+        double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
 
-            Eigen::Vector2d p;
-            spaceToPlane(P, p);
+        double d2 = mx_u * mx_u + my_u * my_u;
 
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+        return Eigen::Vector3d(mx_u, my_u, 1.0 - xi * (d2 + 1.0) / (xi + sqrt(1.0 + (1.0 - xi * xi) * d2)));
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 }
@@ -890,22 +958,11 @@ CataCamera::initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
     cv::cv2eigen(rmat, R);
     R_inv = R.inverse();
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            Eigen::Vector3f xo;
-            xo << u, v, 1;
-
-            Eigen::Vector3f uo = R_inv * K_rect_inv * xo;
-
-            Eigen::Vector2d p;
-            spaceToPlane(uo.cast<double>(), p);
-
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+    Eigen::Matrix3f R_inv_K_rect_inv = R_inv * K_rect_inv;
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        Eigen::Vector3f uo = R_inv_K_rect_inv * Eigen::Vector3f(u, v, 1);
+        return uo.cast<double>().eval();
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 
@@ -513,6 +513,333 @@ class ComprehensionError
     Eigen::Matrix2d m_sqrtPrecisionMat;
 };
 
+// Radial-tangential distortion of (u, v) as in the spaceToPlane templates of
+// the Cata and Pinhole models, with the jacobians w.r.t. (u, v) and (k1, k2, p1, p2)
+inline void
+radtanDistortionJacobian( double k1, double k2, double p1, double p2,
+                          double u, double v,
+                          double& ud, double& vd,
+                          Eigen::Matrix2d& J_uv,
+                          Eigen::Matrix< double, 2, 4 >& J_k )
+{
+    double rho_sqr = u * u + v * v;
+    double L       = 1.0 + k1 * rho_sqr + k2 * rho_sqr * rho_sqr;
+    double dL      = 2.0 * k1 + 4.0 * k2 * rho_sqr;
+
+    ud = L * u + 2.0 * p1 * u * v + p2 * ( rho_sqr + 2.0 * u * u );
+    vd = L * v + p1 * ( rho_sqr + 2.0 * v * v ) + 2.0 * p2 * u * v;
+
+    J_uv( 0, 0 ) = L + dL * u * u + 2.0 * p1 * v + 6.0 * p2 * u;
+    J_uv( 0, 1 ) = dL * u * v + 2.0 * p1 * u + 2.0 * p2 * v;
+    J_uv( 1, 0 ) = J_uv( 0, 1 );
+    J_uv( 1, 1 ) = L + dL * v * v + 6.0 * p1 * v + 2.0 * p2 * u;
+
+    J_k << u * rho_sqr, u * rho_sqr * rho_sqr, 2.0 * u * v, rho_sqr + 2.0 * u * u,
+           v * rho_sqr, v * rho_sqr * rho_sqr, rho_sqr + 2.0 * v * v, 2.0 * u * v;
+}
+
+// Projection of a point in the camera frame with its jacobians w.r.t. the
+// point and the intrinsics, intrinsics in the order of writeParameters().
+// Only specialized for the models with an analytic reprojection error.
+template< class CameraT >
+struct AnalyticProjection;
+
+template<>
+struct AnalyticProjection< PinholeCamera >
+{
+    enum
+    {
+        NUM_PARAMS = 8
+    };
+
+    static void project( const double* params,
+                         const Eigen::Vector3d& P_c,
+                         Eigen::Vector2d& p,
+                         Eigen::Matrix< double, 2, 3 >& J_P,
+                         Eigen::Matrix< double, 2, NUM_PARAMS >& J_params )
+    {
+        double fx = params[4];
+        double fy = params[5];
+
+        double u = P_c( 0 ) / P_c( 2 );
+        double v = P_c( 1 ) / P_c( 2 );
+
+        double ud, vd;
+        Eigen::Matrix2d J_uv;
+        Eigen::Matrix< double, 2, 4 > J_k;
+        radtanDistortionJacobian( params[0], params[1], params[2], params[3], u, v, ud, vd, J_uv, J_k );
+
+        p << fx * ud + params[6], fy * vd + params[7];
+
+        Eigen::Matrix< double, 2, 3 > J_norm;
+        J_norm << 1.0 / P_c( 2 ), 0.0, -u / P_c( 2 ),
+                  0.0, 1.0 / P_c( 2 ), -v / P_c( 2 );
+
+        Eigen::Matrix2d F = Eigen::Vector2d( fx, fy ).asDiagonal( );
+        J_P = F * J_uv * J_norm;
+
+        J_params.setZero( );
+        J_params.block< 2, 4 >( 0, 0 ) = F * J_k;
+        J_params( 0, 4 ) = ud;
+        J_params( 1, 5 ) = vd;
+        J_params( 0, 6 ) = 1.0;
+        J_params( 1, 7 ) = 1.0;
+    }
+};
+
+template<>
+struct AnalyticProjection< CataCamera >
+{
+    enum
+    {
+        NUM_PARAMS = 9
+    };
+
+    static void project( const double* params,
+                         const Eigen::Vector3d& P_c,
+                         Eigen::Vector2d& p,
+                         Eigen::Matrix< double, 2, 3 >& J_P,
+                         Eigen::Matrix< double, 2, NUM_PARAMS >& J_params )
+    {
+        double xi     = params[0];
+        double gamma1 = params[5];
+        double gamma2 = params[6];
+
+        // projection of the unit sphere point, written on P_c directly:
+        // u = x / (z + xi * |P_c|)
+        double len   = P_c.norm( );
+        double denom = P_c( 2 ) + xi * len;
+        double u     = P_c( 0 ) / denom;
+        double v     = P_c( 1 ) / denom;
+
+        double ud, vd;
+        Eigen::Matrix2d J_uv;
+        Eigen::Matrix< double, 2, 4 > J_k;
+        radtanDistortionJacobian( params[1], params[2], params[3], params[4], u, v, ud, vd, J_uv, J_k );
+
+        p << gamma1 * ud + params[7], gamma2 * vd + params[8];
+
+        Eigen::RowVector3d J_denom = xi / len * P_c.transpose( );
+        J_denom( 2 ) += 1.0;
+
+        Eigen::Matrix< double, 2, 3 > J_norm;
+        J_norm.row( 0 ) = ( Eigen::RowVector3d( 1.0, 0.0, 0.0 ) - u * J_denom ) / denom;
+        J_norm.row( 1 ) = ( Eigen::RowVector3d( 0.0, 1.0, 0.0 ) - v * J_denom ) / denom;
+
+        Eigen::Matrix2d F = Eigen::Vector2d( gamma1, gamma2 ).asDiagonal( );
+        J_P = F * J_uv * J_norm;
+
+        J_params.setZero( );
+        J_params.col( 0 ) = F * J_uv * Eigen::Vector2d( u, v ) * ( -len / denom );
+        J_params.block< 2, 4 >( 0, 1 ) = F * J_k;
+        J_params( 0, 5 ) = ud;
+        J_params( 1, 6 ) = vd;
+        J_params( 0, 7 ) = 1.0;
+        J_params( 1, 8 ) = 1.0;
+    }
+};
+
+template<>
+struct AnalyticProjection< EquidistantCamera >
+{
+    enum
+    {
+        NUM_PARAMS = 8
+    };
+
+    static void project( const double* params,
+                         const Eigen::Vector3d& P_c,
+                         Eigen::Vector2d& p,
+                         Eigen::Matrix< double, 2, 3 >& J_P,
+                         Eigen::Matrix< double, 2, NUM_PARAMS >& J_params )
+    {
+        double mu = params[4];
+        double mv = params[5];
+
+        double x    = P_c( 0 );
+        double y    = P_c( 1 );
+        double z    = P_c( 2 );
+        double rho2 = x * x + y * y;
+        double rho  = sqrt( rho2 );
+        double len2 = rho2 + z * z;
+
+        // same angle as acos(z / len) in EquidistantCamera::spaceToPlane
+        double theta  = atan2( rho, z );
+        double theta2 = theta * theta;
+
+        // r(theta) = theta + k2 theta^3 + k3 theta^5 + k4 theta^7 + k5 theta^9
+        double theta_pow[4];
+        double r  = theta;
+        double dr = 1.0;
+        double theta_even = 1.0;
+        for ( int i = 0; i < 4; ++i )
+        {
+            theta_even *= theta2;
+            theta_pow[i] = theta_even * theta;
+            r += params[i] * theta_pow[i];
+            dr += ( 2 * i + 3 ) * params[i] * theta_even;
+        }
+
+        Eigen::Vector2d dir, p_u;
+        Eigen::Matrix< double, 2, 3 > J_pu;
+        if ( rho > 1e-10 * sqrt( len2 ) )
+        {
+            dir << x / rho, y / rho;
+            p_u = r * dir;
+
+            Eigen::RowVector3d J_theta( x * z / ( rho * len2 ), y * z / ( rho * len2 ), -rho / len2 );
+
+            Eigen::Matrix< double, 2, 3 > J_dir;
+            J_dir << y * y, -x * y, 0.0,
+                     -x * y, x * x, 0.0;
+            J_dir /= rho2 * rho;
+
+            J_pu = dr * dir * J_theta + r * J_dir;
+        }
+        else
+        {
+            // on the optical axis r(theta) / rho tends to 1 / z
+            dir.setZero( );
+            p_u << x / z, y / z;
+            J_pu << 1.0 / z, 0.0, -x / ( z * z ),
+                    0.0, 1.0 / z, -y / ( z * z );
+        }
+
+        p << mu * p_u( 0 ) + params[6], mv * p_u( 1 ) + params[7];
+
+        Eigen::Matrix2d F = Eigen::Vector2d( mu, mv ).asDiagonal( );
+        J_P = F * J_pu;
+
+        J_params.setZero( );
+        for ( int i = 0; i < 4; ++i )
+        {
+            J_params.col( i ) = F * dir * theta_pow[i];
+        }
+        J_params( 0, 4 ) = p_u( 0 );
+        J_params( 1, 5 ) = p_u( 1 );
+        J_params( 0, 6 ) = 1.0;
+        J_params( 1, 7 ) = 1.0;
+    }
+};
+
+// Same residual and parameter blocks as
+// AutoDiffCostFunction< ReprojectionError1< CameraT >, 2, N, 4, 3 >, with the
+// jacobians written out instead of evaluated through Jets.
+template< class CameraT >
+class AnalyticReprojectionError1
+: public ceres::SizedCostFunction< 2, AnalyticProjection< CameraT >::NUM_PARAMS, 4, 3 >
+{
+    public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    enum
+    {
+        NUM_PARAMS = AnalyticProjection< CameraT >::NUM_PARAMS
+    };
+
+    AnalyticReprojectionError1( const Eigen::Vector3d& observed_P,
+                                const Eigen::Vector2d& observed_p,
+                                const Eigen::Matrix2d& sqrtPrecisionMat = Eigen::Matrix2d::Identity( ) )
+    : m_observed_P( observed_P )
+    , m_observed_p( observed_p )
+    , m_sqrtPrecisionMat( sqrtPrecisionMat )
+    {
+    }
+
+    virtual bool Evaluate( double const* const* parameters, double* residuals, double** jacobians ) const
+    {
+        // quaternion in Eigen convention (x, y, z, w), normalized as in
+        // ceres::QuaternionRotatePoint
+        Eigen::Map< const Eigen::Vector4d > q_raw( parameters[1] );
+        double q_norm = q_raw.norm( );
+        Eigen::Quaterniond q( q_raw( 3 ) / q_norm, q_raw( 0 ) / q_norm, q_raw( 1 ) / q_norm, q_raw( 2 ) / q_norm );
+        Eigen::Map< const Eigen::Vector3d > t( parameters[2] );
+
+        Eigen::Vector3d P_c = q * m_observed_P + t;
+
+        Eigen::Vector2d p;
+        Eigen::Matrix< double, 2, 3 > J_P;
+        Eigen::Matrix< double, 2, NUM_PARAMS > J_params;
+        AnalyticProjection< CameraT >::project( parameters[0], P_c, p, J_P, J_params );
+
+        Eigen::Map< Eigen::Vector2d > residual( residuals );
+        residual = m_sqrtPrecisionMat * ( p - m_observed_p );
+
+        if ( jacobians == 0 )
+        {
+            return true;
+        }
+
+        Eigen::Matrix< double, 2, 3 > J_P_weighted = m_sqrtPrecisionMat * J_P;
+
+        if ( jacobians[0] != 0 )
+        {
+            Eigen::Map< Eigen::Matrix< double, 2, NUM_PARAMS, Eigen::RowMajor > > J( jacobians[0] );
+            J = m_sqrtPrecisionMat * J_params;
+        }
+
+        if ( jacobians[1] != 0 )
+        {
+            // R(q) P = P + 2 w (v x P) + 2 v x (v x P) for the unit quaternion (v, w),
+            // then through the normalization of the raw quaternion
+            const Eigen::Vector3d& P = m_observed_P;
+            Eigen::Vector3d v        = q.vec( );
+            double w                 = q.w( );
+
+            Eigen::Matrix3d P_skew;
+            P_skew << 0.0, -P( 2 ), P( 1 ),
+                      P( 2 ), 0.0, -P( 0 ),
+                      -P( 1 ), P( 0 ), 0.0;
+
+            Eigen::Matrix< double, 3, 4 > J_q;
+            J_q.leftCols< 3 >( ) = -2.0 * w * P_skew
+                                   + 2.0 * ( v * P.transpose( ) + v.dot( P ) * Eigen::Matrix3d::Identity( )
+                                             - 2.0 * P * v.transpose( ) );
+            J_q.col( 3 ) = 2.0 * v.cross( P );
+
+            Eigen::Vector4d q_unit = q_raw / q_norm;
+            Eigen::Matrix4d J_norm = ( Eigen::Matrix4d::Identity( ) - q_unit * q_unit.transpose( ) ) / q_norm;
+
+            Eigen::Map< Eigen::Matrix< double, 2, 4, Eigen::RowMajor > > J( jacobians[1] );
+            J = J_P_weighted * J_q * J_norm;
+        }
+
+        if ( jacobians[2] != 0 )
+        {
+            Eigen::Map< Eigen::Matrix< double, 2, 3, Eigen::RowMajor > > J( jacobians[2] );
+            J = J_P_weighted;
+        }
+
+        return true;
+    }
+
+    private:
+    Eigen::Vector3d m_observed_P;
+    Eigen::Vector2d m_observed_p;
+    Eigen::Matrix2d m_sqrtPrecisionMat;
+};
+
+// Analytic counterpart of ReprojectionError1 for CAMERA_INTRINSICS | CAMERA_POSE,
+// 0 for the models that only have the autodiff one
+static ceres::CostFunction*
+generateAnalyticReprojectionError( const CameraConstPtr& camera,
+                                   const Eigen::Vector3d& observed_P,
+                                   const Eigen::Vector2d& observed_p,
+                                   const Eigen::Matrix2d& sqrtPrecisionMat )
+{
+    switch ( camera->modelType( ) )
+    {
+        case Camera::KANNALA_BRANDT:
+            return new AnalyticReprojectionError1< EquidistantCamera >( observed_P, observed_p, sqrtPrecisionMat );
+        case Camera::PINHOLE:
+            return new AnalyticReprojectionError1< PinholeCamera >( observed_P, observed_p, sqrtPrecisionMat );
+        case Camera::MEI:
+            return new AnalyticReprojectionError1< CataCamera >( observed_P, observed_p, sqrtPrecisionMat );
+        default:
+            return 0;
+    }
+}
+
 boost::shared_ptr< CostFunctionFactory > CostFunctionFactory::m_instance;
 
 CostFunctionFactory::CostFunctionFactory( ) {}
@@ -536,6 +863,17 @@ CostFunctionFactory::generateCostFunction( const CameraConstPtr& camera,
 {
     ceres::CostFunction* costFunction = 0;
 
+    if ( flags == ( CAMERA_INTRINSICS | CAMERA_POSE | ANALYTIC_JACOBIAN ) )
+    {
+        costFunction = generateAnalyticReprojectionError( camera, observed_P, observed_p,
+                                                          Eigen::Matrix2d::Identity( ) );
+        if ( costFunction != 0 )
+        {
+            return costFunction;
+        }
+    }
+    flags &= ~ANALYTIC_JACOBIAN;
+
     std::vector< double > intrinsic_params;
     camera->writeParameters( intrinsic_params );
 
@@ -618,6 +956,16 @@ CostFunctionFactory::generateCostFunction( const CameraConstPtr& camera,
 {
     ceres::CostFunction* costFunction = 0;
 
+    if ( flags == ( CAMERA_INTRINSICS | CAMERA_POSE | ANALYTIC_JACOBIAN ) )
+    {
+        costFunction = generateAnalyticReprojectionError( camera, observed_P, observed_p, sqrtPrecisionMat );
+        if ( costFunction != 0 )
+        {
+            return costFunction;
+        }
+    }
+    flags &= ~ANALYTIC_JACOBIAN;
+
     std::vector< double > intrinsic_params;
     camera->writeParameters( intrinsic_params );
 
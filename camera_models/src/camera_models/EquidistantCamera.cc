@@ -9,6 +9,7 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "camodocal/camera_models/StateIO.h"
 #include "camodocal/gpl/gpl.h"
 
 namespace camodocal
@@ -256,7 +257,7 @@ EquidistantCamera::EquidistantCamera()
  , m_inv_K22(1.0)
  , m_inv_K23(0.0)
 {
-
+    buildInverseTable();
 }
 
 EquidistantCamera::EquidistantCamera(const std::string& cameraName,
@@ -272,6 +273,8 @@ EquidistantCamera::EquidistantCamera(const std::string& cameraName,
     m_inv_K13 = -mParameters.u0() / mParameters.mu();
     m_inv_K22 = 1.0 / mParameters.mv();
     m_inv_K23 = -mParameters.v0() / mParameters.mv();
+
+    buildInverseTable();
 }
 
 EquidistantCamera::EquidistantCamera(const EquidistantCamera::Parameters& params)
@@ -282,6 +285,8 @@ EquidistantCamera::EquidistantCamera(const EquidistantCamera::Parameters& params
     m_inv_K13 = -mParameters.u0() / mParameters.mu();
     m_inv_K22 = 1.0 / mParameters.mv();
     m_inv_K23 = -mParameters.v0() / mParameters.mv();
+
+    buildInverseTable();
 }
 
 Camera::ModelType
@@ -441,6 +446,62 @@ EquidistantCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P)
     P(2) = cos(theta);
 }
 
+void
+EquidistantCamera::liftProjectiveBatch(const double* p, double* P, int n) const
+{
+    for (int i = 0; i < n; ++i)
+    {
+        double mx_u = m_inv_K11 * p[2 * i] + m_inv_K13;
+        double my_u = m_inv_K22 * p[2 * i + 1] + m_inv_K23;
+        double p_u_norm = sqrt(mx_u * mx_u + my_u * my_u);
+
+        double theta;
+        if (!m_inverseTable.theta(p_u_norm, theta))
+        {
+            theta = solveTheta(p_u_norm);
+        }
+
+        // cos(phi) and sin(phi) from the normalised point, phi = 0 at the center
+        double sin_theta = sin(theta);
+        if (p_u_norm < 1e-10)
+        {
+            P[3 * i] = sin_theta;
+            P[3 * i + 1] = 0.0;
+        }
+        else
+        {
+            P[3 * i] = sin_theta * mx_u / p_u_norm;
+            P[3 * i + 1] = sin_theta * my_u / p_u_norm;
+        }
+        P[3 * i + 2] = cos(theta);
+    }
+}
+
+void
+EquidistantCamera::spaceToPlaneBatch(const double* P, double* p, int n) const
+{
+    double k2 = mParameters.k2();
+    double k3 = mParameters.k3();
+    double k4 = mParameters.k4();
+    double k5 = mParameters.k5();
+    double mu = mParameters.mu();
+    double mv = mParameters.mv();
+    double u0 = mParameters.u0();
+    double v0 = mParameters.v0();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double x = P[3 * i], y = P[3 * i + 1], z = P[3 * i + 2];
+        double rho = sqrt(x * x + y * y);
+        double theta = atan2(rho, z);
+        double inv_rho = rho > 0.0 ? 1.0 / rho : 0.0;
+        double r_theta = r(k2, k3, k4, k5, theta) * inv_rho;
+
+        p[2 * i] = mu * r_theta * x + u0;
+        p[2 * i + 1] = mv * r_theta * y + v0;
+    }
+}
+
 /** 
  * \brief Project a 3D point (\a x,\a y,\a z) to the image plane in (\a u,\a v)
  *
@@ -517,26 +578,15 @@ EquidistantCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale)
     cv::Mat mapX = cv::Mat::zeros(imageSize, CV_32F);
     cv::Mat mapY = cv::Mat::zeros(imageSize, CV_32F);
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
-            double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
-
-            double theta, phi;
-            backprojectSymmetric(Eigen::Vector2d(mx_u, my_u), theta, phi);
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
+        double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
 
-            Eigen::Vector3d P;
-            P << sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta);
+        double theta, phi;
+        backprojectSymmetric(Eigen::Vector2d(mx_u, my_u), theta, phi);
 
-            Eigen::Vector2d p;
-            spaceToPlane(P, p);
-
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+        return Eigen::Vector3d(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 }
@@ -583,22 +633,11 @@ EquidistantCamera::initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
     cv::cv2eigen(rmat, R);
     R_inv = R.inverse();
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            Eigen::Vector3f xo;
-            xo << u, v, 1;
-
-            Eigen::Vector3f uo = R_inv * K_rect_inv * xo;
-
-            Eigen::Vector2d p;
-            spaceToPlane(uo.cast<double>(), p);
-
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+    Eigen::Matrix3f R_inv_K_rect_inv = R_inv * K_rect_inv;
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        Eigen::Vector3f uo = R_inv_K_rect_inv * Eigen::Vector3f(u, v, 1);
+        return uo.cast<double>().eval();
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 
@@ -624,11 +663,8 @@ EquidistantCamera::setParameters(const EquidistantCamera::Parameters& parameters
 {
     mParameters = parameters;
 
-    // Inverse camera projection matrix parameters
-    m_inv_K11 = 1.0 / mParameters.mu();
-    m_inv_K13 = -mParameters.u0() / mParameters.mu();
-    m_inv_K22 = 1.0 / mParameters.mv();
-    m_inv_K23 = -mParameters.v0() / mParameters.mv();
+    updateInverseK();
+    buildInverseTable();
 }
 
 void
@@ -682,6 +718,86 @@ EquidistantCamera::parametersToString(void) const
     return oss.str();
 }
 
+bool
+EquidistantCamera::writeState(std::ostream& out) const
+{
+    writeBinary(out, mParameters.cameraName());
+    writeBinary(out, mParameters.imageWidth());
+    writeBinary(out, mParameters.imageHeight());
+    writeBinary(out, mParameters.k2());
+    writeBinary(out, mParameters.k3());
+    writeBinary(out, mParameters.k4());
+    writeBinary(out, mParameters.k5());
+    writeBinary(out, mParameters.mu());
+    writeBinary(out, mParameters.mv());
+    writeBinary(out, mParameters.u0());
+    writeBinary(out, mParameters.v0());
+
+    m_inverseTable.write(out);
+
+    return out.good();
+}
+
+bool
+EquidistantCamera::readState(std::istream& in)
+{
+    Parameters params = getParameters();
+    RadialInverseTable inverseTable;
+
+    if (!readBinary(in, params.cameraName()) ||
+        !readBinary(in, params.imageWidth()) ||
+        !readBinary(in, params.imageHeight()) ||
+        !readBinary(in, params.k2()) ||
+        !readBinary(in, params.k3()) ||
+        !readBinary(in, params.k4()) ||
+        !readBinary(in, params.k5()) ||
+        !readBinary(in, params.mu()) ||
+        !readBinary(in, params.mv()) ||
+        !readBinary(in, params.u0()) ||
+        !readBinary(in, params.v0()) ||
+        !inverseTable.read(in))
+    {
+        return false;
+    }
+
+    mParameters = params;
+    m_inverseTable = inverseTable;
+    updateInverseK();
+
+    return true;
+}
+
+void
+EquidistantCamera::updateInverseK(void)
+{
+    // Inverse camera projection matrix parameters
+    m_inv_K11 = 1.0 / mParameters.mu();
+    m_inv_K13 = -mParameters.u0() / mParameters.mu();
+    m_inv_K22 = 1.0 / mParameters.mv();
+    m_inv_K23 = -mParameters.v0() / mParameters.mv();
+}
+
+void
+EquidistantCamera::buildInverseTable(void)
+{
+    // r(theta) = theta + k2 theta^3 + k3 theta^5 + k4 theta^7 + k5 theta^9
+    std::vector<double> coeff(10, 0.0);
+    coeff[1] = 1.0;
+    coeff[3] = mParameters.k2();
+    coeff[5] = mParameters.k3();
+    coeff[7] = mParameters.k4();
+    coeff[9] = mParameters.k5();
+
+    // theta = r without distortion, leave the table empty
+    if (coeff[3] == 0.0 && coeff[5] == 0.0 && coeff[7] == 0.0 && coeff[9] == 0.0)
+    {
+        m_inverseTable.build(std::vector<double>(), 0.0);
+        return;
+    }
+
+    m_inverseTable.build(coeff, M_PI);
+}
+
 void
 EquidistantCamera::fitOddPoly(const std::vector<double>& x, const std::vector<double>& y,
                               int n, std::vector<double>& coeffs) const
@@ -716,7 +832,6 @@ void
 EquidistantCamera::backprojectSymmetric(const Eigen::Vector2d& p_u,
                                         double& theta, double& phi) const
 {
-    double tol = 1e-10;
     double p_u_norm = p_u.norm();
 
     if (p_u_norm < 1e-10)
@@ -728,6 +843,18 @@ EquidistantCamera::backprojectSymmetric(const Eigen::Vector2d& p_u,
         phi = atan2(p_u(1), p_u(0));
     }
 
+    if (!m_inverseTable.theta(p_u_norm, theta))
+    {
+        theta = solveTheta(p_u_norm);
+    }
+}
+
+double
+EquidistantCamera::solveTheta(double p_u_norm) const
+{
+    double tol = 1e-10;
+    double theta;
+
     int npow = 9;
     if (mParameters.k5() == 0.0)
     {
@@ -815,6 +942,8 @@ EquidistantCamera::backprojectSymmetric(const Eigen::Vector2d& p_u,
             theta = *std::min_element(thetas.begin(), thetas.end());
         }
     }
+
+    return theta;
 }
 
 }
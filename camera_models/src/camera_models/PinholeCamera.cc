@@ -8,6 +8,7 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "camodocal/camera_models/RadtanDistortion.h"
 #include "camodocal/gpl/gpl.h"
 
 namespace camodocal
@@ -510,6 +511,71 @@ PinholeCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) cons
 }
 
 
+void
+PinholeCamera::liftProjectiveBatch(const double* p, double* P, int n) const
+{
+    if (m_noDistortion)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            P[3 * i] = m_inv_K11 * p[2 * i] + m_inv_K13;
+            P[3 * i + 1] = m_inv_K22 * p[2 * i + 1] + m_inv_K23;
+            P[3 * i + 2] = 1.0;
+        }
+        return;
+    }
+
+    double k1 = mParameters.k1();
+    double k2 = mParameters.k2();
+    double p1 = mParameters.p1();
+    double p2 = mParameters.p2();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double mx_d = m_inv_K11 * p[2 * i] + m_inv_K13;
+        double my_d = m_inv_K22 * p[2 * i + 1] + m_inv_K23;
+
+        // Recursive distortion model, as liftProjective
+        double mx_u = mx_d, my_u = my_d;
+        for (int j = 0; j < 8; ++j)
+        {
+            double dx_u, dy_u;
+            radtanDistortion(k1, k2, p1, p2, mx_u, my_u, dx_u, dy_u);
+            mx_u = mx_d - dx_u;
+            my_u = my_d - dy_u;
+        }
+
+        P[3 * i] = mx_u;
+        P[3 * i + 1] = my_u;
+        P[3 * i + 2] = 1.0;
+    }
+}
+
+void
+PinholeCamera::spaceToPlaneBatch(const double* P, double* p, int n) const
+{
+    double k1 = m_noDistortion ? 0.0 : mParameters.k1();
+    double k2 = m_noDistortion ? 0.0 : mParameters.k2();
+    double p1 = m_noDistortion ? 0.0 : mParameters.p1();
+    double p2 = m_noDistortion ? 0.0 : mParameters.p2();
+    double fx = mParameters.fx();
+    double fy = mParameters.fy();
+    double cx = mParameters.cx();
+    double cy = mParameters.cy();
+
+    for (int i = 0; i < n; ++i)
+    {
+        double mx_u = P[3 * i] / P[3 * i + 2];
+        double my_u = P[3 * i + 1] / P[3 * i + 2];
+
+        double dx_u, dy_u;
+        radtanDistortion(k1, k2, p1, p2, mx_u, my_u, dx_u, dy_u);
+
+        p[2 * i] = fx * (mx_u + dx_u) + cx;
+        p[2 * i + 1] = fy * (my_u + dy_u) + cy;
+    }
+}
+
 /**
  * \brief Project a 3D point (\a x,\a y,\a z) to the image plane in (\a u,\a v)
  *
@@ -704,23 +770,12 @@ PinholeCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale) con
     cv::Mat mapX = cv::Mat::zeros(imageSize, CV_32F);
     cv::Mat mapY = cv::Mat::zeros(imageSize, CV_32F);
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
-            double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
+        double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
 
-            Eigen::Vector3d P;
-            P << mx_u, my_u, 1.0;
-
-            Eigen::Vector2d p;
-            spaceToPlane(P, p);
-
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+        return Eigen::Vector3d(mx_u, my_u, 1.0);
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 }
@@ -768,22 +823,11 @@ PinholeCamera::initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
 
     Eigen::Matrix3f K_rect_inv = K_rect.inverse();
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            Eigen::Vector3f xo;
-            xo << u, v, 1;
-
-            Eigen::Vector3f uo = R_inv * K_rect_inv * xo;
-
-            Eigen::Vector2d p;
-            spaceToPlane(uo.cast<double>(), p);
-
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+    Eigen::Matrix3f R_inv_K_rect_inv = R_inv * K_rect_inv;
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        Eigen::Vector3f uo = R_inv_K_rect_inv * Eigen::Vector3f(u, v, 1);
+        return uo.cast<double>().eval();
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 
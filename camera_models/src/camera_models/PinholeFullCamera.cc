@@ -825,23 +825,12 @@ PinholeFullCamera::initUndistortMap( cv::Mat& map1, cv::Mat& map2, double fScale
     cv::Mat mapX = cv::Mat::zeros( imageSize, CV_32F );
     cv::Mat mapY = cv::Mat::zeros( imageSize, CV_32F );
 
-    for ( int v = 0; v < imageSize.height; ++v )
-    {
-        for ( int u = 0; u < imageSize.width; ++u )
-        {
-            double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
-            double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
+    projectRayMap( mapX, mapY, [&]( int u, int v ) {
+        double mx_u = m_inv_K11 / fScale * u + m_inv_K13 / fScale;
+        double my_u = m_inv_K22 / fScale * v + m_inv_K23 / fScale;
 
-            Eigen::Vector3d P;
-            P << mx_u, my_u, 1.0;
-
-            Eigen::Vector2d p;
-            spaceToPlane( P, p );
-
-            mapX.at< float >( v, u ) = p( 0 );
-            mapY.at< float >( v, u ) = p( 1 );
-        }
-    }
+        return Eigen::Vector3d( mx_u, my_u, 1.0 );
+    } );
 
     cv::convertMaps( mapX, mapY, map1, map2, CV_32FC1, false );
 }
@@ -882,22 +871,11 @@ cv::Mat& map1, cv::Mat& map2, float fx, float fy, cv::Size imageSize, float cx,
 
     Eigen::Matrix3f K_rect_inv = K_rect.inverse( );
 
-    for ( int v = 0; v < imageSize.height; ++v )
-    {
-        for ( int u = 0; u < imageSize.width; ++u )
-        {
-            Eigen::Vector3f xo;
-            xo << u, v, 1;
-
-            Eigen::Vector3f uo = R_inv * K_rect_inv * xo;
-
-            Eigen::Vector2d p;
-            spaceToPlane( uo.cast< double >( ), p );
-
-            mapX.at< float >( v, u ) = p( 0 );
-            mapY.at< float >( v, u ) = p( 1 );
-        }
-    }
+    Eigen::Matrix3f R_inv_K_rect_inv = R_inv * K_rect_inv;
+    projectRayMap( mapX, mapY, [&]( int u, int v ) {
+        Eigen::Vector3f uo = R_inv_K_rect_inv * Eigen::Vector3f( u, v, 1 );
+        return uo.cast< double >( ).eval( );
+    } );
 
     cv::convertMaps( mapX, mapY, map1, map2, CV_32FC1, false );
 
@@ -9,6 +9,7 @@
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <camodocal/camera_models/StateIO.h>
 #include <camodocal/code_utils/math_utils/math_utils.h>
 #include <camodocal/gpl/gpl.h>
 
@@ -16,7 +17,8 @@ namespace camodocal
 {
 
 PolyFisheyeCamera::PolyFisheyeCamera( )
-: m_inv_K11( 1.0 )
+: fastCalc( NULL )
+, m_inv_K11( 1.0 )
 , m_inv_K12( 0.0 )
 , m_inv_K13( 0.0 )
 , m_inv_K22( 1.0 )
@@ -26,6 +28,8 @@ PolyFisheyeCamera::PolyFisheyeCamera( )
 
     poly->setPolyCoeff( 0, 0.0 );
     poly->setPolyCoeff( 1, 1.0 );
+
+    buildInverseTable( );
 }
 
 PolyFisheyeCamera::PolyFisheyeCamera( const std::string& cameraName,
@@ -46,12 +50,14 @@ PolyFisheyeCamera::PolyFisheyeCamera( const std::string& cameraName,
                                       double v0,
                                       int isFast )
 : mParameters( cameraName, imageWidth, imageHeight, k2, k3, k4, k5, k6, k7, p1, p2, A11, A12, A22, u0, v0, isFast )
+, fastCalc( NULL )
 {
     eigen_utils::Vector coeff( FISHEYE_POLY_ORDER + 1 );
     coeff << 0.0, 1.0, k2, k3, k4, k5, k6, k7;
 
     poly = new math_utils::Polynomial( FISHEYE_POLY_ORDER );
     poly->setPolyCoeff( coeff );
+    buildInverseTable( );
 
     if ( mParameters.isFast( ) == 1 )
     {
@@ -68,6 +74,7 @@ PolyFisheyeCamera::PolyFisheyeCamera( const std::string& cameraName,
 
 PolyFisheyeCamera::PolyFisheyeCamera( const PolyFisheyeCamera::Parameters& params )
 : mParameters( params )
+, fastCalc( NULL )
 {
     eigen_utils::Vector coeff( FISHEYE_POLY_ORDER + 1 );
     coeff << 0.0, 1.0, params.k2( ), params.k3( ), params.k4( ), params.k5( ), params.k6( ),
@@ -75,6 +82,7 @@ PolyFisheyeCamera::PolyFisheyeCamera( const PolyFisheyeCamera::Parameters& param
 
     poly = new math_utils::Polynomial( FISHEYE_POLY_ORDER );
     poly->setPolyCoeff( coeff );
+    buildInverseTable( );
 
     calcKinvese( params.A11( ), params.A12( ), params.A22( ), params.u0( ), params.v0( ) );
 
@@ -399,6 +407,79 @@ PolyFisheyeCamera::liftProjective( const Eigen::Vector2d& p, Eigen::Vector3d& P,
     liftProjective( p_tmp, P );              // p_tmp is without resize
 }
 
+void
+PolyFisheyeCamera::liftProjectiveBatch( const double* p, double* P, int n ) const
+{
+    if ( !mParameters.isDistortion( ) || mParameters.isFast( ) == 1 )
+    {
+        Eigen::Vector3d P_i;
+        for ( int i = 0; i < n; ++i )
+        {
+            PolyFisheyeCamera::liftProjective( Eigen::Vector2d( p[2 * i], p[2 * i + 1] ), P_i );
+            P[3 * i]     = P_i( 0 );
+            P[3 * i + 1] = P_i( 1 );
+            P[3 * i + 2] = P_i( 2 );
+        }
+        return;
+    }
+
+    for ( int i = 0; i < n; ++i )
+    {
+        double cos_theta, sin_theta, cos_phi, sin_phi;
+        backprojectSymmetric( Eigen::Vector2d( m_inv_K11 * p[2 * i] + m_inv_K12 * p[2 * i + 1] + m_inv_K13,
+                                               m_inv_K22 * p[2 * i + 1] + m_inv_K23 ),
+                              cos_theta,
+                              sin_theta,
+                              cos_phi,
+                              sin_phi );
+        P[3 * i]     = cos_phi * sin_theta;
+        P[3 * i + 1] = sin_phi * sin_theta;
+        P[3 * i + 2] = cos_theta;
+    }
+}
+
+void
+PolyFisheyeCamera::spaceToPlaneBatch( const double* P, double* p, int n ) const
+{
+    if ( !mParameters.isDistortion( ) || mParameters.isFast( ) == 1 )
+    {
+        Eigen::Vector2d p_i;
+        for ( int i = 0; i < n; ++i )
+        {
+            PolyFisheyeCamera::spaceToPlane( Eigen::Vector3d( P[3 * i], P[3 * i + 1], P[3 * i + 2] ), p_i );
+            p[2 * i]     = p_i( 0 );
+            p[2 * i + 1] = p_i( 1 );
+        }
+        return;
+    }
+
+    double k2  = mParameters.k2( );
+    double k3  = mParameters.k3( );
+    double k4  = mParameters.k4( );
+    double k5  = mParameters.k5( );
+    double k6  = mParameters.k6( );
+    double k7  = mParameters.k7( );
+    double A11 = mParameters.A11( );
+    double A12 = mParameters.A12( );
+    double A22 = mParameters.A22( );
+    double u0  = mParameters.u0( );
+    double v0  = mParameters.v0( );
+
+    for ( int i = 0; i < n; ++i )
+    {
+        double x = P[3 * i], y = P[3 * i + 1], z = P[3 * i + 2];
+
+        double theta        = acos( z / sqrt( x * x + y * y + z * z ) );
+        double inverse_r_P2 = 1.0 / sqrt( y * y + x * x );
+        double r_point      = r( k2, k3, k4, k5, k6, k7, theta ) * inverse_r_P2;
+
+        double u = r_point * x;
+        double v = r_point * y;
+        p[2 * i]     = A11 * u + A12 * v + u0;
+        p[2 * i + 1] = A22 * v + v0;
+    }
+}
+
 void
 PolyFisheyeCamera::undistToPlane( const Eigen::Vector2d& p_u, Eigen::Vector2d& p ) const
 {
@@ -440,23 +521,11 @@ cv::Mat& map1, cv::Mat& map2, float fx, float fy, cv::Size imageSize, float cx,
     cv::cv2eigen( rmat, R );
     R_inv = R.inverse( );
 
-    for ( int v = 0; v < imageSize.height; ++v )
-    {
-        for ( int u = 0; u < imageSize.width; ++u )
-        {
-            Eigen::Vector3f xo;
-            xo << u, v, 1;
-
-            // TODO FIXME
-            Eigen::Vector3f uo = R_inv * K_rect_inv * xo;
-
-            Eigen::Vector2d p;
-            spaceToPlane( uo.cast< double >( ), p );
-
-            mapX.at< float >( v, u ) = p( 0 );
-            mapY.at< float >( v, u ) = p( 1 );
-        }
-    }
+    Eigen::Matrix3f R_inv_K_rect_inv = R_inv * K_rect_inv;
+    projectRayMap( mapX, mapY, [&]( int u, int v ) {
+        Eigen::Vector3f uo = R_inv_K_rect_inv * Eigen::Vector3f( u, v, 1 );
+        return uo.cast< double >( ).eval( );
+    } );
 
     cv::convertMaps( mapX, mapY, map1, map2, CV_32FC1, false );
 
@@ -494,6 +563,7 @@ PolyFisheyeCamera::setParameters( const PolyFisheyeCamera::Parameters& parameter
         delete poly;
         poly = new math_utils::Polynomial( FISHEYE_POLY_ORDER );
         poly->setPolyCoeff( coeff );
+        buildInverseTable( );
 
         if ( mParameters.isFast( ) == 1 )
             setFastCalc( );
@@ -571,6 +641,88 @@ PolyFisheyeCamera::parametersToString( ) const
     return oss.str( );
 }
 
+bool
+PolyFisheyeCamera::writeState( std::ostream& out ) const
+{
+    writeBinary( out, mParameters.cameraName( ) );
+    writeBinary( out, mParameters.imageWidth( ) );
+    writeBinary( out, mParameters.imageHeight( ) );
+    writeBinary( out, mParameters.k2( ) );
+    writeBinary( out, mParameters.k3( ) );
+    writeBinary( out, mParameters.k4( ) );
+    writeBinary( out, mParameters.k5( ) );
+    writeBinary( out, mParameters.k6( ) );
+    writeBinary( out, mParameters.k7( ) );
+    writeBinary( out, mParameters.p1( ) );
+    writeBinary( out, mParameters.p2( ) );
+    writeBinary( out, mParameters.A11( ) );
+    writeBinary( out, mParameters.A12( ) );
+    writeBinary( out, mParameters.A22( ) );
+    writeBinary( out, mParameters.u0( ) );
+    writeBinary( out, mParameters.v0( ) );
+    writeBinary( out, mParameters.isFast( ) );
+    writeBinary( out, mParameters.numDiff( ) );
+    writeBinary( out, mParameters.maxIncidentAngle( ) );
+
+    eigen_utils::Vector coeff = poly->getPolyCoeff( );
+    writeBinary( out, std::vector< double >( coeff.data( ), coeff.data( ) + coeff.size( ) ) );
+    inverseTable.write( out );
+
+    writeBinary( out, static_cast< int >( fastCalc != NULL ) );
+    if ( fastCalc != NULL )
+        fastCalc->write( out );
+
+    return out.good( );
+}
+
+bool
+PolyFisheyeCamera::readState( std::istream& in )
+{
+    Parameters params = getParameters( );
+    std::vector< double > coeff;
+    RadialInverseTable table;
+    int hasFastCalc;
+
+    if ( !readBinary( in, params.cameraName( ) ) || !readBinary( in, params.imageWidth( ) )
+         || !readBinary( in, params.imageHeight( ) ) || !readBinary( in, params.k2( ) )
+         || !readBinary( in, params.k3( ) ) || !readBinary( in, params.k4( ) )
+         || !readBinary( in, params.k5( ) ) || !readBinary( in, params.k6( ) )
+         || !readBinary( in, params.k7( ) ) || !readBinary( in, params.p1( ) )
+         || !readBinary( in, params.p2( ) ) || !readBinary( in, params.A11( ) )
+         || !readBinary( in, params.A12( ) ) || !readBinary( in, params.A22( ) )
+         || !readBinary( in, params.u0( ) ) || !readBinary( in, params.v0( ) )
+         || !readBinary( in, params.isFast( ) ) || !readBinary( in, params.numDiff( ) )
+         || !readBinary( in, params.maxIncidentAngle( ) ) || !readBinary( in, coeff )
+         || coeff.size( ) != static_cast< size_t >( FISHEYE_POLY_ORDER + 1 ) || !table.read( in )
+         || !readBinary( in, hasFastCalc ) )
+    {
+        return false;
+    }
+
+    FastCalcTABLE* table_fast = NULL;
+    if ( hasFastCalc )
+    {
+        table_fast = new FastCalcTABLE;
+        if ( !table_fast->read( in ) )
+        {
+            delete table_fast;
+            return false;
+        }
+    }
+
+    mParameters = params;
+    calcKinvese( params.A11( ), params.A12( ), params.A22( ), params.u0( ), params.v0( ) );
+
+    delete poly;
+    poly = new math_utils::Polynomial( eigen_utils::Vector::Map( coeff.data( ), coeff.size( ) ) );
+    inverseTable = table;
+
+    delete fastCalc;
+    fastCalc = table_fast;
+
+    return true;
+}
+
 void
 PolyFisheyeCamera::backprojectSymmetric( const Eigen::Vector2d& p_u,
                                          double& cos_theta,
@@ -592,9 +744,12 @@ PolyFisheyeCamera::backprojectSymmetric( const Eigen::Vector2d& p_u,
         sin_phi = p_u( 1 ) / r;
         cos_phi = p_u( 0 ) / r;
 
-        theta = poly->getOneRealRoot( r, 0.0, MAX_INCIDENT_ANGLE_DEGREE / RAD2DEG );
-        if ( theta < 1e-10 )
-            theta = 3.14;
+        if ( !inverseTable.theta( r, theta ) )
+        {
+            theta = poly->getOneRealRoot( r, 0.0, MAX_INCIDENT_ANGLE_DEGREE / RAD2DEG );
+            if ( theta < 1e-10 )
+                theta = 3.14;
+        }
     }
 
     sin_theta = sin( theta );
@@ -629,10 +784,22 @@ PolyFisheyeCamera::calcKinvese( double a11, double a12, double a22, double u0, d
     return true;
 }
 
+void
+PolyFisheyeCamera::buildInverseTable( )
+{
+    if ( poly == NULL )
+        return;
+
+    eigen_utils::Vector coeff = poly->getPolyCoeff( );
+    inverseTable.build( std::vector< double >( coeff.data( ), coeff.data( ) + coeff.size( ) ),
+                        MAX_INCIDENT_ANGLE_DEGREE / RAD2DEG );
+}
+
 void
 PolyFisheyeCamera::setPoly( math_utils::Polynomial* value )
 {
     poly = value;
+    buildInverseTable( );
 }
 
 PolyFisheyeCamera::FastCalcTABLE*
@@ -648,12 +815,10 @@ PolyFisheyeCamera::setFastCalc( )
     coeff_fast << 0.0, 1.0, mParameters.k2( ), mParameters.k3( ), mParameters.k4( ),
     mParameters.k5( ), mParameters.k6( ), mParameters.k7( );
 
-    std::cout << "[#Info][camera_model]" << std::endl;
-    //        if(fastCalc != NULL)
-    //          delete fastCalc;
     //        fastCalc = new FastCalcPOLY(coeff_fast,
     //                                    (double) mParameters.maxIncidentAngle());
 
+    delete fastCalc;
     fastCalc
     = new FastCalcTABLE( coeff_fast, mParameters.numDiff( ), ( double )mParameters.maxIncidentAngle( ) );
 
@@ -1189,8 +1354,6 @@ PolyFisheyeCamera::FastCalcTABLE::calcAngleToR( eigen_utils::Matrix& _angleToR,
                                                 const int _numDiffAngle,
                                                 const double _diffAngle )
 {
-    std::cout << "poly_angle " << fastPoly->getPolyCoeff( ).transpose( ) << std::endl;
-
     _angleToR.resize( _numDiffAngle + 1, 1 );
 
     _angleToR( 0, 0 ) = 0;
@@ -1222,8 +1385,6 @@ PolyFisheyeCamera::FastCalcTABLE::calcRToAngle( eigen_utils::Matrix& _rToAngle,
                                                 const double _diffR,
                                                 const double _maxangle )
 {
-    std::cout << "poly_r " << fastPoly->getPolyCoeff( ).transpose( ) << std::endl;
-
     _rToAngle.resize( _numDiffR + 1, 1 );
 
     _rToAngle( 0, 0 ) = 0;
@@ -1259,11 +1420,63 @@ PolyFisheyeCamera::FastCalcTABLE::FastCalcTABLE( eigen_utils::Vector& poly_coeff
 
     fastPoly = new math_utils::Polynomial( poly_coeff );
 
-    std::cout << "fast_poly " << fastPoly->getPolyCoeff( ).transpose( ) << std::endl;
-
     resetFastCalc( );
 }
 
+PolyFisheyeCamera::FastCalcTABLE::FastCalcTABLE( )
+: fastPoly( NULL )
+, maxIncidentAngle( 0.0 )
+, maxImageR( 0.0 )
+, numDiffAngle( 0 )
+, numDiffR( 0 )
+, diffAngle( 0.0 )
+, diffR( 0.0 )
+{
+}
+
+void
+PolyFisheyeCamera::FastCalcTABLE::write( std::ostream& out ) const
+{
+    eigen_utils::Vector coeff = fastPoly->getPolyCoeff( );
+    writeBinary( out, std::vector< double >( coeff.data( ), coeff.data( ) + coeff.size( ) ) );
+
+    writeBinary( out, maxIncidentAngle );
+    writeBinary( out, maxImageR );
+    writeBinary( out, numDiffAngle );
+    writeBinary( out, numDiffR );
+    writeBinary( out, diffAngle );
+    writeBinary( out, diffR );
+
+    // both tables are single columns
+    writeBinary( out, std::vector< double >( angleToR.data( ), angleToR.data( ) + angleToR.size( ) ) );
+    writeBinary( out, std::vector< double >( rToAngle.data( ), rToAngle.data( ) + rToAngle.size( ) ) );
+}
+
+bool
+PolyFisheyeCamera::FastCalcTABLE::read( std::istream& in )
+{
+    std::vector< double > coeff, angle_to_r, r_to_angle;
+
+    if ( !readBinary( in, coeff ) || coeff.empty( ) || !readBinary( in, maxIncidentAngle )
+         || !readBinary( in, maxImageR ) || !readBinary( in, numDiffAngle )
+         || !readBinary( in, numDiffR ) || !readBinary( in, diffAngle ) || !readBinary( in, diffR )
+         || !readBinary( in, angle_to_r ) || !readBinary( in, r_to_angle )
+         || numDiffAngle < 1 || numDiffR < 1
+         || angle_to_r.size( ) != static_cast< size_t >( numDiffAngle + 1 )
+         || r_to_angle.size( ) != static_cast< size_t >( numDiffR + 1 ) )
+    {
+        return false;
+    }
+
+    delete fastPoly;
+    fastPoly = new math_utils::Polynomial( eigen_utils::Vector::Map( coeff.data( ), coeff.size( ) ) );
+
+    angleToR = eigen_utils::Matrix::Map( angle_to_r.data( ), angle_to_r.size( ), 1 );
+    rToAngle = eigen_utils::Matrix::Map( r_to_angle.data( ), r_to_angle.size( ), 1 );
+
+    return true;
+}
+
 void
 PolyFisheyeCamera::FastCalcTABLE::backprojectSymmetric( const Eigen::Vector2d& p_u,
                                                         double& cos_theta,
@@ -0,0 +1,156 @@
+#include <camodocal/camera_models/RadialInverseTable.h>
+#include <camodocal/camera_models/StateIO.h>
+
+#include <algorithm>
+#include <cmath>
+
+// sampling of theta used to find the monotone part of the polynomial
+#define RADIAL_TABLE_MONOTONE_SAMPLES 8
+#define RADIAL_TABLE_BISECTION_ITERATIONS 60
+
+namespace camodocal
+{
+
+RadialInverseTable::RadialInverseTable( )
+: m_maxTheta( 0.0 )
+, m_maxR( 0.0 )
+, m_invDiffR( 0.0 )
+{
+}
+
+void
+RadialInverseTable::build( const std::vector< double >& coeff, double maxTheta, int tableSize )
+{
+    m_coeff = coeff;
+    m_rToTheta.clear( );
+    m_maxTheta = 0.0;
+    m_maxR     = 0.0;
+    m_invDiffR = 0.0;
+
+    if ( tableSize < 2 || maxTheta <= 0.0 )
+        return;
+
+    // the inverse only exists while r(theta) increases
+    int numSamples   = tableSize * RADIAL_TABLE_MONOTONE_SAMPLES;
+    double diffTheta = maxTheta / numSamples;
+    double r_last, dr;
+    evaluate( 0.0, r_last, dr );
+    for ( int index = 1; index <= numSamples; ++index )
+    {
+        double r;
+        evaluate( index * diffTheta, r, dr );
+        if ( r <= r_last || dr <= 0.0 )
+            break;
+        m_maxTheta = index * diffTheta;
+        m_maxR     = r;
+        r_last     = r;
+    }
+
+    if ( m_maxR <= 0.0 )
+        return;
+
+    m_invDiffR = tableSize / m_maxR;
+    m_rToTheta.resize( tableSize + 1 );
+    m_rToTheta[0] = 0.0;
+    for ( int index = 1; index <= tableSize; ++index )
+    {
+        double target = index / m_invDiffR;
+        double lower  = m_rToTheta[index - 1];
+        double upper  = m_maxTheta;
+        for ( int iter = 0; iter < RADIAL_TABLE_BISECTION_ITERATIONS; ++iter )
+        {
+            double mid = 0.5 * ( lower + upper );
+            double r;
+            evaluate( mid, r, dr );
+            if ( r < target )
+                lower = mid;
+            else
+                upper = mid;
+        }
+        m_rToTheta[index] = 0.5 * ( lower + upper );
+    }
+}
+
+bool
+RadialInverseTable::theta( double r, double& theta ) const
+{
+    if ( m_rToTheta.empty( ) || r < 0.0 || r > m_maxR )
+        return false;
+
+    double num = r * m_invDiffR;
+    int index  = std::min( static_cast< int >( num ), static_cast< int >( m_rToTheta.size( ) ) - 2 );
+    theta      = m_rToTheta[index] + ( num - index ) * ( m_rToTheta[index + 1] - m_rToTheta[index] );
+
+    for ( int iter = 0; iter < RADIAL_TABLE_NEWTON_ITERATIONS; ++iter )
+    {
+        double r_theta, dr;
+        evaluate( theta, r_theta, dr );
+        if ( dr <= 0.0 )
+            break;
+        double step = ( r_theta - r ) / dr;
+        theta       = std::max( 0.0, std::min( m_maxTheta, theta - step ) );
+        if ( std::abs( step ) < RADIAL_TABLE_NEWTON_TOLERANCE )
+            break;
+    }
+
+    return true;
+}
+
+bool
+RadialInverseTable::valid( void ) const
+{
+    return !m_rToTheta.empty( );
+}
+
+double
+RadialInverseTable::maxR( void ) const
+{
+    return m_maxR;
+}
+
+double
+RadialInverseTable::maxTheta( void ) const
+{
+    return m_maxTheta;
+}
+
+void
+RadialInverseTable::write( std::ostream& out ) const
+{
+    writeBinary( out, m_coeff );
+    writeBinary( out, m_rToTheta );
+    writeBinary( out, m_maxTheta );
+    writeBinary( out, m_maxR );
+    writeBinary( out, m_invDiffR );
+}
+
+bool
+RadialInverseTable::read( std::istream& in )
+{
+    if ( !readBinary( in, m_coeff ) || !readBinary( in, m_rToTheta ) || !readBinary( in, m_maxTheta )
+         || !readBinary( in, m_maxR ) || !readBinary( in, m_invDiffR ) )
+    {
+        m_rToTheta.clear( );
+        return false;
+    }
+
+    // theta() interpolates between two entries
+    if ( m_rToTheta.size( ) == 1 )
+        m_rToTheta.clear( );
+
+    return true;
+}
+
+void
+RadialInverseTable::evaluate( double theta, double& r, double& dr ) const
+{
+    // Horner scheme for the value and the derivative
+    r  = 0.0;
+    dr = 0.0;
+    for ( int i = static_cast< int >( m_coeff.size( ) ) - 1; i >= 0; --i )
+    {
+        dr = dr * theta + r;
+        r  = r * theta + m_coeff[i];
+    }
+}
+}
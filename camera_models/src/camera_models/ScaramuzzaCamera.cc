@@ -733,22 +733,11 @@ OCAMCamera::initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
     cv::cv2eigen(rmat, R);
     R_inv = R.inverse();
 
-    for (int v = 0; v < imageSize.height; ++v)
-    {
-        for (int u = 0; u < imageSize.width; ++u)
-        {
-            Eigen::Vector3f xo;
-            xo << u, v, 1;
-
-            Eigen::Vector3f uo = R_inv * K_rect_inv * xo;
-
-            Eigen::Vector2d p;
-            spaceToPlane(uo.cast<double>(), p);
-
-            mapX.at<float>(v,u) = p(0);
-            mapY.at<float>(v,u) = p(1);
-        }
-    }
+    Eigen::Matrix3f R_inv_K_rect_inv = R_inv * K_rect_inv;
+    projectRayMap(mapX, mapY, [&](int u, int v) {
+        Eigen::Vector3f uo = R_inv_K_rect_inv * Eigen::Vector3f(u, v, 1);
+        return uo.cast<double>().eval();
+    });
 
     cv::convertMaps(mapX, mapY, map1, map2, CV_32FC1, false);
 
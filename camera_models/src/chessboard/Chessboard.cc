@@ -177,15 +177,11 @@ Chessboard::findChessboardCornersImproved(const cv::Mat& image,
     bool found = false;
     std::vector<ChessboardCornerPtr> outputCorners;
 
-    for (int k = 0; k < 6; ++k)
+    // Stop the sweep at the first threshold and dilation that gives a valid board
+    for (int k = 0; k < 6 && !found; ++k)
     {
-        for (int dilations = minDilations; dilations <= maxDilations; ++dilations)
+        for (int dilations = minDilations; dilations <= maxDilations && !found; ++dilations)
         {
-            if (found)
-            {
-                break;
-            }
-
             cv::Mat thresh_img;
 
             // convert the input grayscale image to binary (black-n-white)
@@ -259,7 +255,7 @@ Chessboard::findChessboardCornersImproved(const cv::Mat& image,
             // function "cleanFoundConnectedQuads" erases the surplus
             // quadrangles by minimizing the convex hull of the remaining pattern.
 
-            for (int group_idx = 0; ; ++group_idx)
+            for (int group_idx = 0; !found; ++group_idx)
             {
                 std::vector<ChessboardQuadPtr> quadGroup;
 
@@ -5,6 +5,7 @@
 #include <iomanip>
 #include <iostream>
 #include <opencv2/core/core.hpp>
+#include <opencv2/core/utility.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
@@ -185,15 +186,40 @@ main( int argc, char** argv )
     camodocal::CameraCalibration calibration( modelType, cameraName, frameSize, boardSize, squareSize );
     calibration.setVerbose( verbose );
 
+    // Decode and detect the images in parallel, results are kept per image and
+    // added in file order below so the calibration does not depend on timing
     std::vector< bool > chessboardFound( imageFilenames.size( ), false );
-    for ( size_t i = 0; i < imageFilenames.size( ); ++i )
-    {
-        image = cv::imread( imageFilenames.at( i ), -1 );
+    std::vector< std::vector< cv::Point2f > > chessboardCorners( imageFilenames.size( ) );
+    std::vector< cv::Mat > chessboardSketches( imageFilenames.size( ) );
+
+    double detectStartTime = camodocal::timeInSeconds( );
+    cv::parallel_for_( cv::Range( 0, imageFilenames.size( ) ), [&]( const cv::Range& range ) {
+        for ( int i = range.start; i < range.end; ++i )
+        {
+            cv::Mat viewImage = cv::imread( imageFilenames.at( i ), -1 );
 
-        camodocal::Chessboard chessboard( boardSize, image );
+            camodocal::Chessboard chessboard( boardSize, viewImage );
+
+            chessboard.findCorners( useOpenCV );
+            if ( chessboard.cornersFound( ) )
+            {
+                chessboardCorners.at( i ) = chessboard.getCorners( );
+                chessboard.getSketch( ).copyTo( chessboardSketches.at( i ) );
+            }
+        }
+    } );
 
-        chessboard.findCorners( useOpenCV );
-        if ( chessboard.cornersFound( ) )
+    if ( verbose )
+    {
+        std::cerr << "# INFO: Chessboard detection in " << imageFilenames.size( ) << " images took "
+                  << camodocal::timeInSeconds( ) - detectStartTime
+                  << " sec with " << cv::getNumThreads( ) << " threads." << std::endl;
+    }
+
+    for ( size_t i = 0; i < imageFilenames.size( ); ++i )
+    {
+        chessboardFound.at( i ) = !chessboardSketches.at( i ).empty( );
+        if ( chessboardFound.at( i ) )
         {
             if ( verbose )
             {
@@ -201,19 +227,15 @@ main( int argc, char** argv )
                           << imageFilenames.at( i ) << std::endl;
             }
 
-            calibration.addChessboardData( chessboard.getCorners( ) );
-
-            cv::Mat sketch;
-            chessboard.getSketch( ).copyTo( sketch );
+            calibration.addChessboardData( chessboardCorners.at( i ) );
 
-            cv::imshow( "Image", sketch );
+            cv::imshow( "Image", chessboardSketches.at( i ) );
             cv::waitKey( 50 );
         }
         else if ( verbose )
         {
             std::cerr << "# INFO: Did not detect chessboard in image " << i + 1 << std::endl;
         }
-        chessboardFound.at( i ) = chessboard.cornersFound( );
     }
     cv::destroyWindow( "Image" );
 
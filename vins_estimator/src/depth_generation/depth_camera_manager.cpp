@@ -6,7 +6,12 @@
 
 using namespace Eigen;
 
-DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye): nh(_nh), fisheye(_fisheye) {
+//Rays sampled per axis for velocity ROI
+#define VEL_ROI_SAMPLES 16
+#define VEL_ROI_ALIGN 32
+
+DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye): 
+    nh(_nh), voxel_snapshot_requested(false), fisheye(_fisheye) {
     pub_depth_clouds.push_back(nh.advertise<sensor_msgs::PointCloud>("depth_cloud_left", 1));
     pub_depth_clouds.push_back(nh.advertise<sensor_msgs::PointCloud>("depth_cloud_front", 1));
     pub_depth_clouds.push_back(nh.advertise<sensor_msgs::PointCloud>("depth_cloud_right", 1));
@@ -76,6 +81,16 @@ DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye
         sgm_params.flags = fsSettings["flags"];
         sgm_params.scanlines_mask = fsSettings["scanlines_mask"];
 
+        coarse_levels.push_back(fsSettings["left_coarse_levels"]);
+        coarse_levels.push_back(fsSettings["front_coarse_levels"]);
+        coarse_levels.push_back(fsSettings["right_coarse_levels"]);
+        coarse_levels.push_back(fsSettings["rear_coarse_levels"]);
+        sgm_params.coarse_band = fsSettings["coarse_band"];
+        if (sgm_params.coarse_band <= 0) {
+            sgm_params.coarse_band = 2;
+        }
+        sgm_params.coarse_eval = (int) fsSettings["coarse_eval"];
+
         pub_cloud_step = fsSettings["pub_cloud_step"];
         if (pub_cloud_step <= 0) {
             pub_cloud_step = 1;
@@ -86,6 +101,52 @@ DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye
         pub_depth_map = (int)fsSettings["pub_depth_map"];
         pub_cloud_all =  (int)fsSettings["pub_cloud_all"];
         enable_extrinsic_calib_for_depth = (int)fsSettings["enable_extrinsic_calib"];
+        enable_temporal_fusion = (int)fsSettings["enable_temporal_fusion"];
+        if (enable_temporal_fusion) {
+            fusion_max_disp_diff = fsSettings["fusion_max_disp_diff"];
+            fusion_decay = fsSettings["fusion_decay"];
+            fusion_min_conf = fsSettings["fusion_min_conf"];
+            fusion_max_conf = fsSettings["fusion_max_conf"];
+            fusion_search_margin = fsSettings["fusion_search_margin"];
+            fusion_full_search_interval = fsSettings["fusion_full_search_interval"];
+            if (fusion_full_search_interval <= 0) {
+                fusion_full_search_interval = 10;
+            }
+            ROS_INFO("Depth temporal fusion enabled: max disp diff %f decay %f conf [%f, %f] search margin %d",
+                fusion_max_disp_diff, fusion_decay, fusion_min_conf, fusion_max_conf, fusion_search_margin);
+        }
+
+        enable_voxel_map = (int)fsSettings["enable_voxel_map"];
+        if (enable_voxel_map) {
+            voxel_resolution = fsSettings["voxel_resolution"];
+            voxel_max_num = fsSettings["voxel_max_num"];
+            voxel_max_age = fsSettings["voxel_max_age"];
+            voxel_min_hits = fsSettings["voxel_min_hits"];
+            if (voxel_resolution <= 0) {
+                voxel_resolution = 0.1;
+            }
+            if (voxel_max_num <= 0) {
+                voxel_max_num = 1000000;
+            }
+            ROS_INFO("Depth voxel map enabled: resolution %f max voxels %d max age %f min hits %d",
+                voxel_resolution, voxel_max_num, voxel_max_age, voxel_min_hits);
+        }
+
+        roi_mode = fsSettings["roi_mode"];
+        if (roi_mode == 1) {
+            roi_yaw_half_angle = fsSettings["roi_yaw_half_angle"];
+            roi_pitch_half_angle = fsSettings["roi_pitch_half_angle"];
+            roi_min_speed = fsSettings["roi_min_speed"];
+            if (roi_yaw_half_angle <= 0) {
+                roi_yaw_half_angle = 45;
+            }
+            if (roi_pitch_half_angle <= 0) {
+                roi_pitch_half_angle = 20;
+            }
+            ROS_INFO("Depth velocity ROI enabled: yaw %f pitch %f min speed %f",
+                roi_yaw_half_angle, roi_pitch_half_angle, roi_min_speed);
+        }
+
         std::string cfg;
         fsSettings["left_depth_RT"] >> cfg;
         dep_RT_config.push_back(cfg);        
@@ -101,6 +162,14 @@ DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye
     }
     fclose(fh);
 
+    if (enable_voxel_map) {
+        voxel_map = new VoxelMap(voxel_resolution, voxel_max_num, voxel_max_age, voxel_min_hits);
+        pub_voxel_added = nh.advertise<sensor_msgs::PointCloud>("depth_map_added", 10);
+        pub_voxel_removed = nh.advertise<sensor_msgs::PointCloud>("depth_map_removed", 10);
+        pub_voxel_snapshot = nh.advertise<sensor_msgs::PointCloud>("depth_map", 1);
+        sub_voxel_snapshot = nh.subscribe("request_depth_map", 1, &DepthCamManager::voxel_snapshot_callback, this);
+    }
+
 
     f_side = fisheye->f_side;
     cx_side = fisheye->cx_side;
@@ -112,6 +181,20 @@ DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye
     cv::eigen2cv(cam_side, cam_side_cv);
     cv::eigen2cv(cam_side_transpose, cam_side_cv_transpose);
 
+    //Side images are transposed and flipped before depth estimation
+    depth_img_size = cv::Size(fisheye->sideImgHeight*downsample_ratio, fisheye->imgWidth*downsample_ratio);
+    rois.resize(4);
+    roi_manual.resize(4, false);
+    roi_visible.resize(4, true);
+    sub_rois.push_back(nh.subscribe<sensor_msgs::RegionOfInterest>("depth_roi_left", 1, 
+        boost::bind(&DepthCamManager::roi_callback, this, _1, 0)));
+    sub_rois.push_back(nh.subscribe<sensor_msgs::RegionOfInterest>("depth_roi_front", 1, 
+        boost::bind(&DepthCamManager::roi_callback, this, _1, 1)));
+    sub_rois.push_back(nh.subscribe<sensor_msgs::RegionOfInterest>("depth_roi_right", 1, 
+        boost::bind(&DepthCamManager::roi_callback, this, _1, 2)));
+    sub_rois.push_back(nh.subscribe<sensor_msgs::RegionOfInterest>("depth_roi_rear", 1, 
+        boost::bind(&DepthCamManager::roi_callback, this, _1, 3)));
+
     depth_cam = camodocal::PinholeCameraPtr(new camodocal::PinholeCamera("depth",
                   fisheye->imgWidth*downsample_ratio, fisheye->sideImgHeight*downsample_ratio,0, 0, 0, 0,
                   f_side*downsample_ratio, f_side*downsample_ratio, cx_side*downsample_ratio, cy_side*downsample_ratio));
@@ -124,6 +207,14 @@ DepthCamManager::DepthCamManager(ros::NodeHandle & _nh, FisheyeUndist * _fisheye
     depth_maps.resize(4);
     pts_3ds.resize(4);
     texture_imgs.resize(4);
+
+    disps.resize(4);
+    fused_disps.resize(4);
+    fused_confs.resize(4);
+    fused_pts_3ds.resize(4);
+    fused_Rs.resize(4);
+    fused_Ps.resize(4);
+    fusion_count.resize(4, 0);
 }
 
 
@@ -170,12 +261,17 @@ DepthEstimator * DepthCamManager::create_depth_estimator(int direction, Eigen::M
 
         _output_path = OUTPUT_FOLDER + "/rear_dep.yaml";
     }
+    SGMParams params = sgm_params;
+    if (direction < (int) coarse_levels.size()) {
+        params.coarse_levels = coarse_levels[direction];
+    }
+
     if (dep_RT_config[direction] != "") {
         //Build stereo with estimate extrinsic
-        deps[direction] = new DepthEstimator(sgm_params, configPath + "/" + dep_RT_config[direction], cam_side_cv_transpose, show_disparity,
+        deps[direction] = new DepthEstimator(params, configPath + "/" + dep_RT_config[direction], cam_side_cv_transpose, show_disparity,
             enable_extrinsic_calib_for_depth, _output_path);
     } else {
-        deps[direction] = new DepthEstimator(sgm_params, t01, r01, cam_side_cv_transpose, show_disparity,
+        deps[direction] = new DepthEstimator(params, t01, r01, cam_side_cv_transpose, show_disparity,
             enable_extrinsic_calib_for_depth, _output_path);
     }
     return deps[direction];
@@ -185,11 +281,19 @@ void DepthCamManager::update_pcl_depth_from_image(ros::Time stamp, int direction
         Eigen::Matrix3d R, Eigen::Vector3d P, Eigen::Matrix3d ric_depth, sensor_msgs::PointCloud & pcl) {
     auto & texture_img = texture_imgs[direction];
 
+    if (enable_temporal_fusion) {
+        fuse_depth(direction, R*ric1, P+R*tic1);
+    }
+
     if (pub_cloud_step > 0 && pub_cloud_all) { 
         add_pts_point_cloud(pts_3ds[direction], R*ric1, P+R*tic1, stamp, pcl, pub_cloud_step, texture_img);
     }
 
-    if(pub_depth_map) {
+    if (enable_voxel_map) {
+        add_pts_voxel_map(pts_3ds[direction], R*ric1, P+R*tic1, stamp, pub_cloud_step);
+    }
+
+    if(pub_depth_map && !depth_maps[direction].empty()) {
         cv::Mat depthmap = depth_maps[direction];
         sensor_msgs::ImagePtr depth_img_msg = cv_bridge::CvImage(std_msgs::Header(), "32FC1", depthmap).toImageMsg();
         depth_img_msg->header.stamp = stamp;
@@ -215,6 +319,11 @@ void DepthCamManager::update_pcl_depth_from_image(ros::Time stamp, int direction
 void DepthCamManager::update_depth_image(int direction, cv::cuda::GpuMat _up_front, cv::cuda::GpuMat _down_front, 
     Eigen::Matrix3d ric1, Eigen::Matrix3d ric_depth) {
 #ifdef USE_CUDA
+    if (!apply_roi(direction)) {
+        clear_depth_image(direction);
+        return;
+    }
+
     cv::cuda::GpuMat  up_front, down_front;
     TicToc tic_resize;
     cv::cuda::resize(_up_front, up_front, cv::Size(), downsample_ratio, downsample_ratio);
@@ -251,7 +360,8 @@ void DepthCamManager::update_depth_image(int direction, cv::cuda::GpuMat _up_fro
     auto dep_est = deps[direction];
     // ROS_WARN("Dep est %d from %d", dep_est, direction);
     
-    cv::Mat pointcloud_up = dep_est->ComputeDepthCloud<cv::cuda::GpuMat>(up_front, down_front);
+    cv::Mat disparity = dep_est->ComputeDisparity32F<cv::cuda::GpuMat>(up_front, down_front);
+    cv::Mat pointcloud_up = dep_est->DisparityToCloud(disparity, dep_est->get_roi());
 
     if(ENABLE_PERF_OUTPUT) {
         ROS_INFO("Up to ComputeDepthCloud cost %f", tic_resize.toc());
@@ -283,7 +393,10 @@ void DepthCamManager::update_depth_image(int direction, cv::cuda::GpuMat _up_fro
     if (pub_cloud_all && RGB_DEPTH_CLOUD == 0) {
         cv::cuda::GpuMat texture;
         dep_est->remap_texture(up_front, texture);
-        texture.download(texture_imgs[direction]);
+        //Download to a new buffer, the last one may still be held by depth_frame_buf
+        cv::Mat texture_cpu;
+        texture.download(texture_cpu);
+        texture_imgs[direction] = texture_cpu;
     }
 
 
@@ -293,12 +406,18 @@ void DepthCamManager::update_depth_image(int direction, cv::cuda::GpuMat _up_fro
    
     depth_maps[direction] = depthmap;
     pts_3ds[direction] = pointcloud_up;
+    disps[direction] = disparity;
 
 #endif
 }
 
 void DepthCamManager::update_depth_image(int direction, cv::Mat _up_front, cv::Mat _down_front, 
     Eigen::Matrix3d ric1, Eigen::Matrix3d ric_depth) {
+    if (!apply_roi(direction)) {
+        clear_depth_image(direction);
+        return;
+    }
+
     cv::Mat up_front, down_front;
 
     TicToc tic_resize;
@@ -336,7 +455,8 @@ void DepthCamManager::update_depth_image(int direction, cv::Mat _up_front, cv::M
     auto dep_est = deps[direction];
     // ROS_WARN("Dep est %d from %d", dep_est, direction);
     
-    cv::Mat pointcloud_up = dep_est->ComputeDepthCloud<cv::Mat>(up_front, down_front);
+    cv::Mat disparity = dep_est->ComputeDisparity32F<cv::Mat>(up_front, down_front);
+    cv::Mat pointcloud_up = dep_est->DisparityToCloud(disparity, dep_est->get_roi());
 
     if(ENABLE_PERF_OUTPUT) {
         ROS_INFO("Up to ComputeDepthCloud cost %f", tic_resize.toc());
@@ -376,6 +496,7 @@ void DepthCamManager::update_depth_image(int direction, cv::Mat _up_front, cv::M
    
     depth_maps[direction] = depthmap;
     pts_3ds[direction] = pointcloud_up;
+    disps[direction] = disparity;
 
 }
 
@@ -417,6 +538,93 @@ void DepthCamManager::pub_depths_from_buf(ros::Time stamp, Eigen::Matrix3d ric1,
     if (pub_cloud_all) {
         pub_depth_cloud.publish(point_cloud);
     }
+
+    if (enable_voxel_map) {
+        publish_voxel_map(stamp);
+    }
+}
+
+void DepthCamManager::save_depth_frame(double stamp) {
+    DepthFrame frame;
+    frame.stamp = stamp;
+    frame.depth_maps = depth_maps;
+    frame.pts_3ds = pts_3ds;
+    frame.texture_imgs = texture_imgs;
+    frame.disps = disps;
+    depth_frame_buf.push_back(frame);
+}
+
+void DepthCamManager::pub_depth_frame(Eigen::Matrix3d ric1, Eigen::Vector3d tic1, 
+        Eigen::Matrix3d R, Eigen::Vector3d P) {
+    auto & frame = depth_frame_buf.front();
+    depth_maps = frame.depth_maps;
+    pts_3ds = frame.pts_3ds;
+    texture_imgs = frame.texture_imgs;
+    disps = frame.disps;
+    pub_depths_from_buf(ros::Time(frame.stamp), ric1, tic1, R, P);
+    depth_frame_buf.pop_front();
+}
+
+void DepthCamManager::add_pts_voxel_map(const cv::Mat & pts3d, Eigen::Matrix3d R, Eigen::Vector3d P, ros::Time stamp, int step) {
+    TicToc tic;
+    std::vector<Vector3d> pts;
+    pts.reserve(pts3d.rows * pts3d.cols / (step*step));
+    for(int v = 0; v < pts3d.rows; v += step){
+        for(int u = 0; u < pts3d.cols; u += step) {
+            cv::Vec3f vec = pts3d.at<cv::Vec3f>(v, u);
+            Vector3d pts_i(vec[0], vec[1], vec[2]);
+            if (pts_i.norm() < depth_cloud_radius && pts_i.z() > min_z) {
+                pts.push_back(R * pts_i + P);
+            }
+        }
+    }
+
+    voxel_map->insert(pts, stamp.toSec());
+
+    if (ENABLE_PERF_OUTPUT) {
+        double dt = tic.toc();
+        ROS_INFO("Voxel map insert %ld pts cost %fms, %3.2fM pts/s; voxels %ld", 
+            pts.size(), dt, pts.size() / dt / 1000, voxel_map->size());
+    }
+}
+
+void DepthCamManager::voxel_snapshot_callback(const std_msgs::Empty & msg) {
+    voxel_snapshot_requested = true;
+}
+
+void DepthCamManager::publish_voxel_map(ros::Time stamp) {
+    voxel_map->age_out(stamp.toSec());
+
+    std::vector<Eigen::Vector3f> added, removed;
+    voxel_map->pop_changed(added, removed);
+
+    auto to_pcl = [stamp](const std::vector<Eigen::Vector3f> & pts) {
+        sensor_msgs::PointCloud pcl;
+        pcl.header.stamp = stamp;
+        pcl.header.frame_id = "world";
+        pcl.points.resize(pts.size());
+        for (size_t i = 0; i < pts.size(); i ++) {
+            pcl.points[i].x = pts[i].x();
+            pcl.points[i].y = pts[i].y();
+            pcl.points[i].z = pts[i].z();
+        }
+        return pcl;
+    };
+
+    if (added.size() > 0) {
+        pub_voxel_added.publish(to_pcl(added));
+    }
+
+    if (removed.size() > 0) {
+        pub_voxel_removed.publish(to_pcl(removed));
+    }
+
+    if (voxel_snapshot_requested) {
+        std::vector<Eigen::Vector3f> pts;
+        voxel_map->snapshot(pts);
+        pub_voxel_snapshot.publish(to_pcl(pts));
+        voxel_snapshot_requested = false;
+    }
 }
 
 void DepthCamManager::add_pts_point_cloud(const cv::Mat & pts3d, Eigen::Matrix3d R, Eigen::Vector3d P, ros::Time stamp,
@@ -512,21 +720,135 @@ void DepthCamManager::publish_world_point_cloud(const cv::Mat & pts3d, Eigen::Ma
 }
 
 
+void DepthCamManager::fuse_depth(int direction, Eigen::Matrix3d R, Eigen::Vector3d P) {
+    //R, P is the pose of rectified depth camera in world frame
+    TicToc tic;
+    auto dep_est = deps[direction];
+    const cv::Mat & disp = disps[direction];
+    cv::Mat & fused = fused_disps[direction];
+    cv::Mat & conf = fused_confs[direction];
+    if (disp.empty()) {
+        return;
+    }
+
+    //Warp last fused depth to current view, keep the nearest one when multiple pixel hits
+    cv::Mat warped = cv::Mat::zeros(disp.size(), CV_32F);
+    cv::Mat warped_conf = cv::Mat::zeros(disp.size(), CV_32F);
+    if (!fused.empty() && fused.size() == disp.size()) {
+        Matrix3d R_rel = R.transpose() * fused_Rs[direction];
+        Vector3d P_rel = R.transpose() * (fused_Ps[direction] - P);
+        const cv::Mat & pts_last = fused_pts_3ds[direction];
+        for (int v = 0; v < pts_last.rows; v ++) {
+            for (int u = 0; u < pts_last.cols; u ++) {
+                float c = conf.at<float>(v, u) * fusion_decay;
+                if (c <= 0 || fused.at<float>(v, u) <= 0) {
+                    continue;
+                }
+                cv::Vec3f vec = pts_last.at<cv::Vec3f>(v, u);
+                Vector3d pts_i = R_rel * Vector3d(vec[0], vec[1], vec[2]) + P_rel;
+                float _u, _v, _d;
+                if (!dep_est->project_to_disparity(pts_i, _u, _v, _d)) {
+                    continue;
+                }
+                int iu = std::round(_u);
+                int iv = std::round(_v);
+                if (iu < 0 || iv < 0 || iu >= warped.cols || iv >= warped.rows) {
+                    continue;
+                }
+                if (_d > warped.at<float>(iv, iu)) {
+                    warped.at<float>(iv, iu) = _d;
+                    warped_conf.at<float>(iv, iu) = c;
+                }
+            }
+        }
+    }
+
+    //Confidence weighted fusion; disagreeing prior is replaced by new measurement, unobserved prior decays
+    cv::Mat new_fused = cv::Mat::zeros(disp.size(), CV_32F);
+    cv::Mat new_conf = cv::Mat::zeros(disp.size(), CV_32F);
+    cv::Mat output = cv::Mat::zeros(disp.size(), CV_32F);
+    for (int v = 0; v < disp.rows; v ++) {
+        for (int u = 0; u < disp.cols; u ++) {
+            float d = disp.at<float>(v, u);
+            float dw = warped.at<float>(v, u);
+            float cw = warped_conf.at<float>(v, u);
+            float & df = new_fused.at<float>(v, u);
+            float & cf = new_conf.at<float>(v, u);
+            if (d > 0 && dw > 0 && fabs(d - dw) < fusion_max_disp_diff) {
+                df = (cw * dw + d) / (cw + 1);
+                cf = std::min(cw + 1, (float)fusion_max_conf);
+            } else if (d > 0) {
+                df = d;
+                cf = 1;
+            } else if (dw > 0) {
+                df = dw;
+                cf = cw;
+            }
+
+            if (cf >= fusion_min_conf) {
+                output.at<float>(v, u) = df;
+            }
+        }
+    }
+
+    fused = new_fused;
+    conf = new_conf;
+    //Fused prior outlives the ROI of current disparity, reproject it over the full image;
+    //output is the confident part of it
+    fused_pts_3ds[direction] = dep_est->DisparityToCloud(new_fused);
+    fused_Rs[direction] = R;
+    fused_Ps[direction] = P;
+
+    cv::Mat pts_output = cv::Mat::zeros(disp.size(), CV_32FC3);
+    fused_pts_3ds[direction].copyTo(pts_output, output > 0);
+    pts_3ds[direction] = pts_output;
+    if (pub_depth_map && !pcl2depth_map[direction].empty()) {
+        depth_maps[direction] = generate_depthmap(pts_3ds[direction], pcl2depth_map[direction]);
+    }
+
+    //Narrow the disparity search of next frame to the fused range, with a full search every few frames
+    if (fusion_search_margin > 0) {
+        double min_d = 0, max_d = 0;
+        cv::minMaxLoc(new_fused, &min_d, &max_d, nullptr, nullptr, new_fused > 0);
+        int max_search = sgm_params.min_disparity + sgm_params.num_disp;
+        if (++fusion_count[direction] % fusion_full_search_interval == 0 || max_d <= 0) {
+            dep_est->set_disparity_range(0, 0);
+        } else {
+            int min_disp = std::max(sgm_params.min_disparity, (int)floor(min_d) - fusion_search_margin);
+            int max_disp = std::min(max_search, (int)ceil(max_d) + fusion_search_margin);
+            //SGBM requires number of disparities divisible by 16
+            int num_disp = ((max_disp - min_disp + 15) / 16) * 16;
+            if (min_disp + num_disp > max_search) {
+                min_disp = std::max(sgm_params.min_disparity, max_search - num_disp);
+            }
+            dep_est->set_disparity_range(min_disp, num_disp);
+        }
+    }
+
+    if (ENABLE_PERF_OUTPUT) {
+        ROS_INFO("Depth fusion of direction %d cost %fms", direction, tic.toc());
+    }
+}
+
 cv::Mat DepthCamManager::build_pcl2depth_map(const cv::Mat & pts3d, Eigen::Matrix3d rel_ric_depth) const {
     cv::Mat pcl2depth_map(depth_cam->imageHeight(), depth_cam->imageWidth(), CV_32FC2);
     pcl2depth_map.setTo(0);
     Eigen::Matrix3d cam_mat;
+    Eigen::Matrix3Xd row_pts(3, pts3d.cols);
+    Eigen::Matrix2Xd row_uv(2, pts3d.cols);
     for(int v = 0; v < pts3d.rows; v += 1) {
         for(int u = 0; u < pts3d.cols; u += 1)  
         {
             cv::Vec3f vec = pts3d.at<cv::Vec3f>(v, u);
-            Eigen::Vector3d vec3d(vec[0], vec[1], vec[2]);
-            vec3d = rel_ric_depth.transpose()*vec3d;
-            Eigen::Vector2d p_sphere(0, 0);
-            depth_cam->spaceToPlane(vec3d, p_sphere);
+            row_pts.col(u) = rel_ric_depth.transpose()*Eigen::Vector3d(vec[0], vec[1], vec[2]);
+        }
+        depth_cam->spaceToPlaneBatch(row_pts.data(), row_uv.data(), pts3d.cols);
+
+        for(int u = 0; u < pts3d.cols; u += 1)  
+        {
             //Than here is the undist points
-            int px = p_sphere.x();
-            int py = p_sphere.y();
+            int px = row_uv(0, u);
+            int py = row_uv(1, u);
             if (py < depth_cam->imageHeight() && px < depth_cam->imageWidth() && px > 0 && py > 0) {
                 pcl2depth_map.at<cv::Vec2f>(py, px) = cv::Vec2f(v, u);
             }
@@ -541,3 +863,104 @@ cv::Mat DepthCamManager::generate_depthmap(const cv::Mat & pts3d, const cv::Mat
     cv::remap(pts3d, depthmap, pcl2depth_map, cv::Mat(), cv::INTER_LINEAR);
     return depthmap;
 }
+
+void DepthCamManager::roi_callback(const sensor_msgs::RegionOfInterestConstPtr & msg, int direction) {
+    std::lock_guard<std::mutex> lock(roi_lock);
+    cv::Rect roi(msg->x_offset, msg->y_offset, msg->width, msg->height);
+    roi &= cv::Rect(cv::Point(0, 0), depth_img_size);
+    if (roi.area() == 0) {
+        //Empty ROI gives the direction back to roi_mode
+        roi_manual[direction] = false;
+        rois[direction] = cv::Rect();
+        roi_visible[direction] = true;
+        ROS_INFO("Depth ROI of direction %d reset", direction);
+        return;
+    }
+    roi_manual[direction] = true;
+    rois[direction] = roi;
+    roi_visible[direction] = true;
+    ROS_INFO("Depth ROI of direction %d set to %d %d %d %d", direction, roi.x, roi.y, roi.width, roi.height);
+}
+
+void DepthCamManager::update_velocity_roi(Eigen::Matrix3d ric1, Eigen::Matrix3d R, Eigen::Vector3d V) {
+    if (roi_mode != 1) {
+        return;
+    }
+
+    Vector3d vel_b = R.transpose() * V;
+    bool slow = vel_b.norm() < roi_min_speed;
+    double yaw0 = atan2(vel_b.y(), vel_b.x());
+    double pitch0 = atan2(vel_b.z(), vel_b.head<2>().norm());
+    double yaw_half = roi_yaw_half_angle * M_PI / 180;
+    double pitch_half = roi_pitch_half_angle * M_PI / 180;
+
+    //Sample the rays in the sector around velocity and take bounding box of their projections
+    std::vector<Vector3d> rays;
+    for (int i = 0; i <= VEL_ROI_SAMPLES; i ++) {
+        double yaw = yaw0 - yaw_half + 2 * yaw_half * i / VEL_ROI_SAMPLES;
+        for (int j = 0; j <= VEL_ROI_SAMPLES; j ++) {
+            double pitch = pitch0 - pitch_half + 2 * pitch_half * j / VEL_ROI_SAMPLES;
+            rays.emplace_back(cos(pitch) * cos(yaw), cos(pitch) * sin(yaw), sin(pitch));
+        }
+    }
+
+    std::vector<Eigen::Quaterniond> t_dirs{t_left, t_front, t_right, t_rear};
+    cv::Rect full(cv::Point(0, 0), depth_img_size);
+    std::lock_guard<std::mutex> lock(roi_lock);
+    for (int direction = 0; direction < 4; direction ++) {
+        if (roi_manual[direction]) {
+            continue;
+        }
+        if (slow) {
+            rois[direction] = cv::Rect();
+            roi_visible[direction] = true;
+            continue;
+        }
+        Matrix3d R_cam = (ric1 * t_dirs[direction] * t_rotate).toRotationMatrix();
+        int u_min = depth_img_size.width, v_min = depth_img_size.height, u_max = -1, v_max = -1;
+        for (auto & ray : rays) {
+            Vector3d pt = R_cam.transpose() * ray;
+            if (pt.z() < 1e-3) {
+                continue;
+            }
+            Vector3d uv = cam_side_transpose * pt / pt.z();
+            if (uv.x() < 0 || uv.y() < 0 || uv.x() >= depth_img_size.width || uv.y() >= depth_img_size.height) {
+                continue;
+            }
+            u_min = std::min(u_min, (int) uv.x());
+            v_min = std::min(v_min, (int) uv.y());
+            u_max = std::max(u_max, (int) uv.x());
+            v_max = std::max(v_max, (int) uv.y());
+        }
+
+        if (u_max < 0) {
+            rois[direction] = cv::Rect();
+            roi_visible[direction] = false;
+            continue;
+        }
+
+        //Align ROI so the matcher is not reallocated on small changes
+        u_min = u_min / VEL_ROI_ALIGN * VEL_ROI_ALIGN;
+        v_min = v_min / VEL_ROI_ALIGN * VEL_ROI_ALIGN;
+        u_max = (u_max / VEL_ROI_ALIGN + 1) * VEL_ROI_ALIGN;
+        v_max = (v_max / VEL_ROI_ALIGN + 1) * VEL_ROI_ALIGN;
+        rois[direction] = cv::Rect(u_min, v_min, u_max - u_min, v_max - v_min) & full;
+        roi_visible[direction] = true;
+    }
+}
+
+bool DepthCamManager::apply_roi(int direction) {
+    std::lock_guard<std::mutex> lock(roi_lock);
+    if (!roi_visible[direction]) {
+        return false;
+    }
+    deps[direction]->set_roi(rois[direction]);
+    return true;
+}
+
+void DepthCamManager::clear_depth_image(int direction) {
+    depth_maps[direction] = cv::Mat();
+    pts_3ds[direction] = cv::Mat();
+    texture_imgs[direction] = cv::Mat();
+    disps[direction] = cv::Mat();
+}
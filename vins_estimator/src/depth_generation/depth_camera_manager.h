@@ -8,17 +8,34 @@
 #include <tf/transform_broadcaster.h>
 #include "depth_estimator.h"
 #include "color_disparity_graph.hpp"
+#include "voxel_map.hpp"
+#include <std_msgs/Empty.h>
+#include <sensor_msgs/RegionOfInterest.h>
+#include <atomic>
+#include <mutex>
+#include <deque>
 #include <camodocal/camera_models/CameraFactory.h>
 #include <camodocal/camera_models/PinholeCamera.h>
 
 class FisheyeUndist;
 
+//Depth result of all directions waiting for pose
+struct DepthFrame {
+    double stamp = 0;
+    std::vector<cv::Mat> depth_maps;
+    std::vector<cv::Mat> pts_3ds;
+    std::vector<cv::Mat> texture_imgs;
+    std::vector<cv::Mat> disps;
+};
+
 class DepthCamManager {
     std::vector<ros::Publisher> pub_depth_clouds;
     std::vector<ros::Publisher> pub_depth_maps;
     std::vector<ros::Publisher> pub_depthcam_poses;
 
     ros::Publisher pub_depth_cloud;
+    ros::Publisher pub_voxel_added, pub_voxel_removed, pub_voxel_snapshot;
+    ros::Subscriber sub_voxel_snapshot;
     ros::Publisher up_cam_info_pub, down_cam_info_pub;
     ros::Publisher pub_camera_up, pub_camera_down;
     ros::NodeHandle nh;
@@ -34,6 +51,8 @@ class DepthCamManager {
     bool pub_depth_map = false;
     
     SGMParams sgm_params;
+    //Coarse to fine pyramid levels of left, front, right, rear
+    std::vector<int> coarse_levels;
     
     double downsample_ratio = 1.0;
     Eigen::Matrix3d cam_side;
@@ -48,6 +67,46 @@ class DepthCamManager {
     std::vector<cv::Mat> texture_imgs;
     std::vector<cv::Mat> pcl2depth_map;
 
+    std::deque<DepthFrame> depth_frame_buf;
+
+    //Temporal fusion of disparity across frames
+    bool enable_temporal_fusion = false;
+    double fusion_max_disp_diff = 1.0;
+    double fusion_decay = 0.8;
+    double fusion_min_conf = 1.0;
+    double fusion_max_conf = 5.0;
+    int fusion_search_margin = 0;
+    int fusion_full_search_interval = 10;
+    std::vector<cv::Mat> disps;
+    std::vector<cv::Mat> fused_disps;
+    std::vector<cv::Mat> fused_confs;
+    std::vector<cv::Mat> fused_pts_3ds;
+    std::vector<Eigen::Matrix3d> fused_Rs;
+    std::vector<Eigen::Vector3d> fused_Ps;
+    std::vector<int> fusion_count;
+
+    //Voxel map of depth cloud, only changed voxels are published
+    bool enable_voxel_map = false;
+    double voxel_resolution = 0.1;
+    int voxel_max_num = 1000000;
+    double voxel_max_age = 10.0;
+    int voxel_min_hits = 2;
+    VoxelMap * voxel_map = nullptr;
+    std::atomic<bool> voxel_snapshot_requested;
+
+    //Region of interest of left, front, right, rear in rotated depth image
+    //roi_mode 0 full image, 1 follows velocity; ROI from depth_roi_* topics overrides both
+    int roi_mode = 0;
+    double roi_yaw_half_angle = 45;
+    double roi_pitch_half_angle = 20;
+    double roi_min_speed = 0.5;
+    std::vector<cv::Rect> rois;
+    std::vector<bool> roi_manual;
+    std::vector<bool> roi_visible;
+    std::vector<ros::Subscriber> sub_rois;
+    cv::Size depth_img_size;
+    std::mutex roi_lock;
+
     int show_disparity = 0;
     int enable_extrinsic_calib_for_depth = 0;
     double depth_cloud_radius = 5;
@@ -79,6 +138,24 @@ public:
     void pub_depths_from_buf(ros::Time stamp, Eigen::Matrix3d ric1, Eigen::Vector3d tic1, 
         Eigen::Matrix3d R, Eigen::Vector3d P);
 
+    //Hold depth of current images until their pose is available
+    void save_depth_frame(double stamp);
+
+    int depth_frame_num() const {
+        return depth_frame_buf.size();
+    }
+
+    double depth_frame_stamp() const {
+        return depth_frame_buf.front().stamp;
+    }
+
+    void pub_depth_frame(Eigen::Matrix3d ric1, Eigen::Vector3d tic1, 
+        Eigen::Matrix3d R, Eigen::Vector3d P);
+
+    void drop_depth_frame() {
+        depth_frame_buf.pop_front();
+    }
+
     DepthEstimator * create_depth_estimator(int direction, Eigen::Matrix3d r01, Eigen::Vector3d t01);
     
     void publish_world_point_cloud(const cv::Mat &pts3d, Eigen::Matrix3d R, Eigen::Vector3d P, ros::Time stamp,
@@ -87,6 +164,24 @@ public:
     void add_pts_point_cloud(const cv::Mat & pts3d, Eigen::Matrix3d R, Eigen::Vector3d P, ros::Time stamp,
         sensor_msgs::PointCloud & pcl, int step = 3, cv::Mat color = cv::Mat());
 
+    void fuse_depth(int direction, Eigen::Matrix3d R, Eigen::Vector3d P);
+
+    void add_pts_voxel_map(const cv::Mat & pts3d, Eigen::Matrix3d R, Eigen::Vector3d P, ros::Time stamp, int step = 3);
+
+    void publish_voxel_map(ros::Time stamp);
+
+    void voxel_snapshot_callback(const std_msgs::Empty & msg);
+
+    void roi_callback(const sensor_msgs::RegionOfInterestConstPtr & msg, int direction);
+
+    //Velocity ROI, R, V is the latest IMU pose and velocity in world frame
+    void update_velocity_roi(Eigen::Matrix3d ric1, Eigen::Matrix3d R, Eigen::Vector3d V);
+
+    //Return false when this direction is outside ROI
+    bool apply_roi(int direction);
+
+    void clear_depth_image(int direction);
+
     cv::Mat generate_depthmap(const cv::Mat & pts3d, const cv::Mat & pcl2depth_map) const;
     cv::Mat build_pcl2depth_map(const cv::Mat & pts3d, Eigen::Matrix3d rel_ric_depth) const;
     template<typename cvMat>
@@ -141,6 +236,9 @@ public:
             pub_depth_cloud.publish(point_cloud);
         }
 
+        if (enable_voxel_map) {
+            publish_voxel_map(stamp);
+        }
     }
 
 
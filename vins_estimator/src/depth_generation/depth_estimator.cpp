@@ -92,8 +92,11 @@ cv::Mat DepthEstimator::ComputeDispartiyMap(cv::cuda::GpuMat & left, cv::cuda::G
 
     cv::cuda::GpuMat leftRectify, rightRectify;
     TicToc remap;
-    cv::cuda::remap(left, leftRectify, map11, map12, cv::INTER_LINEAR);
-    cv::cuda::remap(right, rightRectify, map21, map22, cv::INTER_LINEAR);
+    //Visionworks images are created with fixed size, so ROI is only for libSGM
+    cv::Rect match_rect = params.use_vworks ? cv::Rect(0, 0, left.cols, left.rows) : 
+        roi_match_rect(left.size(), params.min_disparity + params.num_disp);
+    cv::cuda::remap(left, leftRectify, map11(match_rect), map12(match_rect), cv::INTER_LINEAR);
+    cv::cuda::remap(right, rightRectify, map21(match_rect), map22(match_rect), cv::INTER_LINEAR);
 
     cv::cuda::normalize(leftRectify, leftRectify, 0, 255, cv::NORM_MINMAX, CV_8UC1);
     cv::cuda::normalize(rightRectify, rightRectify, 0, 255, cv::NORM_MINMAX, CV_8UC1);
@@ -137,7 +140,7 @@ cv::Mat DepthEstimator::ComputeDispartiyMap(cv::cuda::GpuMat & left, cv::cuda::G
             
         ROS_INFO("SGBM time cost %fms", tic.toc());
 
-        return disparity;
+        return roi_disparity(disparity, left.size(), match_rect, sgmp->getInvalidDisparity());
 
     } else {
 #ifdef WITH_VWORKS
@@ -265,17 +268,36 @@ cv::Mat DepthEstimator::ComputeDispartiyMap(cv::Mat & left, cv::Mat & right) {
     } 
 
 
-    cv::Mat leftRectify, rightRectify, disparity(left.size(), CV_8U);
-    cv::remap(left, leftRectify, _map11, _map12, cv::INTER_LINEAR);
-    cv::remap(right, rightRectify, _map21, _map22, cv::INTER_LINEAR);
-
-    auto sgbm = cv::StereoSGBM::create(params.min_disparity, params.num_disp, params.block_size,
-        params.p1, params.p2, params.disp12Maxdiff, params.prefilterCap, params.uniquenessRatio, params.speckleWindowSize, 
-        params.speckleRange, params.mode);
+    int min_disp = params.min_disparity;
+    int num_disp = params.num_disp;
+    if (prior_num_disp > 0) {
+        min_disp = prior_min_disp;
+        num_disp = prior_num_disp;
+    }
+    last_min_disp = min_disp;
+
+    cv::Rect match_rect = roi_match_rect(left.size(), min_disp + num_disp);
+    cv::Mat leftRectify, rightRectify, disparity(match_rect.size(), CV_8U);
+    cv::remap(left, leftRectify, _map11(match_rect), _map12(match_rect), cv::INTER_LINEAR);
+    cv::remap(right, rightRectify, _map21(match_rect), _map22(match_rect), cv::INTER_LINEAR);
+
+    if (params.coarse_levels > 0) {
+        TicToc tic_c2f;
+        disparity = ComputeDisparityCoarseToFine(leftRectify, rightRectify, min_disp, num_disp);
+        double t_c2f = tic_c2f.toc();
+        ROS_INFO("CPU coarse to fine SGBM levels %d time cost %fms", params.coarse_levels, t_c2f);
+        if (params.coarse_eval) {
+            evaluate_coarse_to_fine(leftRectify, rightRectify, disparity, t_c2f, min_disp, num_disp);
+        }
+    } else {
+        auto sgbm = cv::StereoSGBM::create(min_disp, num_disp, params.block_size,
+            params.p1, params.p2, params.disp12Maxdiff, params.prefilterCap, params.uniquenessRatio, params.speckleWindowSize, 
+            params.speckleRange, params.mode);
 
-    // sgbm->compute(right_rect, left_rect, disparity);
-    sgbm->compute(leftRectify, rightRectify, disparity);
-    ROS_INFO("CPU SGBM time cost %fms", tic.toc());
+        // sgbm->compute(right_rect, left_rect, disparity);
+        sgbm->compute(leftRectify, rightRectify, disparity);
+        ROS_INFO("CPU SGBM time cost %fms", tic.toc());
+    }
     if (show) {
         cv::Mat disparity_color, disp;
         disparity.convertTo(disp, CV_8U, 255. / params.num_disp/16);
@@ -290,8 +312,158 @@ cv::Mat DepthEstimator::ComputeDispartiyMap(cv::Mat & left, cv::Mat & right) {
         cv::imshow("RAW DISP", _show);
         cv::waitKey(2);
     }
+    return roi_disparity(disparity, left.size(), match_rect, (min_disp - 1) * 16);
+}
+
+cv::Rect DepthEstimator::roi_match_rect(cv::Size size, int max_disp) const {
+    cv::Rect full(0, 0, size.width, size.height);
+    cv::Rect _roi = roi & full;
+    if (_roi.area() == 0) {
+        return full;
+    }
+    //Pixels in ROI match pixels up to max_disp left in right image
+    int x0 = std::max(_roi.x - max_disp, 0);
+    return cv::Rect(x0, _roi.y, _roi.x + _roi.width - x0, _roi.height);
+}
+
+cv::Mat DepthEstimator::roi_disparity(const cv::Mat & disparity, cv::Size size, cv::Rect match_rect, int invalid) const {
+    if (match_rect.size() == size) {
+        return disparity;
+    }
+    cv::Rect _roi = roi & cv::Rect(0, 0, size.width, size.height);
+    cv::Mat disparity_full(size, disparity.type(), cv::Scalar(invalid));
+    disparity(_roi - match_rect.tl()).copyTo(disparity_full(_roi));
+    return disparity_full;
+}
+
+cv::Mat DepthEstimator::ComputeDisparityCoarseToFine(const cv::Mat & left, const cv::Mat & right, int min_disp, int num_disp) {
+    //Full SGBM on the coarsest level of pyramid
+    int scale = 1 << params.coarse_levels;
+    cv::Mat left_c = left, right_c = right;
+    for (int i = 0; i < params.coarse_levels; i++) {
+        cv::pyrDown(left_c, left_c);
+        cv::pyrDown(right_c, right_c);
+    }
+
+    int min_disp_c = min_disp / scale;
+    int num_disp_c = std::max(16, ((num_disp / scale + 15) / 16) * 16);
+    int block_c = std::max(3, (params.block_size / scale) | 1);
+    auto sgbm = cv::StereoSGBM::create(min_disp_c, num_disp_c, block_c,
+        params.p1, params.p2, params.disp12Maxdiff, params.prefilterCap, params.uniquenessRatio, params.speckleWindowSize / (scale*scale), 
+        params.speckleRange, params.mode);
+    cv::Mat disp_c;
+    sgbm->compute(left_c, right_c, disp_c);
+
+    cv::Mat disp_c32, disp_up, valid_up;
+    disp_c.convertTo(disp_c32, CV_32F, scale / 16.0);
+    cv::resize(disp_c32, disp_up, left.size(), 0, 0, cv::INTER_NEAREST);
+    cv::resize(disp_c >= min_disp_c * 16, valid_up, left.size(), 0, 0, cv::INTER_NEAREST);
+
+    //Refine in a small band around upsampled disparity with SAD block matching on full resolution
+    int band = std::max(params.coarse_band, 1);
+    int block = params.block_size | 1;
+    cv::Mat left_f, right_f;
+    left.convertTo(left_f, CV_32F);
+    right.convertTo(right_f, CV_32F);
+
+    cv::Mat base_x(left.size(), CV_32F), map_y(left.size(), CV_32F);
+    for (int v = 0; v < left.rows; v ++) {
+        for (int u = 0; u < left.cols; u ++) {
+            base_x.at<float>(v, u) = u - cvRound(disp_up.at<float>(v, u));
+            map_y.at<float>(v, u) = v;
+        }
+    }
+
+    std::vector<cv::Mat> costs(2*band + 1);
+    cv::Mat map_x, warped, diff;
+    for (int k = 0; k < 2*band + 1; k ++) {
+        int o = k - band;
+        map_x = base_x - o;
+        cv::remap(right_f, warped, map_x, map_y, cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(-1));
+        cv::absdiff(left_f, warped, diff);
+        //Pixels out of right image never win
+        diff.setTo(255, warped < 0);
+        cv::boxFilter(diff, costs[k], -1, cv::Size(block, block));
+    }
+
+    cv::Mat disparity(left.size(), CV_16S, cv::Scalar((min_disp - 1) * 16));
+    for (int v = 0; v < left.rows; v ++) {
+        for (int u = 0; u < left.cols; u ++) {
+            if (!valid_up.at<uchar>(v, u)) {
+                continue;
+            }
+            int best = 0;
+            float best_cost = costs[0].at<float>(v, u);
+            for (int k = 1; k < 2*band + 1; k ++) {
+                float c = costs[k].at<float>(v, u);
+                if (c < best_cost) {
+                    best_cost = c;
+                    best = k;
+                }
+            }
+
+            //Minimum on the band border means the true match is outside the band
+            if (best == 0 || best == 2*band) {
+                continue;
+            }
+
+            float c0 = costs[best - 1].at<float>(v, u);
+            float c2 = costs[best + 1].at<float>(v, u);
+            float denom = c0 + c2 - 2*best_cost;
+            float sub = denom > 0 ? 0.5 * (c0 - c2) / denom : 0;
+            float d = cvRound(disp_up.at<float>(v, u)) + best - band + sub;
+            if (d >= min_disp && d < min_disp + num_disp) {
+                disparity.at<short>(v, u) = cvRound(d * 16);
+            }
+        }
+    }
+
     return disparity;
 }
 
+void DepthEstimator::evaluate_coarse_to_fine(const cv::Mat & left, const cv::Mat & right, const cv::Mat & disp_c2f, double t_c2f,
+    int min_disp, int num_disp) {
+    TicToc tic;
+    cv::Mat disp_full;
+    auto sgbm = cv::StereoSGBM::create(min_disp, num_disp, params.block_size,
+        params.p1, params.p2, params.disp12Maxdiff, params.prefilterCap, params.uniquenessRatio, params.speckleWindowSize, 
+        params.speckleRange, params.mode);
+    sgbm->compute(left, right, disp_full);
+    double t_full = tic.toc();
+
+    int fill_c2f = 0, fill_full = 0;
+    std::vector<float> errs;
+    for (int v = 0; v < disp_full.rows; v ++) {
+        for (int u = 0; u < disp_full.cols; u ++) {
+            short d_c2f = disp_c2f.at<short>(v, u);
+            short d_full = disp_full.at<short>(v, u);
+            bool valid_c2f = d_c2f >= min_disp * 16;
+            bool valid_full = d_full >= min_disp * 16;
+            fill_c2f += valid_c2f;
+            fill_full += valid_full;
+            if (valid_c2f && valid_full) {
+                errs.push_back(fabs(d_c2f - d_full) / 16.0);
+            }
+        }
+    }
 
+    double median_err = 0;
+    if (errs.size() > 0) {
+        std::nth_element(errs.begin(), errs.begin() + errs.size() / 2, errs.end());
+        median_err = errs[errs.size() / 2];
+    }
 
+    double pixels = disp_full.rows * disp_full.cols;
+    c2f_eval_count ++;
+    c2f_sum_time += t_c2f;
+    c2f_sum_full_time += t_full;
+    c2f_sum_fill += fill_c2f / pixels;
+    c2f_sum_full_fill += fill_full / pixels;
+    c2f_sum_median_err += median_err;
+
+    ROS_INFO("[C2F] levels %d band %d time %4.1fms fill %3.1f%% | full search time %4.1fms fill %3.1f%% | median err %4.2fpx",
+        params.coarse_levels, params.coarse_band, t_c2f, fill_c2f*100 / pixels, t_full, fill_full*100 / pixels, median_err);
+    ROS_INFO("[C2F] AVG of %d frames: time %4.1fms fill %3.1f%% | full search time %4.1fms fill %3.1f%% | median err %4.2fpx",
+        c2f_eval_count, c2f_sum_time / c2f_eval_count, c2f_sum_fill*100 / c2f_eval_count, 
+        c2f_sum_full_time / c2f_eval_count, c2f_sum_full_fill*100 / c2f_eval_count, c2f_sum_median_err / c2f_eval_count);
+}
@@ -33,6 +33,10 @@ struct SGMParams {
     int bt_clip_value = 31;
     int scanlines_mask = 85;
     int flags = 1;
+    //Coarse to fine matching: pyramid levels of coarse SGBM (0 for disable) and refine band in pixel
+    int coarse_levels = 0;
+    int coarse_band = 2;
+    bool coarse_eval = false;
 };
 
 class DepthEstimator {
@@ -71,6 +75,26 @@ class DepthEstimator {
     std::vector<cv::Point2f> left_pts;
     std::vector<cv::Point2f> right_pts;
 
+    //Disparity search range for next matching, predicted by the temporal fusion.
+    //num <= 0 means use the range in params
+    int prior_min_disp = 0;
+    int prior_num_disp = 0;
+    int last_min_disp = 0;
+
+    int c2f_eval_count = 0;
+    double c2f_sum_time = 0, c2f_sum_full_time = 0;
+    double c2f_sum_fill = 0, c2f_sum_full_fill = 0;
+    double c2f_sum_median_err = 0;
+
+    //Region of interest in rectified left image, empty for full image
+    cv::Rect roi;
+    cv::Rect roi_match_rect(cv::Size size, int max_disp) const;
+    cv::Mat roi_disparity(const cv::Mat & disparity, cv::Size size, cv::Rect match_rect, int invalid) const;
+
+    cv::Mat ComputeDisparityCoarseToFine(const cv::Mat & left, const cv::Mat & right, int min_disp, int num_disp);
+    void evaluate_coarse_to_fine(const cv::Mat & left, const cv::Mat & right, const cv::Mat & disp_c2f, double t_c2f, 
+        int min_disp, int num_disp);
+
 public:
     DepthEstimator(SGMParams _params, Eigen::Vector3d t01, Eigen::Matrix3d R01, cv::Mat camera_mat,
     bool _show, bool _enable_extrinsic_calib, std::string _output_path);
@@ -89,8 +113,58 @@ public:
         cv::remap(img, texture, map11, map12, cv::INTER_LINEAR);
     }
 
+    void set_roi(cv::Rect _roi) {
+        roi = _roi;
+    }
+
+    cv::Rect get_roi() const {
+        return roi;
+    }
+
+    void set_disparity_range(int min_disp, int num_disp) {
+        prior_min_disp = min_disp;
+        prior_num_disp = num_disp;
+    }
+
+    //Project a point in rectified left camera to pixel and disparity, inverse of Q
+    bool project_to_disparity(const Eigen::Vector3d & pt, float & u, float & v, float & d) const {
+        if (Q.empty() || pt.z() <= 0) {
+            return false;
+        }
+        float f = Q.at<float>(2, 3);
+        u = f * pt.x() / pt.z() - Q.at<float>(0, 3);
+        v = f * pt.y() / pt.z() - Q.at<float>(1, 3);
+        d = (f / pt.z() - Q.at<float>(3, 3)) / Q.at<float>(3, 2);
+        return d > 0;
+    }
+
+    //Reproject disparity to 3d. With a ROI, only pixels inside are reprojected and others are left zero;
+    //pass the ROI the disparity was computed with, or none for disparity valid over the full image
+    cv::Mat DisparityToCloud(const cv::Mat & imgDisparity32F, cv::Rect disp_roi = cv::Rect()) const {
+        TicToc tic;
+        cv::Mat XYZ = cv::Mat::zeros(imgDisparity32F.rows, imgDisparity32F.cols, CV_32FC3);   // Output point cloud
+        cv::Rect _roi = disp_roi & cv::Rect(0, 0, imgDisparity32F.cols, imgDisparity32F.rows);
+        if (_roi.area() > 0) {
+            //Reproject ROI only, shift principal point of Q to ROI origin
+            cv::Mat Q_roi = Q.clone();
+            Q_roi.at<float>(0, 3) += _roi.x * Q.at<float>(0, 0);
+            Q_roi.at<float>(1, 3) += _roi.y * Q.at<float>(1, 1);
+            cv::Mat XYZ_roi = XYZ(_roi);
+            cv::reprojectImageTo3D(imgDisparity32F(_roi), XYZ_roi, Q_roi);
+        } else {
+            cv::reprojectImageTo3D(imgDisparity32F, XYZ, Q);    // cv::project
+        }
+        ROS_INFO("Reproject to 3d cost %fms", tic.toc());
+        return XYZ;
+    }
+
     template<typename cvMat>
     cv::Mat ComputeDepthCloud(cvMat & left, cvMat & right) {
+        return DisparityToCloud(ComputeDisparity32F(left, right), roi);
+    }
+
+    template<typename cvMat>
+    cv::Mat ComputeDisparity32F(cvMat & left, cvMat & right) {
         static int count = 0;
         int skip = 10/extrinsic_calib_rate;
         if (skip <= 0) {
@@ -113,20 +187,15 @@ public:
             }
         }
         
+        last_min_disp = params.min_disparity;
         cv::Mat dispartitymap = ComputeDispartiyMap(left, right);
-        int width = left.size().width;
-        int height = left.size().height;
 
         cv::Mat imgDisparity32F;
         TicToc tic1;
         dispartitymap.convertTo(imgDisparity32F, CV_32F, 1./16);
-        cv::threshold(imgDisparity32F, imgDisparity32F, params.min_disparity, 1000, cv::THRESH_TOZERO);
+        //SGBM marks invalid pixels with min_disparity - 1, which may be positive with a narrowed range
+        cv::threshold(imgDisparity32F, imgDisparity32F, std::max(params.min_disparity, last_min_disp - 1), 1000, cv::THRESH_TOZERO);
         ROS_INFO("Convert cost %fms", tic1.toc());
-
-        TicToc tic;
-        cv::Mat XYZ = cv::Mat::zeros(imgDisparity32F.rows, imgDisparity32F.cols, CV_32FC3);   // Output point cloud
-        cv::reprojectImageTo3D(imgDisparity32F, XYZ, Q);    // cv::project
-        ROS_INFO("Reproject to 3d cost %fms", tic.toc());
-        return XYZ;
+        return imgDisparity32F;
     }
 };
\ No newline at end of file
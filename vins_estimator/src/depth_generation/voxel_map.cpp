@@ -0,0 +1,150 @@
+#include "voxel_map.hpp"
+#include <algorithm>
+#include <cmath>
+
+//21 bits per axis, offset to make index positive
+#define VOXEL_KEY_BITS 21
+#define VOXEL_KEY_OFFSET (1 << (VOXEL_KEY_BITS - 1))
+#define VOXEL_KEY_MASK ((1ULL << VOXEL_KEY_BITS) - 1)
+//Evict this ratio of voxels when map is full, so eviction is not done every frame
+#define VOXEL_EVICT_RATIO 0.1
+//Bucket entries allowed above twice the voxel count before stale ones are compacted
+#define VOXEL_BUCKET_SLACK 65536
+//Republish a voxel when its centroid moves more than this ratio of resolution
+#define VOXEL_REPUBLISH_RATIO 0.1
+
+VoxelMap::VoxelMap(double _resolution, size_t _max_voxels, double _max_age, int _min_hits):
+    resolution(_resolution), inv_resolution(1.0/_resolution), max_voxels(_max_voxels),
+    max_age(_max_age), min_hits(_min_hits) {
+    voxels.reserve(max_voxels);
+}
+
+VoxelMap::VoxelKey VoxelMap::key(const Eigen::Vector3d & pt) const {
+    uint64_t x = (int64_t) std::floor(pt.x() * inv_resolution) + VOXEL_KEY_OFFSET;
+    uint64_t y = (int64_t) std::floor(pt.y() * inv_resolution) + VOXEL_KEY_OFFSET;
+    uint64_t z = (int64_t) std::floor(pt.z() * inv_resolution) + VOXEL_KEY_OFFSET;
+    return ((x & VOXEL_KEY_MASK) << (2*VOXEL_KEY_BITS)) | ((y & VOXEL_KEY_MASK) << VOXEL_KEY_BITS) | (z & VOXEL_KEY_MASK);
+}
+
+void VoxelMap::insert(const std::vector<Eigen::Vector3d> & pts, double stamp) {
+    std::lock_guard<std::mutex> lock(map_lock);
+    //Frames arriving out of order go to the newest bucket, buckets stay ordered
+    if (buckets.empty() || stamp > buckets.back().first) {
+        buckets.emplace_back(stamp, std::vector<VoxelKey>());
+    }
+    auto & bucket = buckets.back();
+    for (auto & pt : pts) {
+        auto _key = key(pt);
+        auto & voxel = voxels[_key];
+        voxel.hits ++;
+        voxel.mean += (pt - voxel.mean) / voxel.hits;
+        if (voxel.last_seen != bucket.first) {
+            voxel.last_seen = bucket.first;
+            bucket.second.push_back(_key);
+            bucket_entries ++;
+        }
+        if (!voxel.pending && voxel.hits >= min_hits) {
+            voxel.pending = true;
+            pending_keys.push_back(_key);
+        }
+    }
+}
+
+void VoxelMap::remove(std::unordered_map<VoxelKey, Voxel>::iterator it) {
+    if (it->second.published) {
+        removed_pts.push_back(it->second.published_pt);
+    }
+}
+
+void VoxelMap::compact_buckets() {
+    if (bucket_entries <= 2 * voxels.size() + VOXEL_BUCKET_SLACK) {
+        return;
+    }
+    bucket_entries = 0;
+    for (auto & bucket : buckets) {
+        auto live_end = std::remove_if(bucket.second.begin(), bucket.second.end(), [&](VoxelKey _key) {
+            auto it = voxels.find(_key);
+            return it == voxels.end() || it->second.last_seen != bucket.first;
+        });
+        bucket.second.erase(live_end, bucket.second.end());
+        bucket_entries += bucket.second.size();
+    }
+    //Frames fully revisited since leave empty buckets, the newest one stays for appending
+    buckets.erase(std::remove_if(buckets.begin(), buckets.end() - 1,
+        [](const std::pair<double, std::vector<VoxelKey>> & bucket) { return bucket.second.empty(); }),
+        buckets.end() - 1);
+}
+
+void VoxelMap::age_out(double stamp) {
+    std::lock_guard<std::mutex> lock(map_lock);
+    //Evict down to below max_voxels, so eviction is not done every frame
+    size_t keep_num = voxels.size() > max_voxels ? max_voxels*(1 - VOXEL_EVICT_RATIO) : voxels.size();
+    while (!buckets.empty()) {
+        auto & bucket = buckets.front();
+        bool aged = max_age > 0 && stamp - bucket.first > max_age;
+        while (!bucket.second.empty()) {
+            auto it = voxels.find(bucket.second.back());
+            bool live = it != voxels.end() && it->second.last_seen == bucket.first;
+            if (live && !aged && voxels.size() <= keep_num) {
+                break;
+            }
+            if (live) {
+                remove(it);
+                voxels.erase(it);
+            }
+            bucket.second.pop_back();
+            bucket_entries --;
+        }
+        //Keep the newest bucket, the next frame of the same stamp appends to it
+        if (!bucket.second.empty() || buckets.size() == 1) {
+            break;
+        }
+        buckets.pop_front();
+    }
+    compact_buckets();
+}
+
+void VoxelMap::pop_changed(std::vector<Eigen::Vector3f> & added, std::vector<Eigen::Vector3f> & removed) {
+    std::lock_guard<std::mutex> lock(map_lock);
+    added.clear();
+    added.reserve(pending_keys.size());
+    float republish_dist = resolution * VOXEL_REPUBLISH_RATIO;
+    for (auto _key : pending_keys) {
+        auto it = voxels.find(_key);
+        //Voxel may be evicted before published
+        if (it == voxels.end()) {
+            continue;
+        }
+        auto & voxel = it->second;
+        voxel.pending = false;
+        Eigen::Vector3f centroid = voxel.mean.cast<float>();
+        if (!voxel.published) {
+            voxel.published = true;
+        } else if ((centroid - voxel.published_pt).norm() > republish_dist) {
+            removed_pts.push_back(voxel.published_pt);
+        } else {
+            continue;
+        }
+        voxel.published_pt = centroid;
+        added.push_back(centroid);
+    }
+    pending_keys.clear();
+    removed.swap(removed_pts);
+    removed_pts.clear();
+}
+
+void VoxelMap::snapshot(std::vector<Eigen::Vector3f> & pts) {
+    std::lock_guard<std::mutex> lock(map_lock);
+    pts.clear();
+    pts.reserve(voxels.size());
+    for (auto & it : voxels) {
+        if (it.second.published) {
+            pts.push_back(it.second.published_pt);
+        }
+    }
+}
+
+size_t VoxelMap::size() {
+    std::lock_guard<std::mutex> lock(map_lock);
+    return voxels.size();
+}
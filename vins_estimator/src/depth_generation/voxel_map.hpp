@@ -0,0 +1,64 @@
+#pragma once
+#include <eigen3/Eigen/Dense>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+//Hashed voxel map of depth points in world frame.
+//Each voxel keeps the centroid of points fell in, only voxels created, moved or removed since last
+//pop_changed are reported, so depth clouds of consecutive frames are not republished.
+//Keys are also kept in buckets per frame, oldest first, aging and eviction pop from the front so the
+//cost per frame follows the points inserted and voxels removed, not the map size.
+class VoxelMap {
+public:
+    struct Voxel {
+        //Running mean of points fell in, a float sum loses precision on long-lived voxels
+        Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+        int hits = 0;
+        double last_seen = -1e300;
+        bool published = false;
+        //Centroid last reported, a moved voxel is reported as removed at it and added at new centroid
+        Eigen::Vector3f published_pt = Eigen::Vector3f::Zero();
+        bool pending = false;
+    };
+
+    VoxelMap(double _resolution, size_t _max_voxels, double _max_age, int _min_hits = 1);
+
+    void insert(const std::vector<Eigen::Vector3d> & pts, double stamp);
+
+    //Remove voxels not seen for max_age and evict oldest voxels when exceeding max_voxels
+    void age_out(double stamp);
+
+    //Voxels confirmed, moved and removed since last call
+    void pop_changed(std::vector<Eigen::Vector3f> & added, std::vector<Eigen::Vector3f> & removed);
+
+    //All confirmed voxels
+    void snapshot(std::vector<Eigen::Vector3f> & pts);
+
+    size_t size();
+
+private:
+    typedef uint64_t VoxelKey;
+    VoxelKey key(const Eigen::Vector3d & pt) const;
+    void remove(std::unordered_map<VoxelKey, Voxel>::iterator it);
+    //Drop stale bucket entries once they outnumber the voxels
+    void compact_buckets();
+
+    double resolution;
+    double inv_resolution;
+    size_t max_voxels;
+    double max_age;
+    int min_hits;
+
+    std::unordered_map<VoxelKey, Voxel> voxels;
+    //Keys touched in each frame with the frame stamp. A key is appended once per frame it is seen in,
+    //entries of earlier frames become stale and are dropped when popped or compacted
+    std::deque<std::pair<double, std::vector<VoxelKey>>> buckets;
+    size_t bucket_entries = 0;
+    //Voxels touched since last pop_changed, each key once
+    std::vector<VoxelKey> pending_keys;
+    std::vector<Eigen::Vector3f> removed_pts;
+    std::mutex map_lock;
+};
@@ -0,0 +1,180 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Check of VoxelMap aging, eviction and change reporting against a plain reference map on random
+//frames, of centroid precision on a long-lived voxel, and insertion benchmark per frame over map
+//sizes, which has to stay flat as the map grows. Returns non-zero on failure.
+
+#include <cstdio>
+#include <random>
+#include <map>
+#include <set>
+#include <tuple>
+#include <algorithm>
+#include "voxel_map.hpp"
+#include "../utility/tic_toc.h"
+
+#define CHECK_FRAMES 500
+#define CHECK_PTS_PER_FRAME 200
+#define CHECK_MAX_VOXELS 5000
+#define CHECK_MAX_AGE 40.0
+#define CHECK_CENTROID_HITS 1000000
+//Max centroid error of a voxel far from origin after CHECK_CENTROID_HITS hits
+#define CHECK_CENTROID_TOLERANCE 1e-4
+#define BENCH_FRAMES 50
+#define BENCH_PTS_PER_FRAME 20000
+
+typedef std::tuple<int, int, int> Index;
+
+static std::mt19937 rng(0);
+
+static Eigen::Vector3d centre(const Index & idx) {
+    return Eigen::Vector3d(std::get<0>(idx) + 0.5, std::get<1>(idx) + 0.5, std::get<2>(idx) + 0.5);
+}
+
+static Index index_of(const Eigen::Vector3f & pt) {
+    return Index((int) std::floor(pt.x()), (int) std::floor(pt.y()), (int) std::floor(pt.z()));
+}
+
+//Frames re-touch old voxels and create new ones, one point per voxel centre, so centroids are exact
+static bool check_aging_and_eviction() {
+    VoxelMap voxel_map(1.0, CHECK_MAX_VOXELS, CHECK_MAX_AGE);
+    std::map<Index, double> reference;
+    std::set<Index> published;
+    std::uniform_int_distribution<int> coord(-40, 40);
+    int failures = 0;
+
+    for (int frame = 0; frame < CHECK_FRAMES; frame ++) {
+        double stamp = frame;
+        std::vector<Eigen::Vector3d> pts;
+        for (int i = 0; i < CHECK_PTS_PER_FRAME; i ++) {
+            Index idx(coord(rng), coord(rng), coord(rng));
+            pts.push_back(centre(idx));
+            reference[idx] = stamp;
+        }
+        voxel_map.insert(pts, stamp);
+        voxel_map.age_out(stamp);
+
+        std::vector<Eigen::Vector3f> added, removed;
+        voxel_map.pop_changed(added, removed);
+        for (auto & pt : removed) {
+            failures += published.erase(index_of(pt)) != 1;
+        }
+        for (auto & pt : added) {
+            failures += !published.insert(index_of(pt)).second;
+        }
+
+        std::vector<Eigen::Vector3f> pts_map;
+        voxel_map.snapshot(pts_map);
+        std::set<Index> alive;
+        for (auto & pt : pts_map) {
+            alive.insert(index_of(pt));
+        }
+        //Changes reported add up to the map
+        failures += alive != published;
+        failures += alive.size() != voxel_map.size();
+
+        //Survivors are all within max age, and none is older than a voxel evicted for size
+        double min_alive = stamp, max_gone = -1;
+        for (auto it = reference.begin(); it != reference.end();) {
+            if (alive.count(it->first)) {
+                min_alive = std::min(min_alive, it->second);
+                failures += stamp - it->second > CHECK_MAX_AGE;
+                it ++;
+            } else {
+                if (stamp - it->second <= CHECK_MAX_AGE) {
+                    max_gone = std::max(max_gone, it->second);
+                }
+                it = reference.erase(it);
+            }
+        }
+        failures += max_gone > min_alive;
+        failures += alive.size() > CHECK_MAX_VOXELS;
+    }
+
+    printf("aging and eviction, %d frames: %d failures\n", CHECK_FRAMES, failures);
+    return failures == 0;
+}
+
+static bool check_centroid() {
+    VoxelMap voxel_map(1.0, 10, 0);
+    Eigen::Vector3d truth(1000.3, -2000.6, 500.2);
+    std::uniform_real_distribution<double> noise(-0.05, 0.05);
+    std::vector<Eigen::Vector3d> pts(CHECK_CENTROID_HITS);
+    Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+    for (int i = 0; i < CHECK_CENTROID_HITS; i ++) {
+        pts[i] = truth + Eigen::Vector3d(noise(rng), noise(rng), noise(rng));
+        mean += pts[i];
+    }
+    mean /= CHECK_CENTROID_HITS;
+    voxel_map.insert(pts, 0);
+
+    std::vector<Eigen::Vector3f> added, removed;
+    voxel_map.pop_changed(added, removed);
+    //Float output, compare against the float rounding of the exact mean
+    double err = added.size() == 1 ? (added[0].cast<double>() - mean.cast<float>().cast<double>()).norm() : INFINITY;
+    printf("centroid after %d hits: error %g\n", CHECK_CENTROID_HITS, err);
+    return err <= CHECK_CENTROID_TOLERANCE;
+}
+
+//Insert, age out and publish time per frame at growing map sizes, for a camera moving into new
+//space, which evicts as much as it inserts, and for a camera revisiting a mapped region, which
+//evicts nothing and should not pay for the rest of the map
+static void bench_insert() {
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (size_t map_size : {10000, 100000, 1000000}) {
+        for (bool moving : {true, false}) {
+            VoxelMap voxel_map(0.1, moving ? map_size : 2 * map_size, 1e9);
+            std::vector<Eigen::Vector3d> pts(BENCH_PTS_PER_FRAME);
+            if (!moving) {
+                //Fill the map with a wide region, frames then revisit one corner of it
+                std::vector<Eigen::Vector3d> fill(map_size);
+                for (size_t i = 0; i < map_size; i ++) {
+                    fill[i] = Eigen::Vector3d(i % 1000, (i / 1000) % 1000, i / 1000000) * 0.1 + Eigen::Vector3d::Constant(0.05);
+                }
+                voxel_map.insert(fill, 0);
+            }
+            double t_insert = 0, t_age = 0;
+            int frames = 0;
+            //Fill the map first, then time frames at the limit
+            for (int frame = 1; frames < BENCH_FRAMES; frame ++) {
+                for (auto & pt : pts) {
+                    pt = Eigen::Vector3d(uniform(rng) * 10, uniform(rng) * 10, 0.05);
+                    if (moving) {
+                        pt += Eigen::Vector3d(frame * 0.5, 0, uniform(rng) * 3);
+                    }
+                }
+                TicToc tic;
+                voxel_map.insert(pts, frame);
+                double dt = tic.toc();
+                tic.tic();
+                voxel_map.age_out(frame);
+                std::vector<Eigen::Vector3f> added, removed;
+                voxel_map.pop_changed(added, removed);
+                double dt_age = tic.toc();
+                if (voxel_map.size() > map_size / 2) {
+                    t_insert += dt;
+                    t_age += dt_age;
+                    frames ++;
+                }
+            }
+            printf("%s, map %7ld voxels: insert %.3fms per frame, %.2fM pts/s; age out and publish %.3fms per frame\n",
+                moving ? "moving   " : "revisiting", voxel_map.size(), t_insert / frames,
+                BENCH_PTS_PER_FRAME * frames / t_insert / 1000, t_age / frames);
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    int failures = 0;
+    failures += !check_aging_and_eviction();
+    failures += !check_centroid();
+    bench_insert();
+    return failures == 0 ? 0 : 1;
+}
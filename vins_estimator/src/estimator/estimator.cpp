@@ -8,12 +8,22 @@
  *******************************************************/
 
 #include "estimator.h"
+#include <atomic>
 #include "../utility/visualization.h"
 #include "../featureTracker/fisheye_undist.hpp"
 #include "../depth_generation/depth_camera_manager.h"
 #include "../featureTracker/feature_tracker_fisheye.hpp"
 #include "../featureTracker/feature_tracker_pinhole.hpp"
 
+//Max time in image stamp a depth frame waits for odometry before using IMU propagated pose
+#define DEPTH_ODOM_TIMEOUT 0.2
+#define DEPTH_DROP_TIMEOUT 1.0
+#define MAX_DEPTH_FRAME_BUF 5
+#define MAX_ODOMETRY_BUF 100
+#define MAX_IMU_POSE_BUF 2000
+//Max gap in seconds between a restored snapshot and the first image
+#define SNAPSHOT_MAX_GAP 0.5
+
 Estimator::Estimator(): f_manager{Rs}
 {
     ROS_INFO("init begins");
@@ -29,7 +39,12 @@ Estimator::Estimator(): f_manager{Rs}
     initFirstPoseFlag = false;
 }
 
-void Estimator::setParameter()
+Estimator::~Estimator()
+{
+    waitSnapshot();
+}
+
+void Estimator::setParameter(bool start_threads)
 {
      if (FISHEYE) {
         if (USE_GPU) {
@@ -59,6 +74,9 @@ void Estimator::setParameter()
     
     featureTracker->readIntrinsicParameter(CAM_NAMES);
 
+    if (!start_threads) {
+        return;
+    }
     processThread   = std::thread(&Estimator::processMeasurements, this);
     if (FISHEYE && ENABLE_DEPTH) {
         depthThread   = std::thread(&Estimator::processDepthGeneration, this);
@@ -281,6 +299,7 @@ void Estimator::processDepthGeneration() {
 
     std::vector<cv::cuda::GpuMat> fisheye_imgs_up_cuda, fisheye_imgs_down_cuda;
     std::vector<cv::Mat> fisheye_imgs_up, fisheye_imgs_down;
+    double t_latest = 0;
 
     while(ros::ok()) {
         if (!fisheye_imgs_upBuf.empty() || !fisheye_imgs_upBuf_cuda.empty()) {
@@ -311,6 +330,12 @@ void Estimator::processDepthGeneration() {
                 std::this_thread::sleep_for(dura);
             }
 
+            mBuf.lock();
+            if (fast_prop_inited) {
+                depth_cam_manager->update_velocity_roi(ric[0], latest_Q.toRotationMatrix(), latest_V);
+            }
+            mBuf.unlock();
+
             TicToc tic;
             if (USE_GPU) {
                 depth_cam_manager->update_images_to_buf(fisheye_imgs_up_cuda, fisheye_imgs_down_cuda);
@@ -321,54 +346,88 @@ void Estimator::processDepthGeneration() {
             if (ENABLE_PERF_OUTPUT) {
                 ROS_INFO("Depth generation cost %fms", tic.toc());
             }
-            
-            while(odometry_buf.size() == 0) {
-                //wait for odom
-                std::chrono::milliseconds dura(5);
-                std::this_thread::sleep_for(dura);
-            }
-
-            //1e-3 is for avoiding floating error
-            //First is older than this frame
-            while (odometry_buf.size() > 0 && odometry_buf.front().first < t - 1e-3 ) {
-                odomBuf.lock();
-                odometry_buf.pop();
-                odomBuf.unlock();
-            }
-
-            if(odometry_buf.size() == 0 || fabs(odometry_buf.front().first - t) > 1e-3) {
-                ROS_WARN("No suitable odometry find; skiping");
-                continue;
-            } else {
-                if (ENABLE_PERF_OUTPUT) {
-                    ROS_INFO("ODOM dt for depth %fms", (odometry_buf.front().first - t)*1000);
-                }
-            }
 
-            Eigen::Vector3d _sync_last_P = odometry_buf.front().second.second;
-            Eigen::Matrix3d _sync_last_R = odometry_buf.front().second.first;
-            
-            odomBuf.lock();
-            odometry_buf.pop();
-            odomBuf.unlock();
-            
-            depth_cam_manager->pub_depths_from_buf(ros::Time(t), this->ric[0], this->tic[0], _sync_last_R, _sync_last_P);
-            std_msgs::Header header;
-            header.frame_id = "world";
-            header.stamp = ros::Time(t);
-
-            TicToc tic_pub;
-            ROS_INFO("Pub flatten images cost %fms", tic_pub.toc());
+            depth_cam_manager->save_depth_frame(t);
+            t_latest = t;
+            pubDepthFrames(t_latest);
 
             fisheye_imgs_up.clear();
             fisheye_imgs_down.clear();
         } else {
+            pubDepthFrames(t_latest);
             std::chrono::milliseconds dura(5);
             std::this_thread::sleep_for(dura);
         }
     }
 }
 
+void Estimator::pubDepthFrames(double t_latest) {
+    while (depth_cam_manager->depth_frame_num() > 0) {
+        double t = depth_cam_manager->depth_frame_stamp();
+        Eigen::Matrix3d R;
+        Eigen::Vector3d P;
+        bool buf_full = depth_cam_manager->depth_frame_num() > MAX_DEPTH_FRAME_BUF;
+        bool odom_timeout = t_latest - t > DEPTH_ODOM_TIMEOUT || buf_full;
+        
+        //Prefer optimized odometry; fallback to IMU propagated pose when odometry is late
+        if (getPoseAt(t, R, P, false)) {
+            if (ENABLE_PERF_OUTPUT) {
+                ROS_INFO("Depth frame %f posed by odometry, delay %fms", t, (t_latest - t)*1000);
+            }
+        } else if (odom_timeout && getPoseAt(t, R, P, true)) {
+            if (ENABLE_PERF_OUTPUT) {
+                ROS_INFO("Depth frame %f posed by IMU propagation, delay %fms", t, (t_latest - t)*1000);
+            }
+        } else if (buf_full || t_latest - t > DEPTH_DROP_TIMEOUT) {
+            //Only happens before initialization finish
+            ROS_WARN("No pose for depth frame %f; skiping", t);
+            depth_cam_manager->drop_depth_frame();
+            continue;
+        } else {
+            break;
+        }
+
+        depth_cam_manager->pub_depth_frame(this->ric[0], this->tic[0], R, P);
+    }
+}
+
+static bool interpolatePose(const std::deque<std::pair<double, EigenPose>> & buf, double t, 
+        Eigen::Matrix3d & R, Eigen::Vector3d & P) {
+    //1e-3 is for avoiding floating error
+    if (buf.empty() || t < buf.front().first - 1e-3 || t > buf.back().first + 1e-3) {
+        return false;
+    }
+
+    auto it = std::lower_bound(buf.begin(), buf.end(), t - 1e-3, 
+        [](const std::pair<double, EigenPose> & a, double _t) { return a.first < _t; });
+    if (it == buf.begin() || fabs(it->first - t) <= 1e-3) {
+        R = it->second.first;
+        P = it->second.second;
+        return true;
+    }
+
+    auto prev = it - 1;
+    double s = (t - prev->first) / (it->first - prev->first);
+    Eigen::Quaterniond q0(prev->second.first), q1(it->second.first);
+    R = q0.slerp(s, q1).toRotationMatrix();
+    P = (1 - s) * prev->second.second + s * it->second.second;
+    return true;
+}
+
+bool Estimator::getPoseAt(double t, Eigen::Matrix3d & R, Eigen::Vector3d & P, bool use_imu_propagate) {
+    odomBuf.lock();
+    bool success = interpolatePose(odometry_buf, t, R, P);
+    odomBuf.unlock();
+    if (success || !use_imu_propagate) {
+        return success;
+    }
+
+    mBuf.lock();
+    success = interpolatePose(imu_pose_buf, t, R, P);
+    mBuf.unlock();
+    return success;
+}
+
 void Estimator::processMeasurements()
 {
 
@@ -379,12 +438,10 @@ void Estimator::processMeasurements()
         //printf("process measurments\n");
         TicToc t_process;
         pair<double, FeatureFrame > feature;
-        vector<pair<double, Eigen::Vector3d>> accVector, gyrVector;
         if(!featureBuf.empty())
         {
             feature = featureBuf.front();
 
-            curTime = feature.first + td;
             while(1)
             {
                 if ((!USE_IMU  || IMUAvailable(feature.first + td)))
@@ -397,35 +454,17 @@ void Estimator::processMeasurements()
                 }
             }
             mBuf.lock();
-            if(USE_IMU) {
-                getIMUInterval(prevTime, curTime, accVector, gyrVector);
-                if (curTime - prevTime > 0.11 || accVector.size()/(curTime - prevTime ) < 350) {
-                    ROS_WARN("Long IMU dt %fms or wrong IMU rate %fms", curTime - prevTime, accVector.size()/(curTime - prevTime));
-                } 
-            }
-
             featureBuf.pop();
             mBuf.unlock();
 
-            if(USE_IMU)
-            {
-                if(!initFirstPoseFlag)
-                    initFirstIMUPose(accVector);
-                for(size_t i = 0; i < accVector.size(); i++)
-                {
-                    double dt;
-                    if(i == 0)
-                        dt = accVector[i].first - prevTime;
-                    else if (i == accVector.size() - 1)
-                        dt = curTime - accVector[i - 1].first;
-                    else
-                        dt = accVector[i].first - accVector[i - 1].first;
-                    processIMU(accVector[i].first, dt, accVector[i].second, gyrVector[i].second);
-                }
-            }
-
+            processIMUInterval(feature.first);
             processImage(feature.second, feature.first);
-            prevTime = curTime;
+
+            if (!SNAPSHOT_SAVE_PATH.empty() && solver_flag == NON_LINEAR && 
+                    feature.first - last_snapshot_time > SNAPSHOT_INTERVAL) {
+                saveSnapshot(SNAPSHOT_SAVE_PATH);
+                last_snapshot_time = feature.first;
+            }
 
             printStatistics(*this, 0);
 
@@ -457,6 +496,51 @@ void Estimator::processMeasurements()
 }
 
 
+void Estimator::processIMUInterval(double t)
+{
+    curTime = t + td;
+    //A restored window needs continuous IMU, otherwise start over
+    if (snapshot_restored) {
+        snapshot_restored = false;
+        if (curTime - prevTime > SNAPSHOT_MAX_GAP) {
+            ROS_WARN("Snapshot is %fs older than first image, reinitialize", curTime - prevTime);
+            clearState();
+            for (int i = 0; i < NUM_OF_CAM; i++) {
+                tic[i] = TIC[i];
+                ric[i] = RIC[i];
+            }
+            f_manager.setRic(ric);
+            prevTime = -1;
+        }
+    }
+
+    if(USE_IMU)
+    {
+        vector<pair<double, Eigen::Vector3d>> accVector, gyrVector;
+        mBuf.lock();
+        getIMUInterval(prevTime, curTime, accVector, gyrVector);
+        if (curTime - prevTime > 0.11 || accVector.size()/(curTime - prevTime ) < 350) {
+            ROS_WARN("Long IMU dt %fms or wrong IMU rate %fms", curTime - prevTime, accVector.size()/(curTime - prevTime));
+        } 
+        mBuf.unlock();
+
+        if(!initFirstPoseFlag)
+            initFirstIMUPose(accVector);
+        for(size_t i = 0; i < accVector.size(); i++)
+        {
+            double dt;
+            if(i == 0)
+                dt = accVector[i].first - prevTime;
+            else if (i == accVector.size() - 1)
+                dt = curTime - accVector[i - 1].first;
+            else
+                dt = accVector[i].first - accVector[i - 1].first;
+            processIMU(accVector[i].first, dt, accVector[i].second, gyrVector[i].second);
+        }
+    }
+    prevTime = curTime;
+}
+
 void Estimator::initFirstIMUPose(vector<pair<double, Eigen::Vector3d>> &accVector)
 {
     printf("init first imu pose\n");
@@ -489,6 +573,7 @@ void Estimator::initFirstPose(Eigen::Vector3d p, Eigen::Matrix3d r)
 
 void Estimator::clearState()
 {
+    waitSnapshot();
     for (int i = 0; i < WINDOW_SIZE + 1; i++)
     {
         Rs[i].setIdentity();
@@ -496,9 +581,6 @@ void Estimator::clearState()
         Vs[i].setZero();
         Bas[i].setZero();
         Bgs[i].setZero();
-        dt_buf[i].clear();
-        linear_acceleration_buf[i].clear();
-        angular_velocity_buf[i].clear();
 
         if (pre_integrations[i] != nullptr)
         {
@@ -521,6 +603,11 @@ void Estimator::clearState()
     latest_P = Eigen::Vector3d::Zero();
     latest_V = Eigen::Vector3d::Zero();
     latest_Q = Eigen::Quaterniond::Identity();
+    last_R = Eigen::Matrix3d::Identity();
+    last_P = Eigen::Vector3d::Zero();
+    last_V = Eigen::Vector3d::Zero();
+    last_Ba = Eigen::Vector3d::Zero();
+    last_Bg = Eigen::Vector3d::Zero();
     fast_prop_inited = false;
     initial_timestamp = 0;
     all_image_frame.clear();
@@ -537,6 +624,62 @@ void Estimator::clearState()
     f_manager.clearState();
 
     failure_occur = 0;
+    warm_restarting = false;
+}
+
+void Estimator::warmRestart(double header)
+{
+    //IMU buffers, tracker, extrinsic and the fast propagation are kept; only the window is rebuilt.
+    //The newest frame restarts from the last good state, propagated by its own preintegration
+    Matrix3d R = last_R;
+    Vector3d P = last_P, V = last_V;
+    if (USE_IMU && pre_integrations[frame_count] != nullptr)
+    {
+        IntegrationBase * pre_integration = pre_integrations[frame_count];
+        double dt = pre_integration->sum_dt;
+        P = last_P + last_V * dt - 0.5 * g * dt * dt + last_R * pre_integration->delta_p;
+        V = last_V - g * dt + last_R * pre_integration->delta_v;
+        R = last_R * pre_integration->delta_q.toRotationMatrix();
+    }
+
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+    {
+        Rs[i] = R;
+        Ps[i] = P;
+        Vs[i] = V;
+        Bas[i] = last_Ba;
+        Bgs[i] = last_Bg;
+
+        if (pre_integrations[i] != nullptr)
+        {
+            delete pre_integrations[i];
+        }
+        pre_integrations[i] = nullptr;
+    }
+
+    for (auto & frame : all_image_frame)
+    {
+        delete frame.second.pre_integration;
+    }
+    all_image_frame.clear();
+
+    if (tmp_pre_integration != nullptr)
+        delete tmp_pre_integration;
+    if (last_marginalization_info != nullptr)
+        delete last_marginalization_info;
+
+    tmp_pre_integration = new IntegrationBase{acc_0, gyr_0, last_Ba, last_Bg};
+    pre_integrations[0] = new IntegrationBase{acc_0, gyr_0, last_Ba, last_Bg};
+    last_marginalization_info = nullptr;
+    last_marginalization_parameter_blocks.clear();
+
+    f_manager.clearState();
+
+    frame_count = 0;
+    solver_flag = INITIAL;
+    failure_occur = 0;
+    warm_restarting = true;
+    warm_restart_time = header;
 }
 
 void Estimator::processIMU(double t, double dt, const Vector3d &linear_acceleration, const Vector3d &angular_velocity)
@@ -558,9 +701,6 @@ void Estimator::processIMU(double t, double dt, const Vector3d &linear_accelerat
         //if(solver_flag != NON_LINEAR)
             tmp_pre_integration->push_back(dt, linear_acceleration, angular_velocity);
 
-        dt_buf[frame_count].push_back(dt);
-        linear_acceleration_buf[frame_count].push_back(linear_acceleration);
-        angular_velocity_buf[frame_count].push_back(angular_velocity);
 
         int j = frame_count;         
         Vector3d un_acc_0 = Rs[j] * (acc_0 - Bas[j]) - g;
@@ -658,18 +798,22 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
             }
             if (frame_count == WINDOW_SIZE)
             {
-                map<double, ImageFrame>::iterator frame_it;
-                int i = 0;
-                for (frame_it = all_image_frame.begin(); frame_it != all_image_frame.end(); frame_it++)
-                {
-                    frame_it->second.R = Rs[i];
-                    frame_it->second.T = Ps[i];
-                    i++;
-                }
-                solveGyroscopeBias(all_image_frame, Bgs);
-                for (int i = 0; i <= WINDOW_SIZE; i++)
+                //After warm restart the biases are already estimated
+                if (!warm_restarting)
                 {
-                    pre_integrations[i]->repropagate(Vector3d::Zero(), Bgs[i]);
+                    map<double, ImageFrame>::iterator frame_it;
+                    int i = 0;
+                    for (frame_it = all_image_frame.begin(); frame_it != all_image_frame.end(); frame_it++)
+                    {
+                        frame_it->second.R = Rs[i];
+                        frame_it->second.T = Ps[i];
+                        i++;
+                    }
+                    solveGyroscopeBias(all_image_frame, Bgs);
+                    for (int i = 0; i <= WINDOW_SIZE; i++)
+                    {
+                        pre_integrations[i]->correctBias(Vector3d::Zero(), Bgs[i]);
+                    }
                 }
                 
                 solver_flag = NON_LINEAR;
@@ -680,8 +824,23 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
                 // outliersRejection(removeIndex);
                 // exit(-1);
 
+                if (warm_restarting)
+                {
+                    ROS_WARN("Warm restart window full in %.1fms", (header - warm_restart_time) * 1000);
+                    warm_restarting = false;
+                }
                 ROS_INFO("Initialization finish!");
             }
+            else if (warm_restarting && frame_count >= WARM_RESTART_FRAMES)
+            {
+                //Solve the partial window so fast propagation restarts from a visual estimate
+                optimization();
+                updateLatestStates();
+                if (frame_count == WARM_RESTART_FRAMES)
+                {
+                    ROS_WARN("Warm restart recovered in %.1fms", (header - warm_restart_time) * 1000);
+                }
+            }
 
         }
 
@@ -696,6 +855,7 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
             {
                 solver_flag = NON_LINEAR;
                 slideWindow();
+                warm_restarting = false;
                 ROS_INFO("Initialization finish!");
             }
         }
@@ -746,12 +906,17 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
         if (failureDetection())
         {
             ROS_WARN("failure detection!");
+            if (WARM_RESTART && STEREO)
+            {
+                warmRestart(header);
+                ROS_WARN("system warm restart!");
+                processImage(image, header);
+                return;
+            }
             failure_occur = 1;
             clearState();
             setParameter();
             ROS_WARN("system reboot!");
-            //exit(-1);
-            cv::waitKey(-1);
             return;
         }
 
@@ -769,11 +934,17 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
 
         last_R = Rs[WINDOW_SIZE];
         last_P = Ps[WINDOW_SIZE];
+        last_V = Vs[WINDOW_SIZE];
+        last_Ba = Bas[WINDOW_SIZE];
+        last_Bg = Bgs[WINDOW_SIZE];
         last_R0 = Rs[0];
         last_P0 = Ps[0];
 
         odomBuf.lock();
-        odometry_buf.push(make_pair( header, make_pair(last_R, last_P)));
+        odometry_buf.push_back(make_pair( header, make_pair(last_R, last_P)));
+        while (odometry_buf.size() > MAX_ODOMETRY_BUF) {
+            odometry_buf.pop_front();
+        }
         odomBuf.unlock();
 
         updateLatestStates();
@@ -785,7 +956,6 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
 
 bool Estimator::initialStructure()
 {
-    TicToc t_sfm;
     //check imu observibility
     {
         map<double, ImageFrame>::iterator frame_it;
@@ -852,14 +1022,12 @@ bool Estimator::initialStructure()
         return false;
     }
 
-    //solve pnp for all frame
+    //solve pnp for all frame, non key frames are independent and solved in parallel
+    vector<pair<ImageFrame *, int>> pnp_frames;
     map<double, ImageFrame>::iterator frame_it;
-    map<int, Vector3d>::iterator it;
     frame_it = all_image_frame.begin( );
     for (int i = 0; frame_it != all_image_frame.end( ); frame_it++)
     {
-        // provide initial guess
-        cv::Mat r, rvec, t, D, tmp_r;
         if((frame_it->first) == Headers[i])
         {
             frame_it->second.is_key_frame = true;
@@ -872,43 +1040,56 @@ bool Estimator::initialStructure()
         {
             i++;
         }
+        frame_it->second.is_key_frame = false;
+        pnp_frames.push_back(make_pair(&frame_it->second, i));
+    }
+
+    std::atomic<bool> pnp_succ(true);
+#pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < (int)pnp_frames.size(); k++)
+    {
+        if (!pnp_succ)
+            continue;
+        ImageFrame & frame = *pnp_frames[k].first;
+        int i = pnp_frames[k].second;
+        // provide initial guess
+        cv::Mat r, rvec, t, D, tmp_r;
         Matrix3d R_inital = (Q[i].inverse()).toRotationMatrix();
         Vector3d P_inital = - R_inital * T[i];
         cv::eigen2cv(R_inital, tmp_r);
         cv::Rodrigues(tmp_r, rvec);
         cv::eigen2cv(P_inital, t);
 
-        frame_it->second.is_key_frame = false;
         vector<cv::Point3f> pts_3_vector;
         vector<cv::Point2f> pts_2_vector;
-        for (auto &id_pts : frame_it->second.points)
+        for (auto &id_pts : frame.points)
         {
             int feature_id = id_pts.first;
+            auto it = sfm_tracked_points.find(feature_id);
+            if(it == sfm_tracked_points.end())
+                continue;
             for (auto &i_p : id_pts.second)
             {
-                it = sfm_tracked_points.find(feature_id);
-                if(it != sfm_tracked_points.end())
-                {
-                    Vector3d world_pts = it->second;
-                    cv::Point3f pts_3(world_pts(0), world_pts(1), world_pts(2));
-                    pts_3_vector.push_back(pts_3);
-                    Vector2d img_pts = i_p.second.head<2>();
-                    cv::Point2f pts_2(img_pts(0), img_pts(1));
-                    pts_2_vector.push_back(pts_2);
-                }
+                Vector3d world_pts = it->second;
+                cv::Point3f pts_3(world_pts(0), world_pts(1), world_pts(2));
+                pts_3_vector.push_back(pts_3);
+                Vector2d img_pts = i_p.second.head<2>();
+                cv::Point2f pts_2(img_pts(0), img_pts(1));
+                pts_2_vector.push_back(pts_2);
             }
         }
         cv::Mat K = (cv::Mat_<double>(3, 3) << 1, 0, 0, 0, 1, 0, 0, 0, 1);     
         if(pts_3_vector.size() < 6)
         {
-            cout << "pts_3_vector size " << pts_3_vector.size() << endl;
-            ROS_DEBUG("Not enough points for solve pnp !");
-            return false;
+            ROS_DEBUG("Not enough points for solve pnp %ld!", pts_3_vector.size());
+            pnp_succ = false;
+            continue;
         }
         if (! cv::solvePnP(pts_3_vector, pts_2_vector, K, D, rvec, t, 1))
         {
             ROS_DEBUG("solve pnp fail!");
-            return false;
+            pnp_succ = false;
+            continue;
         }
         cv::Rodrigues(rvec, r);
         MatrixXd R_pnp,tmp_R_pnp;
@@ -917,9 +1098,12 @@ bool Estimator::initialStructure()
         MatrixXd T_pnp;
         cv::cv2eigen(t, T_pnp);
         T_pnp = R_pnp * (-T_pnp);
-        frame_it->second.R = R_pnp * RIC[0].transpose();
-        frame_it->second.T = T_pnp;
+        frame.R = R_pnp * RIC[0].transpose();
+        frame.T = T_pnp;
     }
+    if (!pnp_succ)
+        return false;
+
     if (visualInitialAlign())
         return true;
     else
@@ -955,7 +1139,7 @@ bool Estimator::visualInitialAlign()
     double s = (x.tail<1>())(0);
     for (int i = 0; i <= WINDOW_SIZE; i++)
     {
-        pre_integrations[i]->repropagate(Vector3d::Zero(), Bgs[i]);
+        pre_integrations[i]->correctBias(Vector3d::Zero(), Bgs[i]);
     }
     for (int i = frame_count; i >= 0; i--)
         Ps[i] = s * Ps[i] - Rs[i] * TIC[0] - (s * Ps[0] - Rs[0] * TIC[0]);
@@ -1070,7 +1254,6 @@ void Estimator::vector2double()
     for (auto & it : deps) {
         // ROS_INFO("Feature %d invdepth %f feature index %d", it.first, it.second, param_feature_id.size());
         para_Feature[param_feature_id.size()][0] = it.second;
-        param_feature_id_to_index[it.first] = param_feature_id.size();
         param_feature_id.push_back(it.first);
         
     }
@@ -1157,11 +1340,12 @@ void Estimator::double2vector()
         }
     }
 
-    std::map<int, double> deps;
+    std::vector<std::pair<int, double>> deps;
+    deps.reserve(param_feature_id.size());
     for (unsigned int i = 0; i < param_feature_id.size(); i++) {
         int _id = param_feature_id[i];
         // ROS_INFO("Id %d depth %f", i, 1/para_Feature[i][0]);
-        deps[_id] = para_Feature[i][0];
+        deps.emplace_back(_id, para_Feature[i][0]);
     }
 
     f_manager.setDepth(deps);
@@ -1173,7 +1357,10 @@ void Estimator::double2vector()
 
 bool Estimator::failureDetection()
 {
-    return false;
+    //Full reinitialization loses odometry for seconds, so detection is only enabled where
+    //processImage can warm restart
+    if (!(WARM_RESTART && STEREO))
+        return false;
     if (f_manager.last_track_num < 2)
     {
         ROS_INFO(" little feature %d", f_manager.last_track_num);
@@ -1283,11 +1470,9 @@ void Estimator::optimization()
     int f_m_cnt = 0;
 
     // for (auto &_it : f_manager.feature)
-    for (int _id : param_feature_id){
-        auto & it_per_id = f_manager.feature[_id];
+    for (int feature_index = 0; feature_index < (int) param_feature_id.size(); feature_index++){
+        auto & it_per_id = f_manager.feature[param_feature_id[feature_index]];
         it_per_id.used_num = it_per_id.feature_per_frame.size();
- 
-        int feature_index = param_feature_id_to_index[it_per_id.feature_id];
 
         int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
         
@@ -1367,7 +1552,7 @@ void Estimator::optimization()
     ceres::Solver::Options options;
 
     options.linear_solver_type = ceres::DENSE_SCHUR;
-    options.num_threads = 1;
+    options.num_threads = SOLVER_THREADS;
     options.trust_region_strategy_type = ceres::DOGLEG;
     options.max_num_iterations = NUM_ITERATIONS;
     // options.check_gradients = true;
@@ -1378,6 +1563,13 @@ void Estimator::optimization()
         options.max_solver_time_in_seconds = SOLVER_TIME * 4.0 / 5.0;
     else
         options.max_solver_time_in_seconds = SOLVER_TIME;
+    //Count IMU sqrt info evaluations of this solve only
+    int sqrt_info_hits, sqrt_info_misses;
+    double sqrt_info_ms;
+    if (ENABLE_PERF_OUTPUT && USE_IMU) {
+        for (int i = 1; i <= frame_count; i++)
+            pre_integrations[i]->takeSqrtInfoStats(sqrt_info_hits, sqrt_info_misses, sqrt_info_ms);
+    }
     TicToc t_solver;
     ceres::Solver::Summary summary;
     ceres::Solve(options, &problem, &summary);
@@ -1394,6 +1586,21 @@ void Estimator::optimization()
         ROS_INFO("AVG Iter %f time %fms Iterations : %d solver costs: %f \n", 
             sum_iterations/solve_count, sum_solve_time*1000/solve_count,
             static_cast<int>(summary.iterations.size()),  t_solver.toc());
+        if (USE_IMU) {
+            //Every hit would have recomputed the LLT at the average cost of a miss
+            int hits = 0, misses = 0;
+            double compute_ms = 0;
+            for (int i = 1; i <= frame_count; i++) {
+                pre_integrations[i]->takeSqrtInfoStats(sqrt_info_hits, sqrt_info_misses, sqrt_info_ms);
+                hits += sqrt_info_hits;
+                misses += sqrt_info_misses;
+                compute_ms += sqrt_info_ms;
+            }
+            if (misses > 0) {
+                ROS_INFO("IMU sqrt info %d evaluations, %d computed in %fms, cache saved ~%fms\n",
+                    hits + misses, misses, compute_ms, compute_ms / misses * hits);
+            }
+        }
     }
 
     double2vector();
@@ -1437,10 +1644,8 @@ void Estimator::optimization()
             }
         }
 
-        for (int _id : param_feature_id) {
-            auto & it_per_id = f_manager.feature[_id];
-
-            int feature_index = param_feature_id_to_index[it_per_id.feature_id];
+        for (int feature_index = 0; feature_index < (int) param_feature_id.size(); feature_index++) {
+            auto & it_per_id = f_manager.feature[param_feature_id[feature_index]];
 
             int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
             if (imu_i != 0)
@@ -1607,10 +1812,6 @@ void Estimator::slideWindow()
                 {
                     std::swap(pre_integrations[i], pre_integrations[i + 1]);
 
-                    dt_buf[i].swap(dt_buf[i + 1]);
-                    linear_acceleration_buf[i].swap(linear_acceleration_buf[i + 1]);
-                    angular_velocity_buf[i].swap(angular_velocity_buf[i + 1]);
-
                     Vs[i].swap(Vs[i + 1]);
                     Bas[i].swap(Bas[i + 1]);
                     Bgs[i].swap(Bgs[i + 1]);
@@ -1628,10 +1829,6 @@ void Estimator::slideWindow()
 
                 delete pre_integrations[WINDOW_SIZE];
                 pre_integrations[WINDOW_SIZE] = new IntegrationBase{acc_0, gyr_0, Bas[WINDOW_SIZE], Bgs[WINDOW_SIZE]};
-
-                dt_buf[WINDOW_SIZE].clear();
-                linear_acceleration_buf[WINDOW_SIZE].clear();
-                angular_velocity_buf[WINDOW_SIZE].clear();
             }
 
             if (true || solver_flag == INITIAL)
@@ -1654,18 +1851,8 @@ void Estimator::slideWindow()
 
             if(USE_IMU)
             {
-                for (unsigned int i = 0; i < dt_buf[frame_count].size(); i++)
-                {
-                    double tmp_dt = dt_buf[frame_count][i];
-                    Vector3d tmp_linear_acceleration = linear_acceleration_buf[frame_count][i];
-                    Vector3d tmp_angular_velocity = angular_velocity_buf[frame_count][i];
-
-                    pre_integrations[frame_count - 1]->push_back(tmp_dt, tmp_linear_acceleration, tmp_angular_velocity);
-
-                    dt_buf[frame_count - 1].push_back(tmp_dt);
-                    linear_acceleration_buf[frame_count - 1].push_back(tmp_linear_acceleration);
-                    angular_velocity_buf[frame_count - 1].push_back(tmp_angular_velocity);
-                }
+                //Compose the preintegrations instead of reintegrating the samples of the dropped frame
+                pre_integrations[frame_count - 1]->merge(*pre_integrations[frame_count]);
 
                 Vs[frame_count - 1] = Vs[frame_count];
                 Bas[frame_count - 1] = Bas[frame_count];
@@ -1673,10 +1860,6 @@ void Estimator::slideWindow()
 
                 delete pre_integrations[WINDOW_SIZE];
                 pre_integrations[WINDOW_SIZE] = new IntegrationBase{acc_0, gyr_0, Bas[WINDOW_SIZE], Bgs[WINDOW_SIZE]};
-
-                dt_buf[WINDOW_SIZE].clear();
-                linear_acceleration_buf[WINDOW_SIZE].clear();
-                angular_velocity_buf[WINDOW_SIZE].clear();
             }
             slideWindowNew();
         }
@@ -1761,94 +1944,101 @@ void Estimator::predictPtsInNextFrame()
     featureTracker->setPrediction(predictPts, predictPts1);
 }
 
-double Estimator::reprojectionError(Matrix3d &Ri, Vector3d &Pi, Matrix3d &rici, Vector3d &tici,
-                                 Matrix3d &Rj, Vector3d &Pj, Matrix3d &ricj, Vector3d &ticj, 
-                                 double depth, Vector3d &uvi, Vector3d &uvj)
+double Estimator::reprojectionError(const Matrix3d &R_cj_w, const Vector3d &t_cj_w, const Vector3d &pts_w, const Vector3d &uvj)
 {
-    Vector3d pts_w = Ri * (rici * (depth * uvi) + tici) + Pi;
-    Vector3d pts_cj = ricj.transpose() * (Rj.transpose() * (pts_w - Pj) - ticj);
+    Vector3d pts_cj = R_cj_w * pts_w + t_cj_w;
 
     if (FISHEYE) {
         //In Fisheye we use 3d unit sphere to represent point position
         return (pts_cj.normalized() - uvj).norm();
     } else {
-        Vector2d residual = (pts_cj / pts_cj.z()).head<2>() - uvj.head<2>();
-        double rx = residual.x();
-        double ry = residual.y();
-        return sqrt(rx * rx + ry * ry);
+        return ((pts_cj / pts_cj.z()).head<2>() - uvj.head<2>()).norm();
     }
-
-    return 100000;
 }
 
-void Estimator::outliersRejection(set<int> &removeIndex)
+void Estimator::featureReprojectionErrors(const std::vector<FeaturePerId *> &features, std::vector<double> &ave_errs)
 {
-    for (int _id : param_feature_id) {
-        auto & it_per_id = f_manager.feature[_id];
+    //Camera poses of the window are computed once, then every feature is lifted to world once
+    //and each observation costs a single transform, features are evaluated in parallel
+    Matrix3d R_w_c[WINDOW_SIZE + 1][2], R_c_w[WINDOW_SIZE + 1][2];
+    Vector3d t_w_c[WINDOW_SIZE + 1][2], t_c_w[WINDOW_SIZE + 1][2];
+    for (int i = 0; i <= WINDOW_SIZE; i++) {
+        for (int c = 0; c < 2; c++) {
+            R_w_c[i][c] = Rs[i] * ric[c];
+            t_w_c[i][c] = Rs[i] * tic[c] + Ps[i];
+            R_c_w[i][c] = R_w_c[i][c].transpose();
+            t_c_w[i][c] = -R_c_w[i][c] * t_w_c[i][c];
+        }
+    }
+
+    int num = features.size();
+    ave_errs.assign(num, 0);
+
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < num; k++) {
+        auto & it_per_id = *features[k];
         double err = 0;
         int errCnt = 0;
         it_per_id.used_num = it_per_id.feature_per_frame.size();
 
         int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
+        int main_cam = it_per_id.main_cam;
         Vector3d pts_i = it_per_id.feature_per_frame[0].point;
         double depth = it_per_id.estimated_depth;
-
-        // Vector3d pts_w = Rs[imu_i] * (ric[it_per_id.main_cam] * (depth * pts_i) + tic[it_per_id.main_cam]) + Ps[imu_i];
-        // ROS_INFO("PT %d, STEREO %d w %f %f %f drone %f %f %f ptun %f %f %f, depth %f", 
-        //     it_per_id.feature_id,
-        //     it_per_id.feature_per_frame.front().is_stereo, 
-        //     pts_w.x(), pts_w.y(), pts_w.z(),
-        //     Ps[imu_i].x(), Ps[imu_i].y(), Ps[imu_i].z(),
-        //     pts_i.x(), pts_i.y(), pts_i.z(),
-        //     depth
-        // );
+        Vector3d pts_w = R_w_c[imu_i][main_cam] * (depth * pts_i) + t_w_c[imu_i][main_cam];
+        // need to rewrite projecton factor.........
+        Vector3d pts_w_stereo = R_w_c[imu_i][0] * (depth * pts_i) + t_w_c[imu_i][0];
 
         for (auto &it_per_frame : it_per_id.feature_per_frame)
         {
             imu_j++;
-                
             if (imu_i != imu_j)
             {
-                Vector3d pts_j = it_per_frame.point;     
-                double tmp_error = reprojectionError(Rs[imu_i], Ps[imu_i], ric[it_per_id.main_cam], tic[it_per_id.main_cam], 
-                                                    Rs[imu_j], Ps[imu_j], ric[it_per_id.main_cam], tic[it_per_id.main_cam],
-                                                    depth, pts_i, pts_j);
-                err += tmp_error;
+                err += reprojectionError(R_c_w[imu_j][main_cam], t_c_w[imu_j][main_cam], pts_w, it_per_frame.point);
                 errCnt++;
-                //printf("tmp_error %f\n", FOCAL_LENGTH / 1.5 * tmp_error);
             }
-            // need to rewrite projecton factor.........
+
             if(STEREO && it_per_frame.is_stereo)
             {
-                
-                Vector3d pts_j_right = it_per_frame.pointRight;
-                if(imu_i != imu_j)
-                {            
-                    double tmp_error = reprojectionError(Rs[imu_i], Ps[imu_i], ric[0], tic[0], 
-                                                        Rs[imu_j], Ps[imu_j], ric[1], tic[1],
-                                                        depth, pts_i, pts_j_right);
-                    err += tmp_error;
-                    errCnt++;
-                    //printf("tmp_error %f\n", FOCAL_LENGTH / 1.5 * tmp_error);
-                }
-                else
-                {
-                    double tmp_error = reprojectionError(Rs[imu_i], Ps[imu_i], ric[0], tic[0], 
-                                                        Rs[imu_j], Ps[imu_j], ric[1], tic[1],
-                                                        depth, pts_i, pts_j_right);
-                    err += tmp_error;
-                    errCnt++;
-                    //printf("tmp_error %f\n", FOCAL_LENGTH / 1.5 * tmp_error);
-                }       
+                err += reprojectionError(R_c_w[imu_j][1], t_c_w[imu_j][1], pts_w_stereo, it_per_frame.pointRight);
+                errCnt++;
             }
         }
-        double ave_err = err / errCnt;
-        if(ave_err * FOCAL_LENGTH > THRES_OUTLIER) {
-            // ROS_INFO("Removing feature %d on cam %d...  error %f", it_per_id.feature_id, it_per_id.main_cam, ave_err * FOCAL_LENGTH);
-            removeIndex.insert(it_per_id.feature_id);
+        ave_errs[k] = errCnt > 0 ? err / errCnt : 0;
+    }
+}
+
+void Estimator::outliersRejection(set<int> &removeIndex)
+{
+    TicToc tic;
+    std::vector<FeaturePerId *> features;
+    features.reserve(param_feature_id.size());
+    for (int _id : param_feature_id) {
+        auto it = f_manager.feature.find(_id);
+        if (it != f_manager.feature.end()) {
+            features.push_back(&it->second);
         }
+    }
 
+    int num = features.size();
+    std::vector<double> ave_errs;
+    featureReprojectionErrors(features, ave_errs);
+
+    for (int k = 0; k < num; k++) {
+        int feature_id = features[k]->feature_id;
+        double ave_err = ave_errs[k] * FOCAL_LENGTH;
+        if(ave_err > THRES_OUTLIER) {
+            // ROS_INFO("Removing feature %d on cam %d...  error %f", feature_id, features[k]->main_cam, ave_err);
+            removeIndex.insert(feature_id);
+            //Removal status as removeOutlier sets it, with the error for the track image
+            featureTracker->setFeatureStatus(feature_id, -1, ave_err);
+        } else {
+            featureTracker->setFeatureStatus(feature_id, 3, ave_err);
+        }
+    }
 
+    if (ENABLE_PERF_OUTPUT) {
+        ROS_INFO("Outlier rejection of %d features cost %fms", num, tic.toc());
     }
 }
 
@@ -1876,6 +2066,12 @@ void Estimator::fastPredictIMU(double t, Eigen::Vector3d linear_acceleration, Ei
     latest_V = latest_V + dt * un_acc;
     latest_acc_0 = linear_acceleration;
     latest_gyr_0 = angular_velocity;
+
+    //Stamp in image time for posing depth frames
+    imu_pose_buf.push_back(make_pair(t - td, make_pair(latest_Q.toRotationMatrix(), latest_P)));
+    while (imu_pose_buf.size() > MAX_IMU_POSE_BUF) {
+        imu_pose_buf.pop_front();
+    }
 }
 
 void Estimator::updateLatestStates()
@@ -1895,6 +2091,12 @@ void Estimator::updateLatestStates()
     queue<pair<double, Eigen::Vector3d>> tmp_accBuf = accBuf;
     queue<pair<double, Eigen::Vector3d>> tmp_gyrBuf = gyrBuf;
 
+    //Propagated poses after the optimized frame are replaced by repropagation
+    while (!imu_pose_buf.empty() && imu_pose_buf.back().first >= Headers[frame_count]) {
+        imu_pose_buf.pop_back();
+    }
+    imu_pose_buf.push_back(make_pair(Headers[frame_count], make_pair(Rs[frame_count], Ps[frame_count])));
+
     double re_propagate_dt = accBuf.back().first - latest_time;
 
     if (re_propagate_dt > 3.0/IMAGE_FREQ) {
@@ -11,11 +11,13 @@
  
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <std_msgs/Header.h>
 #include <std_msgs/Float32.h>
 #include <ceres/ceres.h>
 #include <unordered_map>
 #include <queue>
+#include <deque>
 #include <opencv2/core/eigen.hpp>
 #include <eigen3/Eigen/Dense>
 #include <eigen3/Eigen/Geometry>
@@ -45,8 +47,10 @@ class Estimator
 {
   public:
     Estimator();
+    ~Estimator();
 
-    void setParameter();
+    //start_threads: false when measurements are fed to processIMUInterval and processImage directly
+    void setParameter(bool start_threads = true);
 
     // interface
     void initFirstPose(Eigen::Vector3d p, Eigen::Matrix3d r);
@@ -59,12 +63,20 @@ class Estimator
     void inputFisheyeImage(double t, const CvImages & fisheye_imgs_up, const CvImages & fisheye_imgs_down);
     void processIMU(double t, double dt, const Vector3d &linear_acceleration, const Vector3d &angular_velocity);
     void processImage(const FeatureFrame &image, const double header);
+    //Buffered IMU from the previous image to the image at t, integrated into the window
+    void processIMUInterval(double t);
     void processMeasurements();
 
     void processDepthGeneration();
+    void pubDepthFrames(double t_latest);
+    bool getPoseAt(double t, Eigen::Matrix3d & R, Eigen::Vector3d & P, bool use_imu_propagate);
 
     // internal
     void clearState();
+    void warmRestart(double header);
+    bool saveSnapshot(const std::string &path);
+    bool loadSnapshot(const std::string &path);
+    void waitSnapshot();
     bool initialStructure();
     bool visualInitialAlign();
     bool relativePose(Matrix3d &relative_R, Vector3d &relative_T, int &l);
@@ -81,9 +93,9 @@ class Estimator
     void getPoseInWorldFrame(int index, Eigen::Matrix4d &T);
     void predictPtsInNextFrame();
     void outliersRejection(set<int> &removeIndex);
-    double reprojectionError(Matrix3d &Ri, Vector3d &Pi, Matrix3d &rici, Vector3d &tici,
-                                     Matrix3d &Rj, Vector3d &Pj, Matrix3d &ricj, Vector3d &ticj, 
-                                     double depth, Vector3d &uvi, Vector3d &uvj);
+    //Average reprojection error of each feature over the window, in normalized units
+    void featureReprojectionErrors(const std::vector<FeaturePerId *> &features, std::vector<double> &ave_errs);
+    double reprojectionError(const Matrix3d &R_cj_w, const Vector3d &t_cj_w, const Vector3d &pts_w, const Vector3d &uvj);
     void updateLatestStates();
     void fastPredictIMU(double t, Eigen::Vector3d linear_acceleration, Eigen::Vector3d angular_velocity);
     bool IMUAvailable(double t);
@@ -131,14 +143,12 @@ class Estimator
 
     Matrix3d back_R0, last_R, last_R0;
     Vector3d back_P0, last_P, last_P0;
+    Vector3d last_V, last_Ba, last_Bg;
     double Headers[(WINDOW_SIZE + 1)];
 
     IntegrationBase *pre_integrations[(WINDOW_SIZE + 1)] = {0};
     Vector3d acc_0, gyr_0;
 
-    vector<double> dt_buf[(WINDOW_SIZE + 1)];
-    vector<Vector3d> linear_acceleration_buf[(WINDOW_SIZE + 1)];
-    vector<Vector3d> angular_velocity_buf[(WINDOW_SIZE + 1)];
 
     int frame_count;
     int sum_of_outlier, sum_of_back, sum_of_front, sum_of_invalid;
@@ -153,6 +163,12 @@ class Estimator
     bool first_imu;
     bool is_valid, is_key;
     bool failure_occur;
+    bool warm_restarting = false;
+    double warm_restart_time = 0;
+    bool snapshot_restored = false;
+    double last_snapshot_time = 0;
+    std::atomic<bool> snapshot_writing{false};
+    std::thread snapshot_thread;
 
     vector<Vector3d> point_cloud;
     vector<Vector3d> margin_cloud;
@@ -164,7 +180,6 @@ class Estimator
     double para_SpeedBias[WINDOW_SIZE + 1][SIZE_SPEEDBIAS];
     double para_Feature[NUM_OF_F][SIZE_FEATURE];
     std::vector<int> param_feature_id;
-    std::map<int, int> param_feature_id_to_index;
     double para_Ex_Pose[2][SIZE_POSE];
     double para_Retrive_Pose[SIZE_POSE];
     double para_Td[1][1];
@@ -197,6 +212,8 @@ class Estimator
 
     queue<std::vector<cv::Mat>> fisheye_imgs_upBuf;
     queue<std::vector<cv::Mat>> fisheye_imgs_downBuf;
-    queue<std::pair<double, EigenPose>> odometry_buf;
+    //Recent optimized poses and IMU propagated poses, for posing depth frames
+    std::deque<std::pair<double, EigenPose>> odometry_buf;
+    std::deque<std::pair<double, EigenPose>> imu_pose_buf;
 
 };
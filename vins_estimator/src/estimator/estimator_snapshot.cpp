@@ -0,0 +1,695 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "estimator.h"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Binary snapshot of the sliding window.
+//Layout: SnapshotHeader, then sections of SnapshotSection followed by the payload.
+//Every scalar is stored as 8 bytes (int64 or double) and sections are padded to 8 bytes, so
+//the file can be mapped and read in place. Bump SNAPSHOT_VERSION on any layout change.
+#define SNAPSHOT_MAGIC "VINSSNAP"
+#define SNAPSHOT_VERSION 2
+
+enum SnapshotSectionTag
+{
+    SNAPSHOT_STATE = 1,
+    SNAPSHOT_PRE_INTEGRATION = 2,
+    SNAPSHOT_IMAGE_FRAME = 3,
+    SNAPSHOT_FEATURE = 4,
+    SNAPSHOT_MARGINALIZATION = 5
+};
+
+//Parameter blocks of the marginalization prior are stored as which para_ array and index
+enum SnapshotParamBlock
+{
+    PARAM_POSE = 0,
+    PARAM_SPEED_BIAS = 1,
+    PARAM_EX_POSE = 2,
+    PARAM_TD = 3
+};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    int64_t version;
+    int64_t window_size;
+    int64_t num_cam;
+    int64_t size_pose;
+    int64_t size_speedbias;
+    double stamp;
+};
+
+struct SnapshotSection
+{
+    int64_t tag;
+    int64_t size;
+};
+
+class SnapshotWriter
+{
+  public:
+    template <typename T>
+    void put(const T &v)
+    {
+        static_assert(sizeof(T) == 8, "snapshot scalars are 8 bytes");
+        append(&v, sizeof(T));
+    }
+
+    void putInt(int64_t v) { put(v); }
+
+    template <typename Derived>
+    void putMat(const Eigen::MatrixBase<Derived> &m)
+    {
+        Eigen::Matrix<double, Derived::RowsAtCompileTime, Derived::ColsAtCompileTime> tmp = m;
+        append(tmp.data(), sizeof(double) * tmp.size());
+    }
+
+    void putDynamic(const Eigen::MatrixXd &m)
+    {
+        putInt(m.rows());
+        putInt(m.cols());
+        append(m.data(), sizeof(double) * m.size());
+    }
+
+    void append(const void *data, size_t size)
+    {
+        const char *p = static_cast<const char *>(data);
+        buf.insert(buf.end(), p, p + size);
+    }
+
+    void beginSection(int64_t tag)
+    {
+        section_begin = buf.size();
+        SnapshotSection section{tag, 0};
+        append(&section, sizeof(section));
+    }
+
+    void endSection()
+    {
+        buf.resize((buf.size() + 7) / 8 * 8, 0);
+        int64_t size = buf.size() - section_begin - sizeof(SnapshotSection);
+        memcpy(buf.data() + section_begin + offsetof(SnapshotSection, size), &size, sizeof(size));
+    }
+
+    std::vector<char> buf;
+
+  private:
+    size_t section_begin = 0;
+};
+
+class SnapshotReader
+{
+  public:
+    ~SnapshotReader()
+    {
+        if (data != nullptr)
+            munmap(data, length);
+    }
+
+    bool open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        length = st.st_size;
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        data = static_cast<char *>(p);
+        cur = data;
+        end = data + length;
+        return true;
+    }
+
+    bool read(void *dst, size_t size)
+    {
+        if (!ok || cur + size > end)
+        {
+            ok = false;
+            return false;
+        }
+        memcpy(dst, cur, size);
+        cur += size;
+        return true;
+    }
+
+    template <typename T>
+    T get()
+    {
+        T v{};
+        read(&v, sizeof(T));
+        return v;
+    }
+
+    int64_t getInt() { return get<int64_t>(); }
+
+    template <typename Derived>
+    void getMat(Eigen::MatrixBase<Derived> const &m)
+    {
+        Eigen::Matrix<double, Derived::RowsAtCompileTime, Derived::ColsAtCompileTime> tmp = 
+            Eigen::Matrix<double, Derived::RowsAtCompileTime, Derived::ColsAtCompileTime>::Zero();
+        read(tmp.data(), sizeof(double) * tmp.size());
+        const_cast<Eigen::MatrixBase<Derived> &>(m) = tmp;
+    }
+
+    void getDynamic(Eigen::MatrixXd &m)
+    {
+        int64_t rows = getInt(), cols = getInt();
+        if (!ok || rows < 0 || cols < 0 || (size_t)(rows * cols) * sizeof(double) > (size_t)(end - cur))
+        {
+            ok = false;
+            return;
+        }
+        m.resize(rows, cols);
+        read(m.data(), sizeof(double) * m.size());
+    }
+
+    bool beginSection(int64_t tag)
+    {
+        SnapshotSection section;
+        if (!read(&section, sizeof(section)) || section.tag != tag || section.size < 0 || cur + section.size > end)
+        {
+            ok = false;
+            return false;
+        }
+        section_end = cur + section.size;
+        return true;
+    }
+
+    bool endSection()
+    {
+        if (!ok || cur > section_end)
+        {
+            ok = false;
+            return false;
+        }
+        cur = section_end;
+        return true;
+    }
+
+    bool ok = true;
+
+  private:
+    char *data = nullptr;
+    size_t length = 0;
+    const char *cur = nullptr;
+    const char *end = nullptr;
+    const char *section_end = nullptr;
+};
+
+static void writePreIntegration(SnapshotWriter &w, const IntegrationBase *pre_integration)
+{
+    if (pre_integration == nullptr)
+    {
+        w.putInt(0);
+        return;
+    }
+    w.putInt(1);
+    w.putMat(pre_integration->linearized_acc);
+    w.putMat(pre_integration->linearized_gyr);
+    w.putMat(pre_integration->linearized_ba);
+    w.putMat(pre_integration->linearized_bg);
+    w.putMat(pre_integration->jacobian_ba);
+    w.putMat(pre_integration->jacobian_bg);
+    w.putMat(pre_integration->acc_0);
+    w.putMat(pre_integration->gyr_0);
+    w.put(pre_integration->sum_dt);
+    w.putMat(pre_integration->delta_p);
+    w.putMat(pre_integration->delta_q.coeffs());
+    w.putMat(pre_integration->delta_v);
+    w.putMat(pre_integration->jacobian);
+    w.putMat(pre_integration->covariance);
+    w.putInt(pre_integration->dt_buf.size());
+    for (size_t i = 0; i < pre_integration->dt_buf.size(); i++)
+    {
+        w.put(pre_integration->dt_buf[i]);
+        w.putMat(pre_integration->acc_buf[i]);
+        w.putMat(pre_integration->gyr_buf[i]);
+    }
+}
+
+//Integrated values are restored as saved instead of being reintegrated, so a first order
+//bias correction applied before the snapshot is kept exactly
+static IntegrationBase *readPreIntegration(SnapshotReader &r)
+{
+    if (r.getInt() == 0)
+        return nullptr;
+    Vector3d linearized_acc, linearized_gyr, linearized_ba, linearized_bg;
+    r.getMat(linearized_acc);
+    r.getMat(linearized_gyr);
+    r.getMat(linearized_ba);
+    r.getMat(linearized_bg);
+    IntegrationBase *pre_integration = new IntegrationBase{linearized_acc, linearized_gyr, linearized_ba, linearized_bg};
+    r.getMat(pre_integration->jacobian_ba);
+    r.getMat(pre_integration->jacobian_bg);
+    r.getMat(pre_integration->acc_0);
+    r.getMat(pre_integration->gyr_0);
+    pre_integration->sum_dt = r.get<double>();
+    r.getMat(pre_integration->delta_p);
+    r.getMat(pre_integration->delta_q.coeffs());
+    r.getMat(pre_integration->delta_v);
+    r.getMat(pre_integration->jacobian);
+    r.getMat(pre_integration->covariance);
+    int64_t num = r.getInt();
+    for (int64_t i = 0; i < num && r.ok; i++)
+    {
+        Vector3d acc, gyr;
+        double dt = r.get<double>();
+        r.getMat(acc);
+        r.getMat(gyr);
+        pre_integration->dt_buf.push_back(dt);
+        pre_integration->acc_buf.push_back(acc);
+        pre_integration->gyr_buf.push_back(gyr);
+    }
+    return pre_integration;
+}
+
+static bool paramBlockTag(Estimator &e, const double *addr, int64_t &kind, int64_t &index)
+{
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+    {
+        if (addr == e.para_Pose[i]) { kind = PARAM_POSE; index = i; return true; }
+        if (addr == e.para_SpeedBias[i]) { kind = PARAM_SPEED_BIAS; index = i; return true; }
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (addr == e.para_Ex_Pose[i]) { kind = PARAM_EX_POSE; index = i; return true; }
+    }
+    if (addr == e.para_Td[0]) { kind = PARAM_TD; index = 0; return true; }
+    return false;
+}
+
+static double *paramBlockAddr(Estimator &e, int64_t kind, int64_t index)
+{
+    if ((kind == PARAM_POSE || kind == PARAM_SPEED_BIAS) && (index < 0 || index > WINDOW_SIZE))
+        return nullptr;
+    switch (kind)
+    {
+        case PARAM_POSE: return e.para_Pose[index];
+        case PARAM_SPEED_BIAS: return e.para_SpeedBias[index];
+        case PARAM_EX_POSE: return (index >= 0 && index < 2) ? e.para_Ex_Pose[index] : nullptr;
+        case PARAM_TD: return index == 0 ? e.para_Td[0] : nullptr;
+    }
+    return nullptr;
+}
+
+//Write then rename so a crash never leaves a partial snapshot behind
+static bool writeSnapshotFile(const std::string &path, const std::vector<char> &buf)
+{
+    std::string tmp_path = path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == nullptr)
+    {
+        ROS_WARN("Snapshot: can't open %s", tmp_path.c_str());
+        return false;
+    }
+    bool written = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+    written = (fclose(fp) == 0) && written;
+    if (!written || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        ROS_WARN("Snapshot: failed to write %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+//Only serialization runs in the estimator thread, which is the only one modifying the window.
+//The file is written by a background thread; a snapshot due while the previous one is still
+//being written is skipped. The writer is joined before the next one starts, on clearState and
+//on destruction, so it never outlives the estimator
+bool Estimator::saveSnapshot(const std::string &path)
+{
+    if (snapshot_writing)
+        return false;
+
+    TicToc tic;
+    SnapshotWriter w;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.window_size = WINDOW_SIZE;
+    header.num_cam = NUM_OF_CAM;
+    header.size_pose = SIZE_POSE;
+    header.size_speedbias = SIZE_SPEEDBIAS;
+    header.stamp = Headers[frame_count];
+    w.append(&header, sizeof(header));
+
+    w.beginSection(SNAPSHOT_STATE);
+    w.putInt(frame_count);
+    w.putInt(solver_flag);
+    w.putInt(marginalization_flag);
+    w.put(td);
+    w.putMat(g);
+    w.put(prevTime);
+    w.putMat(acc_0);
+    w.putMat(gyr_0);
+    w.putInt(first_imu);
+    w.putInt(initFirstPoseFlag);
+    w.putInt(openExEstimation);
+    w.putInt(sum_of_back);
+    w.putInt(sum_of_front);
+    w.putInt(featureTracker != nullptr ? featureTracker->getNextFeatureId() : 0);
+    for (int i = 0; i < 2; i++)
+    {
+        w.putMat(ric[i]);
+        w.putMat(tic[i]);
+    }
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+    {
+        w.put(Headers[i]);
+        w.putMat(Ps[i]);
+        w.putMat(Vs[i]);
+        w.putMat(Rs[i]);
+        w.putMat(Bas[i]);
+        w.putMat(Bgs[i]);
+    }
+    w.putMat(last_R);
+    w.putMat(last_P);
+    w.putMat(last_V);
+    w.putMat(last_Ba);
+    w.putMat(last_Bg);
+    w.putMat(last_R0);
+    w.putMat(last_P0);
+    w.endSection();
+
+    w.beginSection(SNAPSHOT_PRE_INTEGRATION);
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+        writePreIntegration(w, pre_integrations[i]);
+    writePreIntegration(w, tmp_pre_integration);
+    w.endSection();
+
+    //Feature points of image frames are only used by initialization, which a snapshot never resumes
+    w.beginSection(SNAPSHOT_IMAGE_FRAME);
+    w.putInt(all_image_frame.size());
+    for (auto &it : all_image_frame)
+    {
+        auto &frame = it.second;
+        w.put(frame.t);
+        w.putMat(frame.R);
+        w.putMat(frame.T);
+        w.putInt(frame.is_key_frame);
+        writePreIntegration(w, frame.pre_integration);
+    }
+    w.endSection();
+
+    w.beginSection(SNAPSHOT_FEATURE);
+    w.putInt(f_manager.feature.size());
+    for (auto &it : f_manager.feature)
+    {
+        auto &it_per_id = it.second;
+        w.putInt(it_per_id.feature_id);
+        w.putInt(it_per_id.start_frame);
+        w.putInt(it_per_id.main_cam);
+        w.put(it_per_id.estimated_depth);
+        w.putInt(it_per_id.depth_inited);
+        w.putInt(it_per_id.need_triangulation);
+        w.putInt(it_per_id.is_stereo);
+        w.putInt(it_per_id.solve_flag);
+        w.putInt(it_per_id.good_for_solving);
+        w.putInt(it_per_id.feature_per_frame.size());
+        for (auto &it_per_frame : it_per_id.feature_per_frame)
+        {
+            w.put(it_per_frame.cur_td);
+            w.putMat(it_per_frame.point);
+            w.putMat(it_per_frame.pointRight);
+            w.putMat(it_per_frame.uv);
+            w.putMat(it_per_frame.uvRight);
+            w.putMat(it_per_frame.velocity);
+            w.putMat(it_per_frame.velocityRight);
+            w.putInt(it_per_frame.is_stereo);
+            w.putInt(it_per_frame.camera);
+        }
+    }
+    w.putInt(f_manager.outlier_features.size());
+    for (int _id : f_manager.outlier_features)
+        w.putInt(_id);
+    w.endSection();
+
+    w.beginSection(SNAPSHOT_MARGINALIZATION);
+    MarginalizationInfo *info = last_marginalization_info;
+    if (info == nullptr)
+    {
+        w.putInt(0);
+    }
+    else
+    {
+        w.putInt(1);
+        w.putInt(info->m);
+        w.putInt(info->n);
+        w.putInt(info->sum_block_size);
+        w.putInt(info->valid);
+        w.putDynamic(info->linearized_jacobians);
+        w.putDynamic(info->linearized_residuals);
+        w.putInt(last_marginalization_parameter_blocks.size());
+        for (size_t i = 0; i < last_marginalization_parameter_blocks.size(); i++)
+        {
+            int64_t kind, index;
+            if (!paramBlockTag(*this, last_marginalization_parameter_blocks[i], kind, index))
+            {
+                ROS_WARN("Snapshot: unknown parameter block in marginalization prior, not saved");
+                return false;
+            }
+            int size = info->keep_block_size[i];
+            w.putInt(kind);
+            w.putInt(index);
+            w.putInt(size);
+            w.putInt(info->keep_block_idx[i]);
+            w.append(info->keep_block_data[i], sizeof(double) * size);
+        }
+    }
+    w.endSection();
+
+    if (ENABLE_PERF_OUTPUT)
+    {
+        ROS_INFO("Snapshot %ld bytes serialized cost %fms", w.buf.size(), tic.toc());
+    }
+
+    waitSnapshot();
+    snapshot_writing = true;
+    snapshot_thread = std::thread([this, path](std::vector<char> buf) {
+        writeSnapshotFile(path, buf);
+        snapshot_writing = false;
+    }, std::move(w.buf));
+    return true;
+}
+
+void Estimator::waitSnapshot()
+{
+    if (snapshot_thread.joinable())
+        snapshot_thread.join();
+}
+
+bool Estimator::loadSnapshot(const std::string &path)
+{
+    TicToc tic;
+    SnapshotReader r;
+    if (!r.open(path))
+    {
+        ROS_WARN("Snapshot: can't open %s", path.c_str());
+        return false;
+    }
+
+    SnapshotHeader header;
+    if (!r.read(&header, sizeof(header)) || memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+    {
+        ROS_WARN("Snapshot: %s is not a snapshot", path.c_str());
+        return false;
+    }
+    if (header.version != SNAPSHOT_VERSION || header.window_size != WINDOW_SIZE || header.num_cam != NUM_OF_CAM ||
+        header.size_pose != SIZE_POSE || header.size_speedbias != SIZE_SPEEDBIAS)
+    {
+        ROS_WARN("Snapshot: version %ld window %ld cams %ld does not match this build",
+            header.version, header.window_size, header.num_cam);
+        return false;
+    }
+
+    clearState();
+
+    r.beginSection(SNAPSHOT_STATE);
+    frame_count = r.getInt();
+    solver_flag = (SolverFlag) r.getInt();
+    marginalization_flag = (MarginalizationFlag) r.getInt();
+    td = r.get<double>();
+    r.getMat(g);
+    prevTime = r.get<double>();
+    r.getMat(acc_0);
+    r.getMat(gyr_0);
+    first_imu = r.getInt();
+    initFirstPoseFlag = r.getInt();
+    openExEstimation = r.getInt();
+    sum_of_back = r.getInt();
+    sum_of_front = r.getInt();
+    int next_feature_id = r.getInt();
+    for (int i = 0; i < 2; i++)
+    {
+        r.getMat(ric[i]);
+        r.getMat(tic[i]);
+    }
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+    {
+        Headers[i] = r.get<double>();
+        r.getMat(Ps[i]);
+        r.getMat(Vs[i]);
+        r.getMat(Rs[i]);
+        r.getMat(Bas[i]);
+        r.getMat(Bgs[i]);
+    }
+    r.getMat(last_R);
+    r.getMat(last_P);
+    r.getMat(last_V);
+    r.getMat(last_Ba);
+    r.getMat(last_Bg);
+    r.getMat(last_R0);
+    r.getMat(last_P0);
+    r.endSection();
+
+    r.beginSection(SNAPSHOT_PRE_INTEGRATION);
+    for (int i = 0; i < WINDOW_SIZE + 1; i++)
+        pre_integrations[i] = readPreIntegration(r);
+    tmp_pre_integration = readPreIntegration(r);
+    r.endSection();
+
+    r.beginSection(SNAPSHOT_IMAGE_FRAME);
+    int64_t num_frames = r.getInt();
+    for (int64_t i = 0; i < num_frames && r.ok; i++)
+    {
+        ImageFrame frame;
+        frame.t = r.get<double>();
+        r.getMat(frame.R);
+        r.getMat(frame.T);
+        frame.is_key_frame = r.getInt();
+        frame.pre_integration = readPreIntegration(r);
+        all_image_frame.insert(make_pair(frame.t, frame));
+    }
+    r.endSection();
+
+    r.beginSection(SNAPSHOT_FEATURE);
+    int64_t num_features = r.getInt();
+    for (int64_t i = 0; i < num_features && r.ok; i++)
+    {
+        int feature_id = r.getInt();
+        int start_frame = r.getInt();
+        auto &it_per_id = f_manager.feature.emplace(feature_id, FeaturePerId(feature_id, start_frame)).first->second;
+        it_per_id.main_cam = r.getInt();
+        it_per_id.estimated_depth = r.get<double>();
+        it_per_id.depth_inited = r.getInt();
+        it_per_id.need_triangulation = r.getInt();
+        it_per_id.is_stereo = r.getInt();
+        it_per_id.solve_flag = r.getInt();
+        it_per_id.good_for_solving = r.getInt();
+        int64_t num_obs = r.getInt();
+        for (int64_t k = 0; k < num_obs && r.ok; k++)
+        {
+            FeaturePerFrame it_per_frame(TrackFeatureNoId::Zero(), 0);
+            it_per_frame.cur_td = r.get<double>();
+            r.getMat(it_per_frame.point);
+            r.getMat(it_per_frame.pointRight);
+            r.getMat(it_per_frame.uv);
+            r.getMat(it_per_frame.uvRight);
+            r.getMat(it_per_frame.velocity);
+            r.getMat(it_per_frame.velocityRight);
+            it_per_frame.is_stereo = r.getInt();
+            it_per_frame.camera = r.getInt();
+            it_per_id.feature_per_frame.push_back(it_per_frame);
+        }
+        it_per_id.used_num = it_per_id.feature_per_frame.size();
+    }
+    int64_t num_outliers = r.getInt();
+    for (int64_t i = 0; i < num_outliers && r.ok; i++)
+        f_manager.outlier_features.insert(r.getInt());
+    r.endSection();
+
+    r.beginSection(SNAPSHOT_MARGINALIZATION);
+    if (r.getInt() != 0)
+    {
+        MarginalizationInfo *info = new MarginalizationInfo();
+        last_marginalization_info = info;
+        info->m = r.getInt();
+        info->n = r.getInt();
+        info->sum_block_size = r.getInt();
+        info->valid = r.getInt();
+        r.getDynamic(info->linearized_jacobians);
+        Eigen::MatrixXd residuals;
+        r.getDynamic(residuals);
+        if (residuals.cols() == 1)
+            info->linearized_residuals = residuals;
+        else
+            r.ok = false;
+        int64_t num_blocks = r.getInt();
+        for (int64_t i = 0; i < num_blocks && r.ok; i++)
+        {
+            int64_t kind = r.getInt(), index = r.getInt();
+            int size = r.getInt();
+            int idx = r.getInt();
+            double *addr = paramBlockAddr(*this, kind, index);
+            if (addr == nullptr || size <= 0 || size > SIZE_POSE)
+            {
+                r.ok = false;
+                break;
+            }
+            double *data = new double[size];
+            r.read(data, sizeof(double) * size);
+            info->parameter_block_size[reinterpret_cast<long>(addr)] = size;
+            info->parameter_block_idx[reinterpret_cast<long>(addr)] = idx;
+            info->parameter_block_data[reinterpret_cast<long>(addr)] = data;
+            info->keep_block_size.push_back(size);
+            info->keep_block_idx.push_back(idx);
+            info->keep_block_data.push_back(data);
+            last_marginalization_parameter_blocks.push_back(addr);
+        }
+    }
+    r.endSection();
+
+    if (!r.ok || frame_count < 0 || frame_count > WINDOW_SIZE)
+    {
+        ROS_WARN("Snapshot: %s is truncated or corrupted", path.c_str());
+        //clearState frees the window, the prior and tmp_pre_integration, but not the image frames,
+        //whose preintegrations were allocated separately here
+        for (auto &it : all_image_frame)
+        {
+            delete it.second.pre_integration;
+            it.second.pre_integration = nullptr;
+        }
+        clearState();
+        for (int i = 0; i < NUM_OF_CAM; i++)
+        {
+            tic[i] = TIC[i];
+            ric[i] = RIC[i];
+        }
+        td = TD;
+        g = G;
+        return false;
+    }
+
+    f_manager.setRic(ric);
+    if (featureTracker != nullptr)
+        featureTracker->setNextFeatureId(next_feature_id);
+    //No IMU has arrived yet, the fast propagation restarts after the first optimization
+    snapshot_restored = true;
+
+    ROS_INFO("Snapshot %s restored at %f with %ld features cost %fms",
+        path.c_str(), header.stamp, f_manager.feature.size(), tic.toc());
+    return true;
+}
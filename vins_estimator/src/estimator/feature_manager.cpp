@@ -9,6 +9,13 @@
 
 #include "feature_manager.h"
 
+//Score and buckets of feature selection for solving
+#define SELECT_STEREO_SCORE 3.0
+#define SELECT_PARALLAX_SCORE 1.0
+#define SELECT_MAX_PARALLAX_DEG 5.0
+#define SELECT_AZIMUTH_BINS 8
+#define SELECT_ELEVATION_BINS 4
+
 int FeaturePerId::endFrame()
 {
     return start_frame + feature_per_frame.size() - 1;
@@ -94,6 +101,7 @@ bool FeatureManager::addFeatureCheckParallax(int frame_count, const FeatureFrame
             new_feature_num++;
         } else {
             feature[feature_id].feature_per_frame.push_back(f_per_fra);
+            feature[feature_id].tri_cached = false;
             last_track_num++;
             if( feature[feature_id].feature_per_frame.size() >= 4)
                 long_track_num++;
@@ -156,7 +164,7 @@ vector<pair<Vector3d, Vector3d>> FeatureManager::getCorresponding(int frame_coun
     return corres;
 }
 
-void FeatureManager::setDepth(std::map<int, double> deps)
+void FeatureManager::setDepth(const std::vector<std::pair<int, double>> &deps)
 {
     for (auto &it : deps)
     {
@@ -168,6 +176,7 @@ void FeatureManager::setDepth(std::map<int, double> deps)
 
         it_per_id.estimated_depth = 1.0 / depth;
         it_per_id.need_triangulation = false;
+        it_per_id.tri_cached = false;
         it_per_id.depth_inited = true;
         //ROS_INFO("feature id %d , start_frame %d, depth %f ", it_per_id->feature_id, it_per_id-> start_frame, it_per_id->estimated_depth);
         if (it_per_id.estimated_depth < 0)
@@ -200,41 +209,103 @@ void FeatureManager::clearDepth()
         auto & it_per_id = _it.second;
         it_per_id.estimated_depth = -1;
         it_per_id.depth_inited = false;
+        it_per_id.tri_cached = false;
         it_per_id.good_for_solving = false;
     }
 }
 
-std::map<int, double> FeatureManager::getDepthVector()
+double FeatureManager::solvingScore(const FeaturePerId &it_per_id) const
+{
+    //Long tracks and stereo constrain depth better; parallax is the rotation compensated angle
+    //between bearings of first and last observation
+    const auto & first = it_per_id.feature_per_frame.front();
+    const auto & last = it_per_id.feature_per_frame.back();
+    Vector3d bearing0 = Rs[it_per_id.start_frame] * ric[first.camera] * first.point.normalized();
+    Vector3d bearing1 = Rs[it_per_id.start_frame + it_per_id.feature_per_frame.size() - 1] * ric[last.camera] * last.point.normalized();
+    double parallax = acos(std::min(1.0, std::max(-1.0, bearing0.dot(bearing1)))) * 180 / M_PI;
+
+    return std::min(it_per_id.used_num, WINDOW_SIZE) + 
+        (it_per_id.is_stereo ? SELECT_STEREO_SCORE : 0) + 
+        std::min(parallax, SELECT_MAX_PARALLAX_DEG) * SELECT_PARALLAX_SCORE;
+}
+
+int FeatureManager::bearingBucket(const FeaturePerId &it_per_id) const
 {
-    //This function gives actually points for solving; We only use oldest max_solve_cnt point, oldest pts has good track
+    //Bucket of azimuth and elevation of first observation in body frame, covers both fisheye hemispheres
+    const auto & first = it_per_id.feature_per_frame.front();
+    Vector3d bearing = ric[first.camera] * first.point.normalized();
+    double azimuth = atan2(bearing.y(), bearing.x()) + M_PI;
+    double elevation = asin(std::min(1.0, std::max(-1.0, bearing.z()))) + M_PI / 2;
+    int a = std::min((int)(azimuth / (2 * M_PI) * SELECT_AZIMUTH_BINS), SELECT_AZIMUTH_BINS - 1);
+    int e = std::min((int)(elevation / M_PI * SELECT_ELEVATION_BINS), SELECT_ELEVATION_BINS - 1);
+    return e * SELECT_AZIMUTH_BINS + a;
+}
+
+std::vector<std::pair<int, double>> FeatureManager::getDepthVector()
+{
+    //This function gives actually points for solving. At most MAX_SOLVE_CNT points are used, they are
+    //taken round robin from bearing buckets, best score first in each bucket, so points are spread
+    //around the body instead of concentrated where oldest ids are.
     //As for some feature point not solve all the time; we do re triangulate on it
-    std::map<int, double> dep_vec;
+    TicToc tic;
+    int max_solve_cnt = std::min(MAX_SOLVE_CNT, NUM_OF_F);
+    std::vector<std::vector<std::pair<double, FeaturePerId *>>> buckets(SELECT_AZIMUTH_BINS * SELECT_ELEVATION_BINS);
     for (auto &_it : feature) {
         auto & it_per_id = _it.second;
         it_per_id.used_num = it_per_id.feature_per_frame.size();
+        it_per_id.need_triangulation = true;
         bool id_in_outouliers = outlier_features.find(it_per_id.feature_id) != outlier_features.end();
 
-        if(it_per_id.is_stereo && it_per_id.used_num >= 2 && dep_vec.size() < MAX_SOLVE_CNT &&  it_per_id.good_for_solving && !id_in_outouliers) {
-            dep_vec[it_per_id.feature_id] = 1. / it_per_id.estimated_depth;
-            ft->setFeatureStatus(it_per_id.feature_id, 3);
-        } else {
-            it_per_id.need_triangulation = true;
+        if (it_per_id.good_for_solving && !id_in_outouliers && 
+            ((it_per_id.is_stereo && it_per_id.used_num >= 2) || it_per_id.used_num >= 4)) {
+            buckets[bearingBucket(it_per_id)].emplace_back(solvingScore(it_per_id), &it_per_id);
         }
     }
-    for (auto &_it : feature) {
-        auto & it_per_id = _it.second;
-        it_per_id.used_num = it_per_id.feature_per_frame.size();
-        bool id_in_outouliers = outlier_features.find(it_per_id.feature_id) != outlier_features.end();
 
-        if(dep_vec.size() < MAX_SOLVE_CNT && it_per_id.used_num >= 4 
-            && it_per_id.good_for_solving && !id_in_outouliers) {
-            dep_vec[it_per_id.feature_id] = 1. / it_per_id.estimated_depth;
+    //Round robin takes at most the best `rounds` of each bucket, so buckets are only partitioned in linear
+    //time instead of sorted. The worst of them is placed at rank rounds - 1 for the partial last round.
+    size_t rounds = 0;
+    int selected = 0;
+    while (selected < max_solve_cnt) {
+        int taken = 0;
+        for (auto & bucket : buckets) {
+            taken += bucket.size() > rounds;
+        }
+        if (taken == 0) {
+            break;
+        }
+        selected += taken;
+        rounds ++;
+    }
+    for (auto & bucket : buckets) {
+        if (rounds > 0 && bucket.size() >= rounds) {
+            std::nth_element(bucket.begin(), bucket.begin() + rounds - 1, bucket.end(),
+                [](const std::pair<double, FeaturePerId *> & a, const std::pair<double, FeaturePerId *> & b) {
+                    return a.first > b.first;
+                });
+        }
+    }
+
+    std::vector<std::pair<int, double>> dep_vec;
+    dep_vec.reserve(max_solve_cnt);
+    for (size_t rank = 0; rank < rounds && (int) dep_vec.size() < max_solve_cnt; rank++) {
+        for (auto & bucket : buckets) {
+            if (rank >= bucket.size()) {
+                continue;
+            }
+            auto & it_per_id = *bucket[rank].second;
+            dep_vec.emplace_back(it_per_id.feature_id, 1. / it_per_id.estimated_depth);
+            it_per_id.need_triangulation = false;
             ft->setFeatureStatus(it_per_id.feature_id, 3);
-        } else {
-            it_per_id.need_triangulation = true;
+            if ((int) dep_vec.size() >= max_solve_cnt) {
+                break;
+            }
         }
     }
 
+    if (ENABLE_PERF_OUTPUT) {
+        ROS_INFO("Select %ld features for solving cost %fms", dep_vec.size(), tic.toc());
+    }
     return dep_vec;
 }
 
@@ -402,6 +473,35 @@ void FeatureManager::initFramePoseByPnP(int frameCnt, Vector3d Ps[], Matrix3d Rs
 
 void FeatureManager::triangulate(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[])
 {
+    TicToc t_tri;
+    //Camera poses of the window are shared by all features; a feature keeps its last result when
+    //its observations and the poses of frames observing it are unchanged since, which is the case
+    //for most features while initialization only appends frames
+    Eigen::Matrix<double, 3, 4> cam_poses[WINDOW_SIZE + 1][2];
+    Eigen::Vector3d cam_centers[WINDOW_SIZE + 1][2];
+    bool pose_same[WINDOW_SIZE + 1];
+    bool extrinsic_same = true;
+    for (int c = 0; c < 2; c++) {
+        extrinsic_same = extrinsic_same && tri_tic[c] == tic[c] && tri_ric[c] == ric[c];
+        tri_tic[c] = tic[c];
+        tri_ric[c] = ric[c];
+    }
+    for (int i = 0; i < WINDOW_SIZE + 1; i++) {
+        pose_same[i] = tri_Ps[i] == Ps[i] && tri_Rs[i] == Rs[i];
+        tri_Ps[i] = Ps[i];
+        tri_Rs[i] = Rs[i];
+        for (int c = 0; c < 2; c++) {
+            Eigen::Vector3d t0 = Ps[i] + Rs[i] * tic[c];
+            Eigen::Matrix3d R0 = Rs[i] * ric[c];
+            cam_centers[i][c] = t0;
+            cam_poses[i][c].leftCols<3>() = R0.transpose();
+            cam_poses[i][c].rightCols<1>() = -R0.transpose() * t0;
+        }
+    }
+
+    std::vector<FeaturePerId *> todo;
+    todo.reserve(feature.size());
+    int cached = 0;
     for (auto &_it : feature) {
         auto & it_per_id = _it.second;
         //Only solving point dnot re-triangulate
@@ -413,106 +513,116 @@ void FeatureManager::triangulate(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vec
             ft->setFeatureStatus(it_per_id.feature_id, -1);
             continue;
         }
-
-        int main_cam_id = it_per_id.main_cam;
-
-        std::vector<Eigen::Matrix<double, 3, 4>> poses;
-        std::vector<Eigen::Vector3d> ptss;
-        Eigen::Matrix<double, 3, 4> origin_pose;
-        auto t0 = Ps[it_per_id.start_frame] + Rs[it_per_id.start_frame] * tic[main_cam_id];
-        auto R0 = Rs[it_per_id.start_frame] * ric[main_cam_id];
-        origin_pose.leftCols<3>() = R0.transpose();
-        origin_pose.rightCols<1>() = -R0.transpose() * t0;
-        bool has_stereo = false;
-
-        Eigen::Vector3d _min = t0;
-        Eigen::Vector3d _max = t0;
-
-        for (unsigned int frame = 0; frame < it_per_id.feature_per_frame.size(); frame ++) {
-            int imu_i = it_per_id.start_frame + frame;
-            Eigen::Matrix<double, 3, 4> leftPose;
-            Eigen::Vector3d t0 = Ps[imu_i] + Rs[imu_i] * tic[main_cam_id];
-            _max.x() = max(t0.x(), _max.x());
-            _max.y() = max(t0.y(), _max.y());
-            _max.z() = max(t0.z(), _max.z());
-            
-            _min.x() = min(t0.x(), _min.x());
-            _min.y() = min(t0.y(), _min.y());
-            _min.z() = min(t0.z(), _min.z());
-
-            Eigen::Matrix3d R0 = Rs[imu_i] * ric[main_cam_id];
-            leftPose.leftCols<3>() = R0.transpose();
-            leftPose.rightCols<1>() = -R0.transpose() * t0;
-            Eigen::Vector3d point0 = it_per_id.feature_per_frame[frame].point;
-
-            poses.push_back(leftPose);
-            ptss.push_back(point0);
-
-            if(STEREO && it_per_id.feature_per_frame[frame].is_stereo) {
-                //Secondary cam must be 1 now
-                has_stereo = true;
-                Eigen::Matrix<double, 3, 4> rightPose;
-                Eigen::Vector3d t1 = Ps[imu_i] + Rs[imu_i] * tic[1];
-                Eigen::Matrix3d R1 = Rs[imu_i] * ric[1];
-                rightPose.leftCols<3>() = R1.transpose();
-                rightPose.rightCols<1>() = -R1.transpose() * t1;
-                auto point1 = it_per_id.feature_per_frame[frame].pointRight;
-                poses.push_back(rightPose);
-                ptss.push_back(point1);
-
-                _max.x() = max(t1.x(), _max.x());
-                _max.y() = max(t1.y(), _max.y());
-                _max.z() = max(t1.z(), _max.z());
-                
-                _min.x() = min(t1.x(), _min.x());
-                _min.y() = min(t1.y(), _min.y());
-                _min.z() = min(t1.z(), _min.z());
+        if (it_per_id.tri_cached && extrinsic_same) {
+            bool same = true;
+            for (unsigned int frame = 0; frame < it_per_id.feature_per_frame.size() && same; frame ++) {
+                same = pose_same[it_per_id.start_frame + frame];
             }
-        }
-
-        if (!has_stereo) {
-            //We need calculate baseline
-            it_per_id.is_stereo = false;
-            if ((_max - _min).norm() < depth_estimate_baseline) {
+            if (same) {
+                cached ++;
                 continue;
             }
-        } else {
-            it_per_id.is_stereo = true;
         }
+        todo.push_back(&it_per_id);
+    }
 
-        if (poses.size() < 2) {
-            //No enough information
-            continue;
+    std::vector<int> status(todo.size(), 0);
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int k = 0; k < (int)todo.size(); k++) {
+        status[k] = triangulateFeature(*todo[k], cam_poses, cam_centers);
+    }
+
+    //Tracker status is not thread safe
+    for (unsigned int k = 0; k < todo.size(); k++) {
+        if (status[k] != 0) {
+            ft->setFeatureStatus(todo[k]->feature_id, status[k]);
         }
+    }
 
-        Eigen::Vector3d point3d;
-        double err = triangulatePoint3DPts(poses, ptss, point3d)*FOCAL_LENGTH;
-        Eigen::Vector3d localPoint = origin_pose.leftCols<3>() * point3d + origin_pose.rightCols<1>();
-        if (err > triangulate_max_err) {
-            // ROS_WARN("Feature ID %d CAM %d IS stereo %d poses %ld dep %d %f AVG ERR: %f", 
-            //     it_per_id.feature_id, 
-            //     it_per_id.main_cam,
-            //     it_per_id.feature_per_frame[0].is_stereo,
-            //     poses.size(),
-            //     it_per_id.depth_inited, it_per_id.estimated_depth, err);
-            ft->setFeatureStatus(it_per_id.feature_id, 2);
-            it_per_id.good_for_solving = false;
-            it_per_id.depth_inited = false;
-            it_per_id.need_triangulation = true;
-            //it_per_id.estimated_depth = localPoint.norm();
-        } else {
-            if (it_per_id.feature_per_frame.size() >= 4) {
-                ft->setFeatureStatus(it_per_id.feature_id, 1);            
-            }
-            it_per_id.depth_inited = true;
-            it_per_id.good_for_solving = true;
-            it_per_id.estimated_depth = localPoint.norm();
-            if (!has_stereo && (_max - _min).norm() < depth_estimate_baseline) {
-                it_per_id.estimated_depth = INIT_DEPTH;
-            }
+    if (ENABLE_PERF_OUTPUT) {
+        ROS_INFO("Triangulate %ld features, %d cached, cost %fms", todo.size(), cached, t_tri.toc());
+    }
+}
+
+int FeatureManager::triangulateFeature(FeaturePerId &it_per_id, const Eigen::Matrix<double, 3, 4> cam_poses[][2], 
+        const Eigen::Vector3d cam_centers[][2])
+{
+    int status = 0;
+    it_per_id.tri_cached = true;
+    int main_cam_id = it_per_id.main_cam;
+
+    std::vector<Eigen::Matrix<double, 3, 4>> poses;
+    std::vector<Eigen::Vector3d> ptss;
+    poses.reserve(it_per_id.feature_per_frame.size() * 2);
+    ptss.reserve(it_per_id.feature_per_frame.size() * 2);
+    const Eigen::Matrix<double, 3, 4> & origin_pose = cam_poses[it_per_id.start_frame][main_cam_id];
+    bool has_stereo = false;
+
+    Eigen::Vector3d _min = cam_centers[it_per_id.start_frame][main_cam_id];
+    Eigen::Vector3d _max = _min;
+
+    for (unsigned int frame = 0; frame < it_per_id.feature_per_frame.size(); frame ++) {
+        int imu_i = it_per_id.start_frame + frame;
+        _max = _max.cwiseMax(cam_centers[imu_i][main_cam_id]);
+        _min = _min.cwiseMin(cam_centers[imu_i][main_cam_id]);
+
+        poses.push_back(cam_poses[imu_i][main_cam_id]);
+        ptss.push_back(it_per_id.feature_per_frame[frame].point);
+
+        if(STEREO && it_per_id.feature_per_frame[frame].is_stereo) {
+            //Secondary cam must be 1 now
+            has_stereo = true;
+            poses.push_back(cam_poses[imu_i][1]);
+            ptss.push_back(it_per_id.feature_per_frame[frame].pointRight);
+
+            _max = _max.cwiseMax(cam_centers[imu_i][1]);
+            _min = _min.cwiseMin(cam_centers[imu_i][1]);
+        }
+    }
+
+    if (!has_stereo) {
+        //We need calculate baseline
+        it_per_id.is_stereo = false;
+        if ((_max - _min).norm() < depth_estimate_baseline) {
+            return status;
+        }
+    } else {
+        it_per_id.is_stereo = true;
+    }
+
+    if (poses.size() < 2) {
+        //No enough information
+        return status;
+    }
+
+    Eigen::Vector3d point3d;
+    double err = triangulatePoint3DPts(poses, ptss, point3d)*FOCAL_LENGTH;
+    Eigen::Vector3d localPoint = origin_pose.leftCols<3>() * point3d + origin_pose.rightCols<1>();
+    if (err > triangulate_max_err) {
+        // ROS_WARN("Feature ID %d CAM %d IS stereo %d poses %ld dep %d %f AVG ERR: %f", 
+        //     it_per_id.feature_id, 
+        //     it_per_id.main_cam,
+        //     it_per_id.feature_per_frame[0].is_stereo,
+        //     poses.size(),
+        //     it_per_id.depth_inited, it_per_id.estimated_depth, err);
+        status = 2;
+        it_per_id.good_for_solving = false;
+        it_per_id.depth_inited = false;
+        it_per_id.need_triangulation = true;
+        //it_per_id.estimated_depth = localPoint.norm();
+    } else {
+        if (it_per_id.feature_per_frame.size() >= 4) {
+            status = 1;
+        }
+        it_per_id.depth_inited = true;
+        it_per_id.good_for_solving = true;
+        it_per_id.estimated_depth = localPoint.norm();
+        if (!has_stereo && (_max - _min).norm() < depth_estimate_baseline) {
+            it_per_id.estimated_depth = INIT_DEPTH;
         }
-        // ROS_INFO("Pt3d %f %f %f LocalPt %f %f %f", point3d.x(), point3d.y(), point3d.z(), localPoint.x(), localPoint.y(), localPoint.z());
     }
+    // ROS_INFO("Pt3d %f %f %f LocalPt %f %f %f", point3d.x(), point3d.y(), point3d.z(), localPoint.x(), localPoint.y(), localPoint.z());
+    return status;
 }
 
 void FeatureManager::removeOutlier(set<int> &outlierIndex)
@@ -541,6 +651,7 @@ void FeatureManager::removeBackShiftDepth(Eigen::Matrix3d marg_R, Eigen::Vector3
     {
         auto & it = _it->second; 
         it_next++;
+        it.tri_cached = false;
 
         if (it.start_frame != 0)
             it.start_frame--;
@@ -590,6 +701,7 @@ void FeatureManager::removeBack()
          it != feature.end(); it = it_next)
     {
         it_next++;
+        it->second.tri_cached = false;
 
         if (it->second.start_frame != 0)
             it->second.start_frame--;
@@ -609,6 +721,7 @@ void FeatureManager::removeFront(int frame_count)
     for (auto it = feature.begin(), it_next = feature.begin(); it != feature.end(); it = it_next)
     {
         it_next++;
+        it->second.tri_cached = false;
 
         if (it->second.start_frame == frame_count)
         {
@@ -80,6 +80,8 @@ class FeaturePerId
     int solve_flag = 0; // 0 haven't solve yet; 1 solve succ; 2 solve fail;
     bool good_for_solving = false;
     int main_cam = 0;
+    //Triangulation result is valid for current observations
+    bool tri_cached = false;
 
     FeaturePerId(int _feature_id, int _start_frame)
         : feature_id(_feature_id), start_frame(_start_frame),
@@ -106,10 +108,11 @@ class FeatureManager
     bool addFeatureCheckParallax(int frame_count, const FeatureFrame &image, double td);
     vector<pair<Vector3d, Vector3d>> getCorresponding(int frame_count_l, int frame_count_r);
     //void updateDepth(const VectorXd &x);
-    void setDepth(std::map<int, double> deps);
+    void setDepth(const std::vector<std::pair<int, double>> &deps);
     void removeFailures();
     void clearDepth();
-    std::map<int, double> getDepthVector();
+    //Feature id and inverse depth of features selected for solving
+    std::vector<std::pair<int, double>> getDepthVector();
     void triangulate(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[]);
     void triangulatePoint(Eigen::Matrix<double, 3, 4> &Pose0, Eigen::Matrix<double, 3, 4> &Pose1,
                             Eigen::Vector2d &point0, Eigen::Vector2d &point1, Eigen::Vector3d &point_3d);
@@ -133,8 +136,17 @@ class FeatureManager
 
   private:
     double compensatedParallax2(const FeaturePerId &it_per_id, int frame_count);
+    double solvingScore(const FeaturePerId &it_per_id) const;
+    int bearingBucket(const FeaturePerId &it_per_id) const;
+    int triangulateFeature(FeaturePerId &it_per_id, const Eigen::Matrix<double, 3, 4> cam_poses[][2], 
+        const Eigen::Vector3d cam_centers[][2]);
     const Matrix3d *Rs;
     Matrix3d ric[2];
+    //Window and extrinsic of last triangulation
+    Vector3d tri_Ps[WINDOW_SIZE + 1];
+    Matrix3d tri_Rs[WINDOW_SIZE + 1];
+    Vector3d tri_tic[2];
+    Matrix3d tri_ric[2];
 };
 
 #endif
\ No newline at end of file
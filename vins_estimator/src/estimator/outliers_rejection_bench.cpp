@@ -0,0 +1,156 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Check and timing of the reprojection errors of outlier rejection on a random window of
+//1000 features, half of the observations stereo. Errors are compared with the per
+//observation transform of each frame pair the rejection used before, and timed on one thread and
+//on all threads. Returns non-zero on failure.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <omp.h>
+#include "estimator.h"
+
+#define BENCH_FEATURES 1000
+#define BENCH_ITERATIONS 200
+//Max difference of the average error in normalized units
+#define CHECK_TOLERANCE 1e-12
+
+static std::mt19937 rng(0);
+
+static double uniform(double lo, double hi)
+{
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static Vector3d randomVector(double scale)
+{
+    return Vector3d(uniform(-scale, scale), uniform(-scale, scale), uniform(-scale, scale));
+}
+
+static Matrix3d randomRotation(double angle)
+{
+    return AngleAxisd(uniform(-angle, angle), randomVector(1.0).normalized()).toRotationMatrix();
+}
+
+//Error of one observation from the state, transforming the point through both frames
+static double referenceError(const Estimator &estimator, int imu_i, int cam_i, int imu_j, int cam_j,
+                             double depth, const Vector3d &uvi, const Vector3d &uvj)
+{
+    Vector3d pts_w = estimator.Rs[imu_i] * (estimator.ric[cam_i] * (depth * uvi) + estimator.tic[cam_i]) + estimator.Ps[imu_i];
+    Vector3d pts_cj = estimator.ric[cam_j].transpose() * (estimator.Rs[imu_j].transpose() * (pts_w - estimator.Ps[imu_j]) - estimator.tic[cam_j]);
+    return (pts_cj.normalized() - uvj).norm();
+}
+
+static double referenceAverageError(const Estimator &estimator, const FeaturePerId &it_per_id)
+{
+    double err = 0;
+    int errCnt = 0;
+    int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
+    const Vector3d &pts_i = it_per_id.feature_per_frame[0].point;
+    for (auto &it_per_frame : it_per_id.feature_per_frame)
+    {
+        imu_j++;
+        if (imu_i != imu_j)
+        {
+            err += referenceError(estimator, imu_i, it_per_id.main_cam, imu_j, it_per_id.main_cam,
+                                  it_per_id.estimated_depth, pts_i, it_per_frame.point);
+            errCnt++;
+        }
+        if (it_per_frame.is_stereo)
+        {
+            err += referenceError(estimator, imu_i, 0, imu_j, 1, it_per_id.estimated_depth, pts_i, it_per_frame.pointRight);
+            errCnt++;
+        }
+    }
+    return errCnt > 0 ? err / errCnt : 0;
+}
+
+//Observation of pts_w from camera cam of frame imu, with noise on the unit sphere
+static TrackFeatureNoId observe(const Estimator &estimator, int imu, int cam, const Vector3d &pts_w)
+{
+    Vector3d pts_c = estimator.ric[cam].transpose() * (estimator.Rs[imu].transpose() * (pts_w - estimator.Ps[imu]) - estimator.tic[cam]);
+    TrackFeatureNoId obs = TrackFeatureNoId::Zero();
+    obs.head<3>() = (pts_c.normalized() + randomVector(2e-3)).normalized();
+    return obs;
+}
+
+int main(int argc, char **argv)
+{
+    FISHEYE = 1;
+    STEREO = 1;
+    Estimator *estimator = new Estimator();
+    for (int i = 0; i <= WINDOW_SIZE; i++)
+    {
+        estimator->Rs[i] = randomRotation(0.3);
+        estimator->Ps[i] = Vector3d(0.2 * i, 0, 0) + randomVector(0.05);
+    }
+    for (int c = 0; c < 2; c++)
+    {
+        estimator->ric[c] = randomRotation(0.1);
+        estimator->tic[c] = Vector3d(0, c * 0.1, 0) + randomVector(0.01);
+    }
+
+    std::vector<FeaturePerId> storage;
+    storage.reserve(BENCH_FEATURES);
+    for (int f = 0; f < BENCH_FEATURES; f++)
+    {
+        int start = f % (WINDOW_SIZE - 1);
+        storage.emplace_back(f, start);
+        FeaturePerId &it_per_id = storage.back();
+        it_per_id.main_cam = f % 4 == 0 ? 1 : 0;
+        Vector3d pts_w = estimator->Rs[start] * Vector3d(uniform(-3, 3), uniform(-3, 3), uniform(2, 10)) + estimator->Ps[start];
+        Vector3d pts_c = estimator->ric[it_per_id.main_cam].transpose() *
+                         (estimator->Rs[start].transpose() * (pts_w - estimator->Ps[start]) - estimator->tic[it_per_id.main_cam]);
+        it_per_id.estimated_depth = pts_c.norm() * uniform(0.95, 1.05);
+        for (int j = start; j <= WINDOW_SIZE; j++)
+        {
+            FeaturePerFrame frame(observe(*estimator, j, it_per_id.main_cam, pts_w), 0);
+            if (uniform(0, 1) < 0.5)
+                frame.rightObservation(observe(*estimator, j, 1, pts_w));
+            it_per_id.feature_per_frame.push_back(frame);
+        }
+    }
+    std::vector<FeaturePerId *> features;
+    for (auto &it_per_id : storage)
+        features.push_back(&it_per_id);
+
+    std::vector<double> ave_errs;
+    estimator->featureReprojectionErrors(features, ave_errs);
+    double max_diff = 0;
+    for (int k = 0; k < BENCH_FEATURES; k++)
+        max_diff = std::max(max_diff, std::abs(ave_errs[k] - referenceAverageError(*estimator, *features[k])));
+    printf("reprojection errors of %d features: max difference %g to per observation transforms\n", BENCH_FEATURES, max_diff);
+
+    TicToc t_ref;
+    double sum = 0;
+    for (int iter = 0; iter < BENCH_ITERATIONS; iter++)
+        for (auto it_per_id : features)
+            sum += referenceAverageError(*estimator, *it_per_id);
+    printf("per observation transforms, 1 thread: %.3fms per call%s\n", t_ref.toc() / BENCH_ITERATIONS,
+           std::isfinite(sum) ? "" : ", errors diverged");
+
+    int max_threads = omp_get_max_threads();
+    std::vector<int> thread_counts = {1};
+    if (max_threads > 1)
+        thread_counts.push_back(max_threads);
+    for (int threads : thread_counts)
+    {
+        omp_set_num_threads(threads);
+        TicToc t_err;
+        for (int iter = 0; iter < BENCH_ITERATIONS; iter++)
+            estimator->featureReprojectionErrors(features, ave_errs);
+        printf("outlier rejection errors, %d threads: %.3fms per call\n", threads, t_err.toc() / BENCH_ITERATIONS);
+    }
+    omp_set_num_threads(max_threads);
+
+    delete estimator;
+    return max_diff <= CHECK_TOLERANCE ? 0 : 1;
+}
@@ -26,8 +26,17 @@ Eigen::Vector3d G{0.0, 0.0, 9.8};
 
 double BIAS_ACC_THRESHOLD;
 double BIAS_GYR_THRESHOLD;
+double BIAS_CORRECT_ACC_THRESHOLD;
+double BIAS_CORRECT_GYR_THRESHOLD;
+int PREINTEGRATION_DELTA_ONLY;
 double SOLVER_TIME;
+int WARM_RESTART;
+int WARM_RESTART_FRAMES;
+std::string SNAPSHOT_SAVE_PATH;
+std::string SNAPSHOT_LOAD_PATH;
+double SNAPSHOT_INTERVAL;
 int NUM_ITERATIONS;
+int SOLVER_THREADS;
 int ESTIMATE_EXTRINSIC;
 int ESTIMATE_TD;
 int ROLLING_SHUTTER;
@@ -181,13 +190,44 @@ void readParameters(std::string config_file)
         GYR_N = fsSettings["gyr_n"];
         GYR_W = fsSettings["gyr_w"];
         G.z() = fsSettings["g_norm"];
+        //Bias change above these is reintegrated instead of first order corrected
+        BIAS_CORRECT_ACC_THRESHOLD = fsSettings["bias_correct_acc_threshold"];
+        BIAS_CORRECT_GYR_THRESHOLD = fsSettings["bias_correct_gyr_threshold"];
+        if (BIAS_CORRECT_ACC_THRESHOLD <= 0) {
+            BIAS_CORRECT_ACC_THRESHOLD = 0.1;
+        }
+        if (BIAS_CORRECT_GYR_THRESHOLD <= 0) {
+            BIAS_CORRECT_GYR_THRESHOLD = 0.01;
+        }
+        //Keep only deltas and jacobians of preintegrations, bias changes are always first order corrected
+        PREINTEGRATION_DELTA_ONLY = fsSettings["preintegration_delta_only"];
     }
 
     SOLVER_TIME = fsSettings["max_solver_time"];
     NUM_ITERATIONS = fsSettings["max_num_iterations"];
+    //Threads of the Ceres solves, window optimization and vision only BA of initialization
+    SOLVER_THREADS = fsSettings["solver_threads"];
+    if (SOLVER_THREADS <= 0) {
+        SOLVER_THREADS = 1;
+    }
     MIN_PARALLAX = fsSettings["keyframe_parallax"];
     MIN_PARALLAX = MIN_PARALLAX / FOCAL_LENGTH;
 
+    //Restart from last good state on failure instead of full reinitialization, stereo only
+    WARM_RESTART = fsSettings["warm_restart"];
+    WARM_RESTART_FRAMES = fsSettings["warm_restart_frames"];
+    if (WARM_RESTART_FRAMES <= 0) {
+        WARM_RESTART_FRAMES = 3;
+    }
+
+    //Binary snapshot of the sliding window, saved periodically and restored at start up
+    fsSettings["snapshot_save_path"] >> SNAPSHOT_SAVE_PATH;
+    fsSettings["snapshot_load_path"] >> SNAPSHOT_LOAD_PATH;
+    SNAPSHOT_INTERVAL = fsSettings["snapshot_interval"];
+    if (SNAPSHOT_INTERVAL <= 0) {
+        SNAPSHOT_INTERVAL = 1.0;
+    }
+
     fsSettings["output_path"] >> OUTPUT_FOLDER;
     VINS_RESULT_PATH = OUTPUT_FOLDER + "/vio.csv";
     std::cout << "result path " << VINS_RESULT_PATH << std::endl;
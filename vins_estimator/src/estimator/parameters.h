@@ -24,7 +24,10 @@ const double FOCAL_LENGTH = 460.0;
 const int WINDOW_SIZE = 10;
 const int NUM_OF_F = 1000;
 extern double triangulate_max_err;
+//Error model of the projection factors, define NORMALIZED_PLANE_ERROR for the image plane
+#ifndef NORMALIZED_PLANE_ERROR
 #define UNIT_SPHERE_ERROR
+#endif
 
 extern double INIT_DEPTH;
 extern double THRES_OUTLIER;
@@ -42,8 +45,17 @@ extern Eigen::Vector3d G;
 
 extern double BIAS_ACC_THRESHOLD;
 extern double BIAS_GYR_THRESHOLD;
+extern double BIAS_CORRECT_ACC_THRESHOLD;
+extern double BIAS_CORRECT_GYR_THRESHOLD;
+extern int PREINTEGRATION_DELTA_ONLY;
 extern double SOLVER_TIME;
+extern int WARM_RESTART;
+extern int WARM_RESTART_FRAMES;
+extern std::string SNAPSHOT_SAVE_PATH;
+extern std::string SNAPSHOT_LOAD_PATH;
+extern double SNAPSHOT_INTERVAL;
 extern int NUM_ITERATIONS;
+extern int SOLVER_THREADS;
 extern std::string EX_CALIB_RESULT_PATH;
 extern std::string VINS_RESULT_PATH;
 extern std::string OUTPUT_FOLDER;
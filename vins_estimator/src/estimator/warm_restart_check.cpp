@@ -0,0 +1,281 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Replay check of snapshot restore and warm restart on a simulated dual fisheye sequence with IMU.
+//A reference estimator initializes on the sequence and saves a snapshot of its window. A second
+//estimator restores the snapshot, follows the replay and is warm restarted midway the way
+//processImage does on a detected failure. Checks that the restored window tracks the ground truth,
+//that the warm restarted one gives an estimate again within WARM_RESTART_FRAMES frames and stays
+//on the ground truth, and that its full window is back within WINDOW_SIZE frames. The sequence is
+//seeded, runs are reproducible. Takes the dual fisheye config file, returns non-zero on failure.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <ros/time.h>
+#include "estimator.h"
+
+#define SIM_IMU_RATE 400
+#define SIM_IMAGE_RATE 20
+#define SIM_WALL_LANDMARKS 1000
+#define SIM_PLANE_LANDMARKS 250
+#define SIM_ACC_NOISE 0.02
+#define SIM_GYR_NOISE 0.002
+//Noise of the unit sphere observations, about half a pixel
+#define SIM_OBS_NOISE 1e-3
+//Max distance and angle from the optical axis of an observation
+#define SIM_MAX_RANGE 12.0
+#define SIM_MAX_ANGLE 100.0
+//Frames of the replay at which the snapshot is saved, the warm restart happens and the replay ends
+#define SNAPSHOT_FRAME 60
+#define RESTART_FRAME 90
+#define END_FRAME 150
+#define CHECK_POS_TOLERANCE 0.15
+//Degrees
+#define CHECK_ROT_TOLERANCE 3.0
+
+struct Pose
+{
+    Matrix3d R;
+    Vector3d P;
+};
+
+//Circle of 2m radius in a cylindrical room, speed ramps up from rest over the first seconds,
+//with height, yaw, pitch and roll oscillations for IMU excitation
+static Pose truth(double t)
+{
+    double ramp = 1 - exp(-t);
+    double theta = 0.5 * (t - ramp);
+    Pose pose;
+    pose.P = Vector3d(2.0 * cos(theta), 2.0 * sin(theta), 0.2 * sin(2.0 * t) * ramp);
+    double yaw = theta + M_PI / 2 + 0.2 * sin(0.7 * t) * ramp;
+    double pitch = 0.08 * sin(1.3 * t) * ramp, roll = 0.08 * sin(1.1 * t) * ramp;
+    pose.R = (AngleAxisd(yaw, Vector3d::UnitZ()) * AngleAxisd(pitch, Vector3d::UnitY()) *
+              AngleAxisd(roll, Vector3d::UnitX())).toRotationMatrix();
+    return pose;
+}
+
+class Simulator
+{
+  public:
+    Simulator() : rng(0)
+    {
+        std::uniform_real_distribution<double> angle(-M_PI, M_PI), height(-3, 3), radius(0, 1);
+        for (int i = 0; i < SIM_WALL_LANDMARKS; i++)
+        {
+            double a = angle(rng);
+            landmarks.push_back(Vector3d(6.0 * cos(a), 6.0 * sin(a), height(rng)));
+        }
+        for (int i = 0; i < 2 * SIM_PLANE_LANDMARKS; i++)
+        {
+            double a = angle(rng), r = 6.0 * sqrt(radius(rng));
+            landmarks.push_back(Vector3d(r * cos(a), r * sin(a), i < SIM_PLANE_LANDMARKS ? 3.0 : -2.5));
+        }
+        track_id.assign(landmarks.size(), -1);
+        last_seen.assign(landmarks.size(), -2);
+    }
+
+    //Accelerometer and gyroscope at t, from central differences of the ground truth
+    void imu(double t, Vector3d &acc, Vector3d &gyr)
+    {
+        const double h = 1e-3;
+        Pose prev = truth(t - h), cur = truth(t), next = truth(t + h);
+        Vector3d a = (next.P - 2 * cur.P + prev.P) / (h * h);
+        AngleAxisd delta(prev.R.transpose() * next.R);
+        std::normal_distribution<double> acc_noise(0, SIM_ACC_NOISE), gyr_noise(0, SIM_GYR_NOISE);
+        acc = cur.R.transpose() * (a + G) + Vector3d(acc_noise(rng), acc_noise(rng), acc_noise(rng));
+        gyr = delta.axis() * delta.angle() / (2 * h) + Vector3d(gyr_noise(rng), gyr_noise(rng), gyr_noise(rng));
+    }
+
+    //Observations of both cameras at image frame, a landmark lost for a frame comes back with a new id
+    //as the tracker would give it
+    FeatureFrame image(int frame, double t, const Vector3d tic[], const Matrix3d ric[])
+    {
+        Pose pose = truth(t);
+        std::normal_distribution<double> obs_noise(0, SIM_OBS_NOISE);
+        FeatureFrame features;
+        for (size_t i = 0; i < landmarks.size(); i++)
+        {
+            FeatureFramenoId observations;
+            for (int c = 0; c < 2; c++)
+            {
+                Vector3d pts_c = ric[c].transpose() * (pose.R.transpose() * (landmarks[i] - pose.P) - tic[c]);
+                double dist = pts_c.norm();
+                if (dist > SIM_MAX_RANGE || acos(pts_c.z() / dist) > SIM_MAX_ANGLE * M_PI / 180)
+                    continue;
+                TrackFeatureNoId obs = TrackFeatureNoId::Zero();
+                obs.head<3>() = (pts_c / dist + Vector3d(obs_noise(rng), obs_noise(rng), obs_noise(rng))).normalized();
+                observations.push_back(make_pair(c, obs));
+            }
+            if (observations.empty())
+                continue;
+            if (last_seen[i] != frame - 1)
+                track_id[i] = next_id++;
+            last_seen[i] = frame;
+            features[track_id[i]] = observations;
+        }
+        return features;
+    }
+
+  private:
+    std::mt19937 rng;
+    std::vector<Vector3d> landmarks;
+    std::vector<int> track_id, last_seen;
+    int next_id = 0;
+};
+
+static Estimator *newEstimator()
+{
+    Estimator *estimator = new Estimator();
+    estimator->setParameter(false);
+    return estimator;
+}
+
+//Buffers the sample as inputIMU does, without publishing the fast propagation
+static void feedIMU(Estimator *estimator, double t, const Vector3d &acc, const Vector3d &gyr)
+{
+    if (estimator == nullptr)
+        return;
+    estimator->mBuf.lock();
+    estimator->accBuf.push(make_pair(t, acc));
+    estimator->gyrBuf.push(make_pair(t, gyr));
+    estimator->mBuf.unlock();
+}
+
+//Error of the latest estimate against the ground truth, false if the estimator has none at t
+static bool latestError(const Estimator *estimator, double t, double &pos_err, double &rot_err)
+{
+    if (std::abs(estimator->latest_time - t) > 1e-6)
+        return false;
+    Pose pose = truth(t);
+    pos_err = (estimator->latest_P - pose.P).norm();
+    rot_err = AngleAxisd(pose.R.transpose() * estimator->latest_Q.toRotationMatrix()).angle() * 180 / M_PI;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: warm_restart_check <dual fisheye config file>\n");
+        return 1;
+    }
+    ros::Time::init();
+    readParameters(argv[1]);
+    //Exact extrinsic and time offset in the simulation, nothing to calibrate
+    USE_IMU = 1;
+    STEREO = 1;
+    ESTIMATE_EXTRINSIC = 0;
+    ESTIMATE_TD = 0;
+    TD = 0;
+    WARM_RESTART = 1;
+    ENABLE_PERF_OUTPUT = 0;
+    SNAPSHOT_SAVE_PATH = "";
+    std::string snapshot_path = "/tmp/warm_restart_check.snapshot";
+
+    Simulator sim;
+    Estimator *reference = newEstimator(), *restored = nullptr;
+    Pose start = truth(0);
+    reference->initFirstPose(start.P, start.R);
+    reference->initFirstPoseFlag = true;
+
+    const int imu_per_image = SIM_IMU_RATE / SIM_IMAGE_RATE;
+    const double imu_dt = 1.0 / SIM_IMU_RATE;
+    bool restarted = false;
+    int failures = 0, restart_gap = -1, restart_refill = -1;
+    double max_pos_err[3] = {0, 0, 0}, max_rot_err[3] = {0, 0, 0}, max_diff = 0;
+    for (int frame = 0; frame <= END_FRAME; frame++)
+    {
+        double t = (double)frame / SIM_IMAGE_RATE;
+        for (int k = frame == 0 ? imu_per_image : 1; k <= imu_per_image; k++)
+        {
+            double t_imu = t - (imu_per_image - k) * imu_dt;
+            Vector3d acc, gyr;
+            sim.imu(t_imu, acc, gyr);
+            feedIMU(reference, t_imu, acc, gyr);
+            feedIMU(restored, t_imu, acc, gyr);
+        }
+        FeatureFrame features = sim.image(frame, t, reference->tic, reference->ric);
+
+        //As processMeasurements, the restored window is warm restarted the way processImage does on a
+        //detected failure, after the IMU of the frame is integrated
+        reference->processIMUInterval(t);
+        reference->processImage(features, t);
+        if (restored != nullptr)
+        {
+            restored->processIMUInterval(t);
+            if (frame == RESTART_FRAME)
+            {
+                restored->warmRestart(t);
+                restarted = true;
+            }
+            restored->processImage(features, t);
+        }
+
+        //Reference after its initialization, restored window before the restart, and after
+        double pos_err, rot_err;
+        int phase = restored == nullptr ? 0 : restarted ? 2 : 1;
+        const Estimator *estimator = phase == 0 ? reference : restored;
+        if (latestError(estimator, t, pos_err, rot_err))
+        {
+            if (phase == 2 && restart_gap < 0)
+            {
+                restart_gap = frame - RESTART_FRAME;
+                printf("warm restart: first estimate %d frames after the restart, error %.3fm %.2fdeg\n",
+                       restart_gap, pos_err, rot_err);
+            }
+            if (phase > 0 || reference->solver_flag == Estimator::NON_LINEAR)
+            {
+                max_pos_err[phase] = std::max(max_pos_err[phase], pos_err);
+                max_rot_err[phase] = std::max(max_rot_err[phase], rot_err);
+            }
+        }
+        if (phase > 0 && latestError(reference, t, pos_err, rot_err))
+            max_diff = std::max(max_diff, (restored->latest_P - reference->latest_P).norm());
+        if (phase == 2 && restart_refill < 0 && restored->solver_flag == Estimator::NON_LINEAR)
+            restart_refill = frame - RESTART_FRAME;
+
+        if (frame == SNAPSHOT_FRAME)
+        {
+            if (reference->solver_flag != Estimator::NON_LINEAR)
+            {
+                printf("reference estimator did not initialize in %d frames\n", SNAPSHOT_FRAME);
+                return 1;
+            }
+            if (!reference->saveSnapshot(snapshot_path))
+            {
+                printf("failed to save the snapshot\n");
+                return 1;
+            }
+            reference->waitSnapshot();
+            restored = newEstimator();
+            if (!restored->loadSnapshot(snapshot_path))
+            {
+                printf("failed to restore the snapshot\n");
+                return 1;
+            }
+        }
+    }
+    remove(snapshot_path.c_str());
+
+    const char *phases[3] = {"reference", "restored window", "after warm restart"};
+    for (int phase = 0; phase < 3; phase++)
+    {
+        printf("%s: max error %.3fm %.2fdeg\n", phases[phase], max_pos_err[phase], max_rot_err[phase]);
+        failures += max_pos_err[phase] > CHECK_POS_TOLERANCE || max_rot_err[phase] > CHECK_ROT_TOLERANCE;
+    }
+    printf("warm restart: full window after %d frames, max difference to the reference %.3fm\n", restart_refill, max_diff);
+    failures += restart_gap < 0 || restart_gap > WARM_RESTART_FRAMES;
+    failures += restart_refill < 0 || restart_refill > WINDOW_SIZE;
+    printf("%d failures\n", failures);
+
+    delete restored;
+    delete reference;
+    return failures == 0 ? 0 : 1;
+}
@@ -11,8 +11,11 @@
 
 #include "../utility/utility.h"
 #include "../estimator/parameters.h"
+#include "../utility/tic_toc.h"
 
 #include <ceres/ceres.h>
+#include <mutex>
+#include <climits>
 using namespace Eigen;
 
 class IntegrationBase
@@ -23,6 +26,7 @@ class IntegrationBase
                     const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg)
         : acc_0{_acc_0}, gyr_0{_gyr_0}, linearized_acc{_acc_0}, linearized_gyr{_gyr_0},
           linearized_ba{_linearized_ba}, linearized_bg{_linearized_bg},
+          jacobian_ba{_linearized_ba}, jacobian_bg{_linearized_bg}, keep_samples{!PREINTEGRATION_DELTA_ONLY},
             jacobian{Eigen::Matrix<double, 15, 15>::Identity()}, covariance{Eigen::Matrix<double, 15, 15>::Zero()},
           sum_dt{0.0}, delta_p{Eigen::Vector3d::Zero()}, delta_q{Eigen::Quaterniond::Identity()}, delta_v{Eigen::Vector3d::Zero()}
 
@@ -38,14 +42,23 @@ class IntegrationBase
 
     void push_back(double dt, const Eigen::Vector3d &acc, const Eigen::Vector3d &gyr)
     {
-        dt_buf.push_back(dt);
-        acc_buf.push_back(acc);
-        gyr_buf.push_back(gyr);
+        if (keep_samples)
+        {
+            dt_buf.push_back(dt);
+            acc_buf.push_back(acc);
+            gyr_buf.push_back(gyr);
+        }
         propagate(dt, acc, gyr);
     }
 
     void repropagate(const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg)
     {
+        //Without raw samples the first order correction is all that can be done
+        if (!keep_samples)
+        {
+            correctBias(_linearized_ba, _linearized_bg);
+            return;
+        }
         sum_dt = 0.0;
         acc_0 = linearized_acc;
         gyr_0 = linearized_gyr;
@@ -54,12 +67,76 @@ class IntegrationBase
         delta_v.setZero();
         linearized_ba = _linearized_ba;
         linearized_bg = _linearized_bg;
+        jacobian_ba = _linearized_ba;
+        jacobian_bg = _linearized_bg;
         jacobian.setIdentity();
         covariance.setZero();
+        version++;
         for (int i = 0; i < static_cast<int>(dt_buf.size()); i++)
             propagate(dt_buf[i], acc_buf[i], gyr_buf[i]);
     }
 
+    //Move the linearization point to new biases. Changes are applied with the first order bias
+    //jacobians, raw samples are only reintegrated when the biases drift from those the jacobians
+    //were computed at by more than the thresholds. Without raw samples the correction is always first order.
+    void correctBias(const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg)
+    {
+        if (keep_samples && ((_linearized_ba - jacobian_ba).norm() > BIAS_CORRECT_ACC_THRESHOLD ||
+                             (_linearized_bg - jacobian_bg).norm() > BIAS_CORRECT_GYR_THRESHOLD))
+        {
+            repropagate(_linearized_ba, _linearized_bg);
+            return;
+        }
+
+        Eigen::Vector3d dba = _linearized_ba - linearized_ba;
+        Eigen::Vector3d dbg = _linearized_bg - linearized_bg;
+        delta_p += jacobian.block<3, 3>(O_P, O_BA) * dba + jacobian.block<3, 3>(O_P, O_BG) * dbg;
+        delta_v += jacobian.block<3, 3>(O_V, O_BA) * dba + jacobian.block<3, 3>(O_V, O_BG) * dbg;
+        delta_q = delta_q * Utility::deltaQ(jacobian.block<3, 3>(O_R, O_BG) * dbg);
+        delta_q.normalize();
+        linearized_ba = _linearized_ba;
+        linearized_bg = _linearized_bg;
+    }
+
+    //Append the preintegration of the interval following this one, as if its samples were pushed here.
+    //Midpoint integration of the appended samples from the end state of this interval is its own result
+    //rotated by delta_q, so deltas, jacobian and covariance compose exactly and no sample is reintegrated.
+    //next is moved to the biases of this one first.
+    void merge(IntegrationBase &next)
+    {
+        next.correctBias(linearized_ba, linearized_bg);
+
+        //next is expressed in the frame at the end of this interval, T rotates its position and velocity rows
+        Matrix3d R = delta_q.toRotationMatrix();
+        Eigen::Matrix<double, 15, 15> T = Eigen::Matrix<double, 15, 15>::Identity();
+        T.block<3, 3>(O_P, O_P) = R;
+        T.block<3, 3>(O_V, O_V) = R;
+        Eigen::Matrix<double, 15, 15> F = T * next.jacobian * T.transpose();
+        jacobian = F * jacobian;
+        covariance = F * covariance * F.transpose() + T * next.covariance * T.transpose();
+
+        delta_p += delta_v * next.sum_dt + R * next.delta_p;
+        delta_v += R * next.delta_v;
+        delta_q = delta_q * next.delta_q;
+        delta_q.normalize();
+        sum_dt += next.sum_dt;
+        if (next.sum_dt > 0)
+        {
+            dt = next.dt;
+            acc_1 = next.acc_1;
+            gyr_1 = next.gyr_1;
+        }
+        acc_0 = next.acc_0;
+        gyr_0 = next.gyr_0;
+        if (keep_samples)
+        {
+            dt_buf.insert(dt_buf.end(), next.dt_buf.begin(), next.dt_buf.end());
+            acc_buf.insert(acc_buf.end(), next.acc_buf.begin(), next.acc_buf.end());
+            gyr_buf.insert(gyr_buf.end(), next.gyr_buf.begin(), next.gyr_buf.end());
+        }
+        version++;
+    }
+
     void midPointIntegration(double _dt, 
                             const Eigen::Vector3d &_acc_0, const Eigen::Vector3d &_gyr_0,
                             const Eigen::Vector3d &_acc_1, const Eigen::Vector3d &_gyr_1,
@@ -96,48 +173,111 @@ class IntegrationBase
                 a_1_x(2), 0, -a_1_x(0),
                 -a_1_x(1), a_1_x(0), 0;
 
-            MatrixXd F = MatrixXd::Zero(15, 15);
-            F.block<3, 3>(0, 0) = Matrix3d::Identity();
-            F.block<3, 3>(0, 3) = -0.25 * delta_q.toRotationMatrix() * R_a_0_x * _dt * _dt + 
-                                  -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt * _dt;
-            F.block<3, 3>(0, 6) = MatrixXd::Identity(3,3) * _dt;
-            F.block<3, 3>(0, 9) = -0.25 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt * _dt;
-            F.block<3, 3>(0, 12) = -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * _dt * -_dt;
-            F.block<3, 3>(3, 3) = Matrix3d::Identity() - R_w_x * _dt;
-            F.block<3, 3>(3, 12) = -1.0 * MatrixXd::Identity(3,3) * _dt;
-            F.block<3, 3>(6, 3) = -0.5 * delta_q.toRotationMatrix() * R_a_0_x * _dt + 
-                                  -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt;
-            F.block<3, 3>(6, 6) = Matrix3d::Identity();
-            F.block<3, 3>(6, 9) = -0.5 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt;
-            F.block<3, 3>(6, 12) = -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * -_dt;
-            F.block<3, 3>(9, 9) = Matrix3d::Identity();
-            F.block<3, 3>(12, 12) = Matrix3d::Identity();
-            //cout<<"A"<<endl<<A<<endl;
+            //F and V are block sparse, only the non-trivial 3x3 blocks are kept.
+            //F has identity on the diagonal except F_rr, V has zero blocks except those below.
+            Matrix3d R_0 = delta_q.toRotationMatrix();
+            Matrix3d R_1 = result_delta_q.toRotationMatrix();
+            Matrix3d R_1_a_1_x = R_1 * R_a_1_x;
+            Matrix3d F_rr = Matrix3d::Identity() - R_w_x * _dt;
+            Matrix3d F_vr = -0.5 * R_0 * R_a_0_x * _dt + -0.5 * R_1_a_1_x * F_rr * _dt;
+            Matrix3d F_vba = -0.5 * (R_0 + R_1) * _dt;
+            Matrix3d F_vbg = 0.5 * R_1_a_1_x * _dt * _dt;
+            Matrix3d F_pr = 0.5 * _dt * F_vr;
+            Matrix3d F_pba = 0.5 * _dt * F_vba;
+            Matrix3d F_pbg = 0.5 * _dt * F_vbg;
+
+            Matrix3d V_pa0 = 0.25 * R_0 * _dt * _dt;
+            Matrix3d V_pg = -0.125 * R_1_a_1_x * _dt * _dt * _dt;
+            Matrix3d V_pa1 = 0.25 * R_1 * _dt * _dt;
+            Matrix3d V_va0 = 0.5 * R_0 * _dt;
+            Matrix3d V_vg = -0.25 * R_1_a_1_x * _dt * _dt;
+            Matrix3d V_va1 = 0.5 * R_1 * _dt;
+
+            //jacobian = F * jacobian
+            applyStepJacobian(jacobian, _dt, F_pr, F_pba, F_pbg, F_rr, F_vr, F_vba, F_vbg);
+
+            //covariance = F * covariance * F^T, covariance is symmetric so F * (F * covariance)^T is the same
+            applyStepJacobian(covariance, _dt, F_pr, F_pba, F_pbg, F_rr, F_vr, F_vba, F_vbg);
+            covariance.transposeInPlace();
+            applyStepJacobian(covariance, _dt, F_pr, F_pba, F_pbg, F_rr, F_vr, F_vba, F_vbg);
+
+            //covariance += V * noise * V^T, noise is block diagonal with scalar blocks
+            double n_a0 = noise(0, 0), n_g0 = noise(3, 3), n_a1 = noise(6, 6), n_g1 = noise(9, 9);
+            double n_ba = noise(12, 12), n_bg = noise(15, 15);
+            double n_g = n_g0 + n_g1;
+            Matrix3d Q_pp = n_a0 * V_pa0 * V_pa0.transpose() + n_a1 * V_pa1 * V_pa1.transpose() + n_g * V_pg * V_pg.transpose();
+            Matrix3d Q_pr = 0.5 * _dt * n_g * V_pg;
+            Matrix3d Q_pv = n_a0 * V_pa0 * V_va0.transpose() + n_a1 * V_pa1 * V_va1.transpose() + n_g * V_pg * V_vg.transpose();
+            Matrix3d Q_rv = 0.5 * _dt * n_g * V_vg.transpose();
+            Matrix3d Q_vv = n_a0 * V_va0 * V_va0.transpose() + n_a1 * V_va1 * V_va1.transpose() + n_g * V_vg * V_vg.transpose();
+
+            covariance.block<3, 3>(0, 0) += Q_pp;
+            covariance.block<3, 3>(0, 3) += Q_pr;
+            covariance.block<3, 3>(3, 0) += Q_pr.transpose();
+            covariance.block<3, 3>(0, 6) += Q_pv;
+            covariance.block<3, 3>(6, 0) += Q_pv.transpose();
+            covariance.block<3, 3>(3, 3).diagonal().array() += 0.25 * _dt * _dt * n_g;
+            covariance.block<3, 3>(3, 6) += Q_rv;
+            covariance.block<3, 3>(6, 3) += Q_rv.transpose();
+            covariance.block<3, 3>(6, 6) += Q_vv;
+            covariance.block<3, 3>(9, 9).diagonal().array() += _dt * _dt * n_ba;
+            covariance.block<3, 3>(12, 12).diagonal().array() += _dt * _dt * n_bg;
+        }
 
-            MatrixXd V = MatrixXd::Zero(15,18);
-            V.block<3, 3>(0, 0) =  0.25 * delta_q.toRotationMatrix() * _dt * _dt;
-            V.block<3, 3>(0, 3) =  0.25 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * _dt * 0.5 * _dt;
-            V.block<3, 3>(0, 6) =  0.25 * result_delta_q.toRotationMatrix() * _dt * _dt;
-            V.block<3, 3>(0, 9) =  V.block<3, 3>(0, 3);
-            V.block<3, 3>(3, 3) =  0.5 * MatrixXd::Identity(3,3) * _dt;
-            V.block<3, 3>(3, 9) =  0.5 * MatrixXd::Identity(3,3) * _dt;
-            V.block<3, 3>(6, 0) =  0.5 * delta_q.toRotationMatrix() * _dt;
-            V.block<3, 3>(6, 3) =  0.5 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * 0.5 * _dt;
-            V.block<3, 3>(6, 6) =  0.5 * result_delta_q.toRotationMatrix() * _dt;
-            V.block<3, 3>(6, 9) =  V.block<3, 3>(6, 3);
-            V.block<3, 3>(9, 12) = MatrixXd::Identity(3,3) * _dt;
-            V.block<3, 3>(12, 15) = MatrixXd::Identity(3,3) * _dt;
-
-            //step_jacobian = F;
-            //step_V = V;
-            jacobian = F * jacobian;
-            covariance = F * covariance * F.transpose() + V * noise * V.transpose();
+    }
+
+    //Left multiply X by the 15x15 step jacobian F of midPointIntegration without forming F.
+    //Rows of bias are identity in F and stay unchanged.
+    static void applyStepJacobian(Eigen::Matrix<double, 15, 15> &X, double _dt,
+                            const Matrix3d &F_pr, const Matrix3d &F_pba, const Matrix3d &F_pbg,
+                            const Matrix3d &F_rr, const Matrix3d &F_vr, const Matrix3d &F_vba, const Matrix3d &F_vbg)
+    {
+        Eigen::Matrix<double, 3, 15> X_r = X.block<3, 15>(3, 0);
+        Eigen::Matrix<double, 3, 15> X_v = X.block<3, 15>(6, 0);
+        const auto X_ba = X.block<3, 15>(9, 0);
+        const auto X_bg = X.block<3, 15>(12, 0);
+        X.block<3, 15>(0, 0) += F_pr * X_r + _dt * X_v + F_pba * X_ba + F_pbg * X_bg;
+        X.block<3, 15>(3, 0) = F_rr * X_r - _dt * X_bg;
+        X.block<3, 15>(6, 0) += F_vr * X_r + F_vba * X_ba + F_vbg * X_bg;
+    }
+
+    //Square root of information of the preintegrated measurement, cached until covariance is propagated
+    Eigen::Matrix<double, 15, 15> getSqrtInfo()
+    {
+        std::lock_guard<std::mutex> lock(sqrt_info_lock);
+        if (sqrt_info_version != version)
+        {
+            TicToc t_sqrt_info;
+            sqrt_info = computeSqrtInfo();
+            sqrt_info_version = version;
+            sqrt_info_misses++;
+            sqrt_info_ms += t_sqrt_info.toc();
         }
+        else
+            sqrt_info_hits++;
+        return sqrt_info;
+    }
 
+    //Uncached square root of information, what every evaluation computed before the cache
+    Eigen::Matrix<double, 15, 15> computeSqrtInfo() const
+    {
+        return Eigen::LLT<Eigen::Matrix<double, 15, 15>>(covariance.inverse()).matrixL().transpose();
+    }
+
+    //Cache hits, misses and time spent computing on misses since last call, then reset
+    void takeSqrtInfoStats(int &hits, int &misses, double &compute_ms)
+    {
+        std::lock_guard<std::mutex> lock(sqrt_info_lock);
+        hits = sqrt_info_hits;
+        misses = sqrt_info_misses;
+        compute_ms = sqrt_info_ms;
+        sqrt_info_hits = sqrt_info_misses = 0;
+        sqrt_info_ms = 0;
     }
 
     void propagate(double _dt, const Eigen::Vector3d &_acc_1, const Eigen::Vector3d &_gyr_1)
     {
+        version++;
         dt = _dt;
         acc_1 = _acc_1;
         gyr_1 = _gyr_1;
@@ -200,6 +340,10 @@ class IntegrationBase
 
     const Eigen::Vector3d linearized_acc, linearized_gyr;
     Eigen::Vector3d linearized_ba, linearized_bg;
+    //Biases the jacobian and deltas were integrated at, linearized_ba/bg move with first order corrections
+    Eigen::Vector3d jacobian_ba, jacobian_bg;
+    //Raw samples are kept for reintegration unless PREINTEGRATION_DELTA_ONLY
+    const bool keep_samples;
 
     Eigen::Matrix<double, 15, 15> jacobian, covariance;
     Eigen::Matrix<double, 15, 15> step_jacobian;
@@ -215,6 +359,15 @@ class IntegrationBase
     std::vector<Eigen::Vector3d> acc_buf;
     std::vector<Eigen::Vector3d> gyr_buf;
 
+  private:
+    //Bumped on every propagation, sqrt_info is valid when versions match
+    unsigned int version = 0;
+    unsigned int sqrt_info_version = UINT_MAX;
+    Eigen::Matrix<double, 15, 15> sqrt_info;
+    std::mutex sqrt_info_lock;
+    int sqrt_info_hits = 0;
+    int sqrt_info_misses = 0;
+    double sqrt_info_ms = 0;
 };
 /*
 
@@ -0,0 +1,299 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Check of the block-sparse jacobian and covariance propagation of IntegrationBase against the
+//dense F * J and F * P * F^T + V * Q * V^T of the original midpoint integration, on random
+//states. Also checks that merging two consecutive preintegrations matches integrating all samples
+//at once, that the cached square root information follows every change of covariance, and times
+//the block-sparse and dense updates and the cached and recomputed square root information.
+//Returns non-zero on failure.
+
+#include <cstdio>
+#include <random>
+#include "integration_base.h"
+#include "../utility/tic_toc.h"
+
+#define CHECK_TRIALS 1000
+#define MERGE_TRIALS 100
+#define BENCH_STEPS 200000
+//IMU factor evaluations of a solve, window of WINDOW_SIZE preintegrations and a few dozen evaluations each
+#define BENCH_SQRT_INFO_EVALS 500
+//Max difference relative to the largest entry of the dense result
+#define CHECK_TOLERANCE 1e-12
+//Merging differs from integrating all samples by the bias jacobians of the second interval not being
+//moved with its first order bias correction, and by midpoint integration rotating with a non-unit
+//quaternion within a step, about (gyr * dt)^2 relative
+#define MERGE_TOLERANCE 1e-4
+
+static std::mt19937 rng(0);
+
+static double uniform(double lo, double hi)
+{
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static Eigen::Vector3d randomVector(double scale)
+{
+    return Eigen::Vector3d(uniform(-scale, scale), uniform(-scale, scale), uniform(-scale, scale));
+}
+
+static Eigen::Quaterniond randomRotation()
+{
+    return Eigen::Quaterniond(Eigen::AngleAxisd(uniform(-M_PI, M_PI), randomVector(1.0).normalized()));
+}
+
+static Matrix3d skew(const Vector3d &v)
+{
+    Matrix3d m;
+    m << 0, -v(2), v(1),
+        v(2), 0, -v(0),
+        -v(1), v(0), 0;
+    return m;
+}
+
+//Dense step jacobian F and noise jacobian V as midPointIntegration formed them before the block-sparse update
+static void denseStep(double _dt, const Vector3d &_acc_0, const Vector3d &_gyr_0,
+                      const Vector3d &_acc_1, const Vector3d &_gyr_1, const Quaterniond &delta_q,
+                      const Vector3d &linearized_ba, const Vector3d &linearized_bg,
+                      MatrixXd &F, MatrixXd &V)
+{
+    Vector3d un_gyr = 0.5 * (_gyr_0 + _gyr_1) - linearized_bg;
+    Quaterniond result_delta_q = delta_q * Quaterniond(1, un_gyr(0) * _dt / 2, un_gyr(1) * _dt / 2, un_gyr(2) * _dt / 2);
+    Matrix3d R_w_x = skew(0.5 * (_gyr_0 + _gyr_1) - linearized_bg);
+    Matrix3d R_a_0_x = skew(_acc_0 - linearized_ba);
+    Matrix3d R_a_1_x = skew(_acc_1 - linearized_ba);
+
+    F = MatrixXd::Zero(15, 15);
+    F.block<3, 3>(0, 0) = Matrix3d::Identity();
+    F.block<3, 3>(0, 3) = -0.25 * delta_q.toRotationMatrix() * R_a_0_x * _dt * _dt +
+                          -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt * _dt;
+    F.block<3, 3>(0, 6) = MatrixXd::Identity(3,3) * _dt;
+    F.block<3, 3>(0, 9) = -0.25 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt * _dt;
+    F.block<3, 3>(0, 12) = -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * _dt * -_dt;
+    F.block<3, 3>(3, 3) = Matrix3d::Identity() - R_w_x * _dt;
+    F.block<3, 3>(3, 12) = -1.0 * MatrixXd::Identity(3,3) * _dt;
+    F.block<3, 3>(6, 3) = -0.5 * delta_q.toRotationMatrix() * R_a_0_x * _dt +
+                          -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt;
+    F.block<3, 3>(6, 6) = Matrix3d::Identity();
+    F.block<3, 3>(6, 9) = -0.5 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt;
+    F.block<3, 3>(6, 12) = -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * -_dt;
+    F.block<3, 3>(9, 9) = Matrix3d::Identity();
+    F.block<3, 3>(12, 12) = Matrix3d::Identity();
+
+    V = MatrixXd::Zero(15,18);
+    V.block<3, 3>(0, 0) =  0.25 * delta_q.toRotationMatrix() * _dt * _dt;
+    V.block<3, 3>(0, 3) =  0.25 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * _dt * 0.5 * _dt;
+    V.block<3, 3>(0, 6) =  0.25 * result_delta_q.toRotationMatrix() * _dt * _dt;
+    V.block<3, 3>(0, 9) =  V.block<3, 3>(0, 3);
+    V.block<3, 3>(3, 3) =  0.5 * MatrixXd::Identity(3,3) * _dt;
+    V.block<3, 3>(3, 9) =  0.5 * MatrixXd::Identity(3,3) * _dt;
+    V.block<3, 3>(6, 0) =  0.5 * delta_q.toRotationMatrix() * _dt;
+    V.block<3, 3>(6, 3) =  0.5 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * 0.5 * _dt;
+    V.block<3, 3>(6, 6) =  0.5 * result_delta_q.toRotationMatrix() * _dt;
+    V.block<3, 3>(6, 9) =  V.block<3, 3>(6, 3);
+    V.block<3, 3>(9, 12) = MatrixXd::Identity(3,3) * _dt;
+    V.block<3, 3>(12, 15) = MatrixXd::Identity(3,3) * _dt;
+}
+
+static double relativeError(const MatrixXd &a, const MatrixXd &b)
+{
+    return (a - b).cwiseAbs().maxCoeff() / b.cwiseAbs().maxCoeff();
+}
+
+int main(int argc, char **argv)
+{
+    ACC_N = 0.08;
+    GYR_N = 0.004;
+    ACC_W = 0.00004;
+    GYR_W = 2.0e-6;
+    BIAS_CORRECT_ACC_THRESHOLD = 0.1;
+    BIAS_CORRECT_GYR_THRESHOLD = 0.01;
+
+    double worst_jacobian = 0, worst_covariance = 0;
+    int failures = 0;
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        Vector3d acc_0 = randomVector(20.0), gyr_0 = randomVector(3.0);
+        Vector3d acc_1 = randomVector(20.0), gyr_1 = randomVector(3.0);
+        Vector3d ba = randomVector(0.5), bg = randomVector(0.05);
+        double dt = uniform(0.001, 0.02);
+
+        IntegrationBase pre_integration(acc_0, gyr_0, ba, bg);
+        pre_integration.delta_p = randomVector(5.0);
+        pre_integration.delta_q = randomRotation();
+        pre_integration.delta_v = randomVector(5.0);
+        //Any jacobian, and a symmetric positive definite covariance
+        Eigen::Matrix<double, 15, 15> J = Eigen::Matrix<double, 15, 15>::Random();
+        Eigen::Matrix<double, 15, 15> A = Eigen::Matrix<double, 15, 15>::Random();
+        Eigen::Matrix<double, 15, 15> P = 1e-3 * (A * A.transpose() + Eigen::Matrix<double, 15, 15>::Identity());
+        pre_integration.jacobian = J;
+        pre_integration.covariance = P;
+
+        MatrixXd F, V;
+        denseStep(dt, acc_0, gyr_0, acc_1, gyr_1, pre_integration.delta_q, ba, bg, F, V);
+        MatrixXd dense_jacobian = F * J;
+        MatrixXd dense_covariance = F * P * F.transpose() + V * pre_integration.noise * V.transpose();
+
+        pre_integration.propagate(dt, acc_1, gyr_1);
+        double err_jacobian = relativeError(pre_integration.jacobian, dense_jacobian);
+        double err_covariance = relativeError(pre_integration.covariance, dense_covariance);
+        worst_jacobian = std::max(worst_jacobian, err_jacobian);
+        worst_covariance = std::max(worst_covariance, err_covariance);
+        if (err_jacobian > CHECK_TOLERANCE || err_covariance > CHECK_TOLERANCE)
+        {
+            if (failures == 0)
+                printf("trial %d: relative error jacobian %g covariance %g above %g\n",
+                       trial, err_jacobian, err_covariance, CHECK_TOLERANCE);
+            failures++;
+        }
+    }
+    printf("%d trials, worst relative error: jacobian %g, covariance %g, %d failures\n",
+           CHECK_TRIALS, worst_jacobian, worst_covariance, failures);
+
+    //Two consecutive intervals merged against one preintegration of all samples, the second one
+    //linearized at slightly different biases as a new frame in the window is. Checked with and
+    //without raw samples kept.
+    double worst_merge = 0;
+    int merge_failures = 0;
+    for (int trial = 0; trial < 2 * MERGE_TRIALS; trial++)
+    {
+        PREINTEGRATION_DELTA_ONLY = trial >= MERGE_TRIALS;
+        int num_a = 5 + trial % 20, num_b = 1 + trial % 15;
+        std::vector<Vector3d> acc(num_a + num_b + 1), gyr(num_a + num_b + 1);
+        for (auto &a : acc)
+            a = Vector3d(0, 0, 9.8) + randomVector(5.0);
+        for (auto &g : gyr)
+            g = randomVector(2.0);
+        Vector3d ba = randomVector(0.2), bg = randomVector(0.02);
+        double dt = uniform(0.002, 0.01);
+
+        IntegrationBase whole(acc[0], gyr[0], ba, bg);
+        IntegrationBase first(acc[0], gyr[0], ba, bg);
+        for (int i = 1; i <= num_a + num_b; i++)
+            whole.push_back(dt, acc[i], gyr[i]);
+        for (int i = 1; i <= num_a; i++)
+            first.push_back(dt, acc[i], gyr[i]);
+        IntegrationBase second(acc[num_a], gyr[num_a], ba + randomVector(1e-4), bg + randomVector(1e-5));
+        for (int i = num_a + 1; i <= num_a + num_b; i++)
+            second.push_back(dt, acc[i], gyr[i]);
+        //The biases of second are within the thresholds, so the merge is first order corrected
+        second.correctBias(ba, bg);
+        first.merge(second);
+        whole.correctBias(ba, bg);
+
+        Eigen::Matrix<double, 10, 1> delta_first, delta_whole;
+        delta_first << first.delta_p, first.delta_q.coeffs(), first.delta_v;
+        delta_whole << whole.delta_p, whole.delta_q.coeffs(), whole.delta_v;
+        double err = std::max({relativeError(delta_first, delta_whole),
+                               relativeError(first.jacobian, whole.jacobian),
+                               relativeError(first.covariance, whole.covariance),
+                               std::abs(first.sum_dt - whole.sum_dt)});
+        worst_merge = std::max(worst_merge, err);
+        if (err > MERGE_TOLERANCE)
+        {
+            if (merge_failures == 0)
+                printf("merge trial %d: relative error %g above %g\n", trial, err, MERGE_TOLERANCE);
+            merge_failures++;
+        }
+    }
+    printf("%d merges, worst relative error %g, %d failures\n", 2 * MERGE_TRIALS, worst_merge, merge_failures);
+    failures += merge_failures;
+    PREINTEGRATION_DELTA_ONLY = 0;
+
+    //Same IMU stream through the block-sparse propagation and the dense products
+    std::vector<Vector3d> acc(BENCH_STEPS + 1), gyr(BENCH_STEPS + 1);
+    for (int i = 0; i <= BENCH_STEPS; i++)
+    {
+        acc[i] = Vector3d(0, 0, 9.8) + randomVector(1.0);
+        gyr[i] = randomVector(0.5);
+    }
+    double dt = 0.005;
+
+    IntegrationBase sparse(acc[0], gyr[0], Vector3d::Zero(), Vector3d::Zero());
+    TicToc t_sparse;
+    for (int i = 1; i <= BENCH_STEPS; i++)
+        sparse.propagate(dt, acc[i], gyr[i]);
+    double sparse_ms = t_sparse.toc();
+
+    IntegrationBase dense(acc[0], gyr[0], Vector3d::Zero(), Vector3d::Zero());
+    MatrixXd jacobian = MatrixXd::Identity(15, 15), covariance = MatrixXd::Zero(15, 15);
+    MatrixXd noise = dense.noise, F, V;
+    Vector3d delta_p = Vector3d::Zero(), delta_v = Vector3d::Zero(), ba = Vector3d::Zero(), bg = Vector3d::Zero();
+    Quaterniond delta_q = Quaterniond::Identity();
+    TicToc t_dense;
+    for (int i = 1; i <= BENCH_STEPS; i++)
+    {
+        Vector3d result_delta_p, result_delta_v, result_ba, result_bg;
+        Quaterniond result_delta_q;
+        dense.midPointIntegration(dt, acc[i - 1], gyr[i - 1], acc[i], gyr[i], delta_p, delta_q, delta_v, ba, bg,
+                                  result_delta_p, result_delta_q, result_delta_v, result_ba, result_bg, 0);
+        denseStep(dt, acc[i - 1], gyr[i - 1], acc[i], gyr[i], delta_q, ba, bg, F, V);
+        jacobian = F * jacobian;
+        covariance = F * covariance * F.transpose() + V * noise * V.transpose();
+        delta_p = result_delta_p;
+        delta_q = result_delta_q.normalized();
+        delta_v = result_delta_v;
+    }
+    double dense_ms = t_dense.toc();
+
+    printf("propagation of %d steps: block-sparse %.1f ns/step, dense %.1f ns/step, speedup %.2fx\n",
+           BENCH_STEPS, sparse_ms * 1e6 / BENCH_STEPS, dense_ms * 1e6 / BENCH_STEPS, dense_ms / sparse_ms);
+    //Keep the dense results alive
+    if (!std::isfinite(jacobian.sum() + covariance.sum()))
+        printf("dense propagation diverged\n");
+
+    //Cached square root information against a recompute after each way covariance changes
+    int sqrt_info_failures = 0;
+    IntegrationBase cached(acc[0], gyr[0], randomVector(0.1), randomVector(0.01));
+    IntegrationBase next(acc[50], gyr[50], Vector3d::Zero(), Vector3d::Zero());
+    for (int i = 1; i <= 50; i++)
+        cached.push_back(dt, acc[i], gyr[i]);
+    for (int i = 51; i <= 60; i++)
+        next.push_back(dt, acc[i], gyr[i]);
+    sqrt_info_failures += cached.getSqrtInfo() != cached.computeSqrtInfo();
+    sqrt_info_failures += cached.getSqrtInfo() != cached.computeSqrtInfo();
+    cached.push_back(dt, acc[51], gyr[51]);
+    sqrt_info_failures += cached.getSqrtInfo() != cached.computeSqrtInfo();
+    cached.repropagate(Vector3d::Zero(), Vector3d::Zero());
+    sqrt_info_failures += cached.getSqrtInfo() != cached.computeSqrtInfo();
+    cached.merge(next);
+    sqrt_info_failures += cached.getSqrtInfo() != cached.computeSqrtInfo();
+    printf("cached sqrt info: %d stale results\n", sqrt_info_failures);
+    failures += sqrt_info_failures;
+
+    //One solve evaluates each IMU factor many times between propagations
+    std::vector<IntegrationBase *> window;
+    for (int k = 0; k < WINDOW_SIZE; k++)
+    {
+        window.push_back(new IntegrationBase(acc[0], gyr[0], Vector3d::Zero(), Vector3d::Zero()));
+        for (int i = 1; i <= 20; i++)
+            window.back()->push_back(dt, acc[k * 20 + i], gyr[k * 20 + i]);
+    }
+    double sum = 0;
+    TicToc t_recompute;
+    for (int e = 0; e < BENCH_SQRT_INFO_EVALS; e++)
+        for (auto pre_integration : window)
+            sum += pre_integration->computeSqrtInfo()(0, 0);
+    double recompute_ms = t_recompute.toc();
+    TicToc t_cached;
+    for (int e = 0; e < BENCH_SQRT_INFO_EVALS; e++)
+        for (auto pre_integration : window)
+            sum += pre_integration->getSqrtInfo()(0, 0);
+    double cached_ms = t_cached.toc();
+    int evals = BENCH_SQRT_INFO_EVALS * WINDOW_SIZE;
+    printf("sqrt info of %d evaluations: recompute %.1f ns, cached %.1f ns per evaluation, %.3fms saved per %d, "
+           "speedup %.2fx\n", evals, recompute_ms * 1e6 / evals, cached_ms * 1e6 / evals, recompute_ms - cached_ms,
+           evals, recompute_ms / cached_ms);
+    for (auto pre_integration : window)
+        delete pre_integration;
+    if (!std::isfinite(sum))
+        printf("sqrt info diverged\n");
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <Eigen/Dense>
+#include "../utility/utility.h"
+#include "projection_error.h"
+
+//Chain of transforms from camera i to camera j and the residual and jacobians of the projection
+//factors along it, written once for the three factors and specialized on their topology:
+//  TWO_FRAME: the point is observed from two frames, pose blocks i and j come first,
+//             otherwise both observations are taken at the same time and no pose is involved
+//  TWO_CAM: the observations come from two cameras with an extrinsic block each,
+//           otherwise both ends of the chain use the same extrinsic
+//Parameter blocks are [pose_i, pose_j,] ex_i, [ex_j,] inv_dep, td.
+template <bool TWO_FRAME, bool TWO_CAM>
+struct ProjectionChain
+{
+    static_assert(TWO_FRAME || TWO_CAM, "a projection needs two frames or two cameras");
+
+    enum
+    {
+        POSE_I = 0,
+        POSE_J = 1,
+        EX_I = TWO_FRAME ? 2 : 0,
+        EX_J = TWO_CAM ? EX_I + 1 : EX_I,
+        INV_DEP = EX_J + 1,
+        TD = INV_DEP + 1
+    };
+
+    Eigen::Matrix3d R_cj_ci;     // ric_j^T * Rj^T * Ri * ric
+    Eigen::Vector3d t_cj_ci;
+    Eigen::Vector3d tic, tic_j;  // extrinsic translations of cameras i and j
+    //Only computed for jacobians
+    Eigen::Matrix3d ric, ric_t;  // extrinsic of camera i
+    Eigen::Matrix3d ric_j_t;     // extrinsic of camera j, transposed
+    Eigen::Matrix3d R_cj_w;      // ric_j^T * Rj^T
+    Eigen::Matrix3d R_cj_bi;     // ric_j^T * Rj^T * Ri
+    bool with_jacobians = false;
+
+    //The residual only needs the composed rotation, built from quaternions as it is the same
+    //whether jacobians are computed or not
+    void compute(double const *const *parameters, bool _with_jacobians)
+    {
+        with_jacobians = _with_jacobians;
+        tic = Eigen::Vector3d(parameters[EX_I][0], parameters[EX_I][1], parameters[EX_I][2]);
+        Eigen::Quaterniond qic(parameters[EX_I][6], parameters[EX_I][3], parameters[EX_I][4], parameters[EX_I][5]);
+        Eigen::Quaterniond qic_j = qic;
+        tic_j = tic;
+        if (TWO_CAM)
+        {
+            tic_j = Eigen::Vector3d(parameters[EX_J][0], parameters[EX_J][1], parameters[EX_J][2]);
+            qic_j = Eigen::Quaterniond(parameters[EX_J][6], parameters[EX_J][3], parameters[EX_J][4], parameters[EX_J][5]);
+        }
+
+        Eigen::Quaterniond Qi, Qj;
+        if (TWO_FRAME)
+        {
+            Eigen::Vector3d Pi(parameters[POSE_I][0], parameters[POSE_I][1], parameters[POSE_I][2]);
+            Qi = Eigen::Quaterniond(parameters[POSE_I][6], parameters[POSE_I][3], parameters[POSE_I][4], parameters[POSE_I][5]);
+            Eigen::Vector3d Pj(parameters[POSE_J][0], parameters[POSE_J][1], parameters[POSE_J][2]);
+            Qj = Eigen::Quaterniond(parameters[POSE_J][6], parameters[POSE_J][3], parameters[POSE_J][4], parameters[POSE_J][5]);
+            R_cj_ci = (qic_j.conjugate() * Qj.conjugate() * Qi * qic).toRotationMatrix();
+            t_cj_ci = qic_j.conjugate() * (Qj.conjugate() * (Qi * tic + Pi - Pj) - tic_j);
+        }
+        else
+        {
+            R_cj_ci = (qic_j.conjugate() * qic).toRotationMatrix();
+            t_cj_ci = qic_j.conjugate() * (tic - tic_j);
+        }
+
+        if (!with_jacobians)
+            return;
+        ric = qic.toRotationMatrix();
+        ric_t = ric.transpose();
+        ric_j_t = TWO_CAM ? Eigen::Matrix3d(qic_j.toRotationMatrix().transpose()) : ric_t;
+        if (TWO_FRAME)
+        {
+            R_cj_w = ric_j_t * Qj.toRotationMatrix().transpose();
+            R_cj_bi = R_cj_w * Qi.toRotationMatrix();
+        }
+        else
+        {
+            R_cj_w = ric_j_t;
+            R_cj_bi = ric_j_t;
+        }
+    }
+
+    //Residual and jacobians of factor at parameters. The transforms must be computed from the same
+    //parameters, with jacobians if any are requested. Factor provides the observations, time
+    //offsets, tangent_base and sqrt_info.
+    template <typename Factor>
+    void evaluate(const Factor &factor, double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        double inv_dep_i = parameters[INV_DEP][0];
+
+        double td = parameters[TD][0];
+
+        Eigen::Vector3d pts_i_td, pts_j_td;
+        pts_i_td = factor.pts_i - (td - factor.td_i) * factor.velocity_i;
+        pts_j_td = factor.pts_j - (td - factor.td_j) * factor.velocity_j;
+        Eigen::Vector3d pts_camera_i = pts_i_td / inv_dep_i;
+        Eigen::Vector3d pts_camera_j = R_cj_ci * pts_camera_i + t_cj_ci;
+        Eigen::Map<Eigen::Vector2d> residual(residuals);
+
+        residual = ProjectionError::residual(pts_camera_j, pts_j_td, factor.tangent_base);
+
+        residual = factor.sqrt_info * residual;
+
+        if (!jacobians)
+            return;
+
+        Eigen::Matrix<double, 2, 3> reduce = factor.sqrt_info * ProjectionError::reduce(pts_camera_j, factor.tangent_base);
+
+        if (TWO_FRAME && jacobians[POSE_I])
+        {
+            Eigen::Vector3d pts_imu_i = ric * pts_camera_i + tic;
+            Eigen::Matrix<double, 3, 6> jaco_i;
+            jaco_i.leftCols<3>() = R_cj_w;
+            jaco_i.rightCols<3>() = R_cj_bi * -Utility::skewSymmetric(pts_imu_i);
+            setPoseJacobian(jacobians[POSE_I], reduce, jaco_i);
+        }
+        if (TWO_FRAME && jacobians[POSE_J])
+        {
+            Eigen::Vector3d pts_imu_j = ric_j_t.transpose() * pts_camera_j + tic_j;
+            Eigen::Matrix<double, 3, 6> jaco_j;
+            jaco_j.leftCols<3>() = -R_cj_w;
+            jaco_j.rightCols<3>() = ric_j_t * Utility::skewSymmetric(pts_imu_j);
+            setPoseJacobian(jacobians[POSE_J], reduce, jaco_j);
+        }
+        if (jacobians[EX_I])
+        {
+            Eigen::Matrix<double, 3, 6> jaco_ex;
+            jaco_ex.leftCols<3>() = R_cj_bi;
+            jaco_ex.rightCols<3>() = R_cj_ci * -Utility::skewSymmetric(pts_camera_i);
+            if (!TWO_CAM)
+            {
+                //The extrinsic is also the end of the chain, add the camera j part
+                jaco_ex.leftCols<3>() -= ric_j_t;
+                jaco_ex.rightCols<3>() += Utility::skewSymmetric(pts_camera_j);
+            }
+            setPoseJacobian(jacobians[EX_I], reduce, jaco_ex);
+        }
+        if (TWO_CAM && jacobians[EX_J])
+        {
+            Eigen::Matrix<double, 3, 6> jaco_ex;
+            jaco_ex.leftCols<3>() = -ric_j_t;
+            jaco_ex.rightCols<3>() = Utility::skewSymmetric(pts_camera_j);
+            setPoseJacobian(jacobians[EX_J], reduce, jaco_ex);
+        }
+        if (jacobians[INV_DEP])
+        {
+            Eigen::Map<Eigen::Vector2d> jacobian_feature(jacobians[INV_DEP]);
+            jacobian_feature = reduce * R_cj_ci * pts_i_td * -1.0 / (inv_dep_i * inv_dep_i);
+        }
+        if (jacobians[TD])
+        {
+            Eigen::Map<Eigen::Vector2d> jacobian_td(jacobians[TD]);
+            jacobian_td = reduce * R_cj_ci * factor.velocity_i / inv_dep_i * -1.0 +
+                          factor.sqrt_info * ProjectionError::tdJacobian(pts_j_td, factor.velocity_j, factor.tangent_base);
+        }
+    }
+
+    static void setPoseJacobian(double *jacobian, const Eigen::Matrix<double, 2, 3> &reduce, const Eigen::Matrix<double, 3, 6> &jaco)
+    {
+        Eigen::Map<Eigen::Matrix<double, 2, 7, Eigen::RowMajor>> jacobian_pose(jacobian);
+        jacobian_pose.leftCols<6>() = reduce * jaco;
+        jacobian_pose.rightCols<1>().setZero();
+    }
+};
@@ -0,0 +1,176 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <ceres/ceres.h>
+#include <Eigen/Dense>
+#include <iostream>
+#include <vector>
+#include "../utility/utility.h"
+#include "../estimator/parameters.h"
+
+//Error models of the projection factors. The factors are written once against this interface
+//and the model is chosen at compile time, so each one is inlined without runtime branches.
+//  tangentBase: basis of the error space built from the observation
+//  residual: error of point in camera j against observation
+//  reduce: jacobian of residual w.r.t. point in camera j
+//  tdJacobian: jacobian of residual w.r.t. td through the observation velocity
+
+//Error on the tangent plane of the unit sphere, valid for wide angle cameras
+struct UnitSphereError
+{
+    static Eigen::Matrix<double, 2, 3> tangentBase(const Eigen::Vector3d &pts_j)
+    {
+        Eigen::Matrix<double, 2, 3> tangent_base;
+        Eigen::Vector3d b1, b2;
+        Eigen::Vector3d a = pts_j.normalized();
+        Eigen::Vector3d tmp(0, 0, 1);
+        if(a == tmp)
+            tmp << 1, 0, 0;
+        b1 = (tmp - a * (a.transpose() * tmp)).normalized();
+        b2 = a.cross(b1);
+        tangent_base.block<1, 3>(0, 0) = b1.transpose();
+        tangent_base.block<1, 3>(1, 0) = b2.transpose();
+        return tangent_base;
+    }
+
+    static Eigen::Vector2d residual(const Eigen::Vector3d &pts_camera_j, const Eigen::Vector3d &pts_j_td,
+                                    const Eigen::Matrix<double, 2, 3> &tangent_base)
+    {
+        return tangent_base * (pts_camera_j.normalized() - pts_j_td.normalized());
+    }
+
+    //Jacobian of pts.normalized()
+    static Eigen::Matrix3d normJacobian(const Eigen::Vector3d &pts)
+    {
+        double inv_norm = 1.0 / pts.norm();
+        double inv_norm3 = inv_norm * inv_norm * inv_norm;
+        return inv_norm * Eigen::Matrix3d::Identity() - inv_norm3 * pts * pts.transpose();
+    }
+
+    static Eigen::Matrix<double, 2, 3> reduce(const Eigen::Vector3d &pts_camera_j, const Eigen::Matrix<double, 2, 3> &tangent_base)
+    {
+        return tangent_base * normJacobian(pts_camera_j);
+    }
+
+    static Eigen::Vector2d tdJacobian(const Eigen::Vector3d &pts_j_td, const Eigen::Vector3d &velocity_j,
+                                      const Eigen::Matrix<double, 2, 3> &tangent_base)
+    {
+        return tangent_base * normJacobian(pts_j_td) * velocity_j;
+    }
+};
+
+//Error on the normalized image plane
+struct NormalizedPlaneError
+{
+    static Eigen::Matrix<double, 2, 3> tangentBase(const Eigen::Vector3d &pts_j)
+    {
+        Eigen::Matrix<double, 2, 3> tangent_base;
+        tangent_base << 1, 0, 0,
+                        0, 1, 0;
+        return tangent_base;
+    }
+
+    static Eigen::Vector2d residual(const Eigen::Vector3d &pts_camera_j, const Eigen::Vector3d &pts_j_td,
+                                    const Eigen::Matrix<double, 2, 3> &tangent_base)
+    {
+        return (pts_camera_j / pts_camera_j.z()).head<2>() - pts_j_td.head<2>();
+    }
+
+    static Eigen::Matrix<double, 2, 3> reduce(const Eigen::Vector3d &pts_camera_j, const Eigen::Matrix<double, 2, 3> &tangent_base)
+    {
+        double dep_j = pts_camera_j.z();
+        Eigen::Matrix<double, 2, 3> reduce;
+        reduce << 1. / dep_j, 0, -pts_camera_j(0) / (dep_j * dep_j),
+            0, 1. / dep_j, -pts_camera_j(1) / (dep_j * dep_j);
+        return reduce;
+    }
+
+    static Eigen::Vector2d tdJacobian(const Eigen::Vector3d &pts_j_td, const Eigen::Vector3d &velocity_j,
+                                      const Eigen::Matrix<double, 2, 3> &tangent_base)
+    {
+        return velocity_j.head<2>();
+    }
+};
+
+#ifdef UNIT_SPHERE_ERROR
+typedef UnitSphereError ProjectionError;
+#else
+typedef NormalizedPlaneError ProjectionError;
+#endif
+
+//Compare the analytic jacobians of a factor with central differences at parameters.
+//Blocks of size 7 are poses perturbed on the manifold as in PoseLocalParameterization.
+//Return the max absolute difference.
+inline double checkJacobian(const ceres::CostFunction *factor, double **parameters, bool verbose = true)
+{
+    const double eps = 1e-6;
+    const std::vector<int32_t> &sizes = factor->parameter_block_sizes();
+    int num_res = factor->num_residuals();
+    int num_blocks = sizes.size();
+
+    std::vector<std::vector<double>> jaco_data(num_blocks);
+    std::vector<double *> jaco(num_blocks);
+    for (int b = 0; b < num_blocks; b++)
+    {
+        jaco_data[b].resize(num_res * sizes[b]);
+        jaco[b] = jaco_data[b].data();
+    }
+    Eigen::VectorXd residual(num_res);
+    factor->Evaluate(parameters, residual.data(), jaco.data());
+
+    std::vector<std::vector<double>> params(num_blocks);
+    std::vector<double *> param_ptrs(num_blocks);
+    for (int b = 0; b < num_blocks; b++)
+    {
+        params[b].assign(parameters[b], parameters[b] + sizes[b]);
+        param_ptrs[b] = params[b].data();
+    }
+
+    auto perturb = [&](int b, int k, double delta) {
+        params[b].assign(parameters[b], parameters[b] + sizes[b]);
+        if (sizes[b] == 7 && k >= 3)
+        {
+            Eigen::Map<Eigen::Quaterniond> q(params[b].data() + 3);
+            q = (q * Utility::deltaQ(Eigen::Vector3d::Unit(k - 3) * delta)).normalized();
+        }
+        else
+        {
+            params[b][k] += delta;
+        }
+    };
+
+    double max_diff = 0;
+    Eigen::VectorXd res_plus(num_res), res_minus(num_res);
+    for (int b = 0; b < num_blocks; b++)
+    {
+        int local_size = sizes[b] == 7 ? 6 : sizes[b];
+        Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> analytic(jaco[b], num_res, sizes[b]);
+        Eigen::MatrixXd numeric(num_res, local_size);
+        for (int k = 0; k < local_size; k++)
+        {
+            perturb(b, k, eps);
+            factor->Evaluate(param_ptrs.data(), res_plus.data(), nullptr);
+            perturb(b, k, -eps);
+            factor->Evaluate(param_ptrs.data(), res_minus.data(), nullptr);
+            params[b].assign(parameters[b], parameters[b] + sizes[b]);
+            numeric.col(k) = (res_plus - res_minus) / (2 * eps);
+        }
+        double diff = (analytic.leftCols(local_size) - numeric).cwiseAbs().maxCoeff();
+        max_diff = std::max(max_diff, diff);
+        if (verbose)
+        {
+            std::cout << "block " << b << " max diff " << diff << std::endl;
+            std::cout << "analytic" << std::endl << analytic.leftCols(local_size) << std::endl;
+            std::cout << "numeric" << std::endl << numeric << std::endl;
+        }
+    }
+    return max_diff;
+}
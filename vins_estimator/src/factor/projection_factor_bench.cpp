@@ -0,0 +1,172 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Evaluation time of the three projection factors, best of a few runs, residual only as in line search and with all
+//jacobians as in the linearization, on a sliding window of random poses and features. Factors are
+//evaluated in feature order as Ceres does, poses move a little every iteration. Returns non-zero
+//if residuals are not finite.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "projectionTwoFrameOneCamFactor.h"
+#include "projectionTwoFrameTwoCamFactor.h"
+#include "projectionOneFrameTwoCamFactor.h"
+
+#define BENCH_FRAMES 10
+#define BENCH_FEATURES 1000
+//Frames a feature is tracked in
+#define BENCH_TRACK 5
+#define BENCH_ITERATIONS 50
+//Runs per measurement, the fastest is reported to filter out other load on the machine
+#define BENCH_REPEATS 5
+
+static std::mt19937 rng(0);
+
+static double uniform(double lo, double hi)
+{
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static Eigen::Vector3d randomVector(double scale)
+{
+    return Eigen::Vector3d(uniform(-scale, scale), uniform(-scale, scale), uniform(-scale, scale));
+}
+
+static void randomPose(double *pose, double trans, double angle)
+{
+    Eigen::Map<Eigen::Vector3d> P(pose);
+    Eigen::Map<Eigen::Quaterniond> Q(pose + 3);
+    P = randomVector(trans);
+    Eigen::Vector3d axis = randomVector(1.0).normalized();
+    Q = Eigen::Quaterniond(Eigen::AngleAxisd(uniform(-angle, angle), axis));
+}
+
+static Eigen::Vector3d observation(const Eigen::Vector3d &pts)
+{
+#ifdef UNIT_SPHERE_ERROR
+    return pts.normalized();
+#else
+    return pts / pts.z();
+#endif
+}
+
+struct Window
+{
+    std::vector<double> poses, initial_poses, ex, inv_deps, td;
+    Window() : poses(7 * BENCH_FRAMES), ex(14), inv_deps(BENCH_FEATURES), td(1, 0.0)
+    {
+        for (int k = 0; k < BENCH_FRAMES; k++)
+            randomPose(&poses[7 * k], 1.0, 0.5);
+        randomPose(&ex[0], 0.1, 0.2);
+        randomPose(&ex[7], 0.1, 0.2);
+        initial_poses = poses;
+    }
+};
+
+//Factors of every feature against the frames that track it, params holds their parameter blocks
+template <typename Factor>
+static void buildFactors(Window &window, bool two_frame, bool two_cam, std::vector<Factor> &factors,
+                         std::vector<std::vector<double *>> &params)
+{
+    for (int f = 0; f < BENCH_FEATURES; f++)
+    {
+        int start = f % (BENCH_FRAMES - 1);
+        int end = two_frame ? std::min(start + BENCH_TRACK, BENCH_FRAMES) : start + 1;
+        for (int j = two_frame ? start + 1 : start; j < end; j++)
+        {
+            Eigen::Vector3d pts_ci(uniform(-1, 1), uniform(-1, 1), uniform(3, 6));
+            window.inv_deps[f] = 1.0 / pts_ci.z();
+            Eigen::Vector3d velocity_i = randomVector(0.1), velocity_j = randomVector(0.1);
+            velocity_i.z() = velocity_j.z() = 0;
+            factors.push_back(Factor(observation(pts_ci), observation(pts_ci + randomVector(0.3)),
+                                     velocity_i, velocity_j, uniform(-0.01, 0.01), uniform(-0.01, 0.01)));
+            std::vector<double *> blocks;
+            if (two_frame)
+            {
+                blocks.push_back(&window.poses[7 * start]);
+                blocks.push_back(&window.poses[7 * j]);
+            }
+            blocks.push_back(&window.ex[0]);
+            if (two_cam)
+                blocks.push_back(&window.ex[7]);
+            blocks.push_back(&window.inv_deps[f]);
+            blocks.push_back(&window.td[0]);
+            params.push_back(blocks);
+        }
+    }
+}
+
+//Mean time of one evaluation in ns
+template <typename Factor>
+static double timeFactors(Window &window, const std::vector<Factor> &factors, const std::vector<std::vector<double *>> &params,
+                          bool with_jacobians, double &sum)
+{
+    double residual[2], jaco_data[6][2 * 7];
+    double *jaco[6];
+    for (int b = 0; b < 6; b++)
+        jaco[b] = jaco_data[b];
+
+    window.poses = window.initial_poses;
+    double ms = 0;
+    for (int iter = 0; iter < BENCH_ITERATIONS; iter++)
+    {
+        for (int k = 0; k < BENCH_FRAMES; k++)
+            window.poses[7 * k] += 1e-3;
+        TicToc t_eval;
+        for (size_t k = 0; k < factors.size(); k++)
+        {
+            factors[k].Evaluate(params[k].data(), residual, with_jacobians ? jaco : nullptr);
+            sum += residual[0];
+        }
+        ms += t_eval.toc();
+    }
+    return ms * 1e6 / (factors.size() * BENCH_ITERATIONS);
+}
+
+template <typename Factor>
+static void bench(const char *name, bool two_frame, bool two_cam, double &sum)
+{
+    Window window;
+    std::vector<Factor> factors;
+    std::vector<std::vector<double *>> params;
+    buildFactors(window, two_frame, two_cam, factors, params);
+    double ns_residual = INFINITY, ns_jacobians = INFINITY;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+    {
+        ns_residual = std::min(ns_residual, timeFactors(window, factors, params, false, sum));
+        ns_jacobians = std::min(ns_jacobians, timeFactors(window, factors, params, true, sum));
+    }
+    printf("%s, %d evaluations: residual %.1f ns, with jacobians %.1f ns\n", name,
+           (int)factors.size() * BENCH_ITERATIONS, ns_residual, ns_jacobians);
+}
+
+int main(int argc, char **argv)
+{
+#ifdef UNIT_SPHERE_ERROR
+    printf("unit sphere error\n");
+#else
+    printf("normalized plane error\n");
+#endif
+    ProjectionTwoFrameOneCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+    ProjectionTwoFrameTwoCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+    ProjectionOneFrameTwoCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+
+    double sum = 0;
+    bench<ProjectionTwoFrameOneCamFactor>("two frame one cam", true, false, sum);
+    bench<ProjectionTwoFrameTwoCamFactor>("two frame two cam", true, true, sum);
+    bench<ProjectionOneFrameTwoCamFactor>("one frame two cam", false, true, sum);
+    if (!std::isfinite(sum))
+    {
+        printf("residuals are not finite\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Gradient check of the three projection factors against central differences on random
+//configurations. The error model is fixed at compile time, the build compiles this check once
+//per model (NORMALIZED_PLANE_ERROR selects the image plane). Also checks that the frame pair
+//transform cache of ProjectionTwoFrameOneCamFactor gives the same results as the uncached path
+//when slots collide or go stale, and times both. Returns non-zero on failure.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "projectionTwoFrameOneCamFactor.h"
+#include "projectionTwoFrameTwoCamFactor.h"
+#include "projectionOneFrameTwoCamFactor.h"
+
+#define CHECK_TRIALS 200
+//Max difference between analytic and numeric jacobians, relative to the largest entry
+#define CHECK_TOLERANCE 1e-5
+//Random evaluations over a pool of poses, more frame pairs than cache slots
+#define CACHE_CHECK_STEPS 20000
+#define CACHE_CHECK_POSES 64
+//Sliding window of the benchmark, features observed in a few consecutive frames
+#define BENCH_FRAMES 10
+#define BENCH_FEATURES 1000
+#define BENCH_ITERATIONS 20
+
+static std::mt19937 rng(0);
+
+static double uniform(double lo, double hi)
+{
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static Eigen::Vector3d randomVector(double scale)
+{
+    return Eigen::Vector3d(uniform(-scale, scale), uniform(-scale, scale), uniform(-scale, scale));
+}
+
+static void randomPose(double *pose, double trans, double angle)
+{
+    Eigen::Map<Eigen::Vector3d> P(pose);
+    Eigen::Map<Eigen::Quaterniond> Q(pose + 3);
+    P = randomVector(trans);
+    Eigen::Vector3d axis = randomVector(1.0).normalized();
+    Q = Eigen::Quaterniond(Eigen::AngleAxisd(uniform(-angle, angle), axis));
+}
+
+//Observation of a point in front of the camera as the factors expect it
+static Eigen::Vector3d observation(const Eigen::Vector3d &pts)
+{
+#ifdef UNIT_SPHERE_ERROR
+    return pts.normalized();
+#else
+    return pts / pts.z();
+#endif
+}
+
+//Largest analytic jacobian entry, used to scale the tolerance
+static double jacobianScale(const ceres::CostFunction *factor, double **parameters)
+{
+    const std::vector<int32_t> &sizes = factor->parameter_block_sizes();
+    std::vector<std::vector<double>> jaco_data(sizes.size());
+    std::vector<double *> jaco(sizes.size());
+    for (size_t b = 0; b < sizes.size(); b++)
+    {
+        jaco_data[b].resize(factor->num_residuals() * sizes[b]);
+        jaco[b] = jaco_data[b].data();
+    }
+    std::vector<double> residual(factor->num_residuals());
+    factor->Evaluate(parameters, residual.data(), jaco.data());
+
+    double scale = 1.0;
+    for (size_t b = 0; b < sizes.size(); b++)
+        for (double v : jaco_data[b])
+            scale = std::max(scale, std::abs(v));
+    return scale;
+}
+
+//Residual followed by all jacobian blocks
+static std::vector<double> evaluate(const ceres::CostFunction *factor, double **parameters)
+{
+    const std::vector<int32_t> &sizes = factor->parameter_block_sizes();
+    int num_res = factor->num_residuals();
+    size_t total = num_res;
+    for (int32_t size : sizes)
+        total += num_res * size;
+    std::vector<double> result(total);
+    std::vector<double *> jaco(sizes.size());
+    size_t offset = num_res;
+    for (size_t b = 0; b < sizes.size(); b++)
+    {
+        jaco[b] = result.data() + offset;
+        offset += num_res * sizes[b];
+    }
+    factor->Evaluate(parameters, result.data(), jaco.data());
+    return result;
+}
+
+static ProjectionTwoFrameOneCamFactor randomTwoFrameOneCamFactor(double *inv_dep)
+{
+    Eigen::Vector3d pts_ci(uniform(-1, 1), uniform(-1, 1), uniform(3, 6));
+    inv_dep[0] = 1.0 / pts_ci.z();
+    Eigen::Vector3d velocity_i = randomVector(0.1), velocity_j = randomVector(0.1);
+    velocity_i.z() = velocity_j.z() = 0;
+    return ProjectionTwoFrameOneCamFactor(observation(pts_ci), observation(pts_ci + randomVector(0.3)),
+                                          velocity_i, velocity_j, uniform(-0.01, 0.01), uniform(-0.01, 0.01));
+}
+
+//Cached against uncached frame pair transforms, bitwise. Random pairs of the pool share cache slots,
+//and poses are changed in place between evaluations as the solver does, so slots go stale.
+static int checkFramePairCache()
+{
+    std::vector<double> poses(7 * CACHE_CHECK_POSES), ex(14);
+    for (int k = 0; k < CACHE_CHECK_POSES; k++)
+        randomPose(&poses[7 * k], 1.0, 0.5);
+    randomPose(&ex[0], 0.1, 0.2);
+    randomPose(&ex[7], 0.1, 0.2);
+
+    std::uniform_int_distribution<int> pose_index(0, CACHE_CHECK_POSES - 1);
+    int mismatches = 0;
+    for (int step = 0; step < CACHE_CHECK_STEPS; step++)
+    {
+        if (uniform(0, 1) < 0.1)
+            randomPose(&poses[7 * pose_index(rng)], 1.0, 0.5);
+        int i = pose_index(rng), j = pose_index(rng);
+        if (i == j)
+            continue;
+        double inv_dep[1], td[1] = {uniform(-0.01, 0.01)};
+        ProjectionTwoFrameOneCamFactor factor = randomTwoFrameOneCamFactor(inv_dep);
+        double *params[5] = {&poses[7 * i], &poses[7 * j], &ex[7 * (step % 2)], inv_dep, td};
+
+        ProjectionTwoFrameOneCamFactor::use_frame_pair_cache = true;
+        std::vector<double> cached = evaluate(&factor, params);
+        ProjectionTwoFrameOneCamFactor::use_frame_pair_cache = false;
+        std::vector<double> uncached = evaluate(&factor, params);
+        if (cached != uncached)
+        {
+            if (mismatches == 0)
+                printf("frame pair cache: step %d differs from the uncached path\n", step);
+            mismatches++;
+        }
+    }
+    ProjectionTwoFrameOneCamFactor::use_frame_pair_cache = true;
+    printf("frame pair cache, %d evaluations: %d mismatches\n", CACHE_CHECK_STEPS, mismatches);
+    return mismatches;
+}
+
+//Evaluation time of the window's two frame one cam factors in feature order, as Ceres evaluates them,
+//with poses moved in place every iteration
+static void benchFramePairCache()
+{
+    std::vector<double> initial_poses(7 * BENCH_FRAMES), ex(7);
+    for (int k = 0; k < BENCH_FRAMES; k++)
+        randomPose(&initial_poses[7 * k], 1.0, 0.5);
+    randomPose(&ex[0], 0.1, 0.2);
+    std::vector<double> poses = initial_poses;
+
+    std::vector<ProjectionTwoFrameOneCamFactor> factors;
+    std::vector<std::vector<double *>> params;
+    std::vector<double> inv_deps(BENCH_FEATURES), td(1, 0.0);
+    for (int f = 0; f < BENCH_FEATURES; f++)
+    {
+        int start = f % (BENCH_FRAMES - 1);
+        int end = std::min(start + 5, BENCH_FRAMES);
+        for (int j = start + 1; j < end; j++)
+        {
+            factors.push_back(randomTwoFrameOneCamFactor(&inv_deps[f]));
+            params.push_back({&poses[7 * start], &poses[7 * j], &ex[0], &inv_deps[f], &td[0]});
+        }
+    }
+
+    double residual[2], jaco_data[2 * 7 * 3 + 2 * 2];
+    double *jaco[5] = {jaco_data, jaco_data + 14, jaco_data + 28, jaco_data + 42, jaco_data + 44};
+    double ms[2], sum = 0;
+    for (int use_cache = 0; use_cache < 2; use_cache++)
+    {
+        ProjectionTwoFrameOneCamFactor::use_frame_pair_cache = use_cache;
+        poses = initial_poses;
+        ms[use_cache] = 0;
+        for (int iter = 0; iter < BENCH_ITERATIONS; iter++)
+        {
+            for (int k = 0; k < BENCH_FRAMES; k++)
+                poses[7 * k] += 1e-3;
+            TicToc t_eval;
+            for (size_t k = 0; k < factors.size(); k++)
+            {
+                factors[k].Evaluate(params[k].data(), residual, jaco);
+                sum += residual[0];
+            }
+            ms[use_cache] += t_eval.toc();
+        }
+    }
+    ProjectionTwoFrameOneCamFactor::use_frame_pair_cache = true;
+    int evals = factors.size() * BENCH_ITERATIONS;
+    printf("two frame one cam evaluation with jacobians, %d evaluations: uncached %.1f ns, cached %.1f ns, "
+           "speedup %.2fx%s\n", evals, ms[0] * 1e6 / evals, ms[1] * 1e6 / evals, ms[0] / ms[1],
+           std::isfinite(sum) ? "" : ", residuals diverged");
+}
+
+static bool check(const char *name, const ceres::CostFunction *factor, double **parameters, double &worst)
+{
+    double diff = checkJacobian(factor, parameters, false) / jacobianScale(factor, parameters);
+    worst = std::max(worst, diff);
+    if (diff > CHECK_TOLERANCE)
+    {
+        static bool printed = false;
+        printf("%s: relative jacobian error %g above %g\n", name, diff, CHECK_TOLERANCE);
+        if (!printed)
+            checkJacobian(factor, parameters, true);
+        printed = true;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef UNIT_SPHERE_ERROR
+    const char *model = "unit sphere";
+#else
+    const char *model = "normalized plane";
+#endif
+    ProjectionTwoFrameOneCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+    ProjectionTwoFrameTwoCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+    ProjectionOneFrameTwoCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Eigen::Matrix2d::Identity();
+
+    double worst[3] = {0, 0, 0};
+    int failures = 0;
+    for (int trial = 0; trial < CHECK_TRIALS; trial++)
+    {
+        double pose_i[7], pose_j[7], ex_0[7], ex_1[7];
+        randomPose(pose_i, 1.0, 0.5);
+        randomPose(pose_j, 1.0, 0.5);
+        randomPose(ex_0, 0.1, 0.2);
+        randomPose(ex_1, 0.1, 0.2);
+        double td_i = uniform(-0.01, 0.01), td_j = uniform(-0.01, 0.01);
+        double td[1] = {uniform(-0.01, 0.01)};
+
+        //Point in camera i, well in front of both cameras so the normalized plane stays regular
+        Eigen::Vector3d pts_ci(uniform(-1, 1), uniform(-1, 1), uniform(3, 6));
+        double inv_dep[1] = {1.0 / pts_ci.norm()};
+#ifndef UNIT_SPHERE_ERROR
+        inv_dep[0] = 1.0 / pts_ci.z();
+#endif
+        //Observations need not be consistent with the state, only the jacobians are checked
+        Eigen::Vector3d pts_i = observation(pts_ci);
+        Eigen::Vector3d pts_j = observation(pts_ci + randomVector(0.3));
+        Eigen::Vector3d velocity_i = randomVector(0.1), velocity_j = randomVector(0.1);
+        velocity_i.z() = velocity_j.z() = 0;
+
+        ProjectionTwoFrameOneCamFactor two_frame_one_cam(pts_i, pts_j, velocity_i, velocity_j, td_i, td_j);
+        double *params_tfoc[5] = {pose_i, pose_j, ex_0, inv_dep, td};
+        failures += !check("ProjectionTwoFrameOneCamFactor", &two_frame_one_cam, params_tfoc, worst[0]);
+
+        ProjectionTwoFrameTwoCamFactor two_frame_two_cam(pts_i, pts_j, velocity_i, velocity_j, td_i, td_j);
+        double *params_tftc[6] = {pose_i, pose_j, ex_0, ex_1, inv_dep, td};
+        failures += !check("ProjectionTwoFrameTwoCamFactor", &two_frame_two_cam, params_tftc, worst[1]);
+
+        ProjectionOneFrameTwoCamFactor one_frame_two_cam(pts_i, pts_j, velocity_i, velocity_j, td_i, td_j);
+        double *params_oftc[4] = {ex_0, ex_1, inv_dep, td};
+        failures += !check("ProjectionOneFrameTwoCamFactor", &one_frame_two_cam, params_oftc, worst[2]);
+    }
+
+    printf("%s error, %d trials, worst relative jacobian error: two frame one cam %g, "
+           "two frame two cam %g, one frame two cam %g, %d failures\n",
+           model, CHECK_TRIALS, worst[0], worst[1], worst[2], failures);
+
+    failures += checkFramePairCache();
+    benchFramePairCache();
+    return failures == 0 ? 0 : 1;
+}
@@ -327,7 +327,7 @@ map<int, cv::Point2f> pts_map(vector<int> ids, vector<cv::Point2f> cur_pts) {
 }
 
 void BaseFeatureTracker::drawTrackImage(cv::Mat & img, vector<cv::Point2f> pts, vector<int> ids, map<int, cv::Point2f> prev_pts, map<int, cv::Point2f> predictions) {
-    char idtext[10] = {0};
+    char idtext[32] = {0};
     for (size_t j = 0; j < pts.size(); j++) {
         //Not tri
         //Not solving
@@ -358,7 +358,12 @@ void BaseFeatureTracker::drawTrackImage(cv::Mat & img, vector<cv::Point2f> pts,
         }
 
         cv::circle(img, pts[j], 1, color, 2);
-        sprintf(idtext, "%d", ids[j]);
+        auto err_it = pts_reproj_err.find(ids[j]);
+        if (err_it != pts_reproj_err.end()) {
+            sprintf(idtext, "%d:%.1f", ids[j], err_it->second);
+        } else {
+            sprintf(idtext, "%d", ids[j]);
+        }
 	    cv::putText(img, idtext, pts[j] - cv::Point2f(5, 0), cv::FONT_HERSHEY_SIMPLEX, 0.5, color, 1);
     }
 
@@ -64,8 +64,12 @@ public:
     virtual FeatureFrame trackImage(double _cur_time, cv::InputArray _img, 
         cv::InputArray _img1 = cv::noArray()) = 0;
     
-    void setFeatureStatus(int feature_id, int status) {
+    //reproj_err: average reprojection error in pixel from the estimator, negative for unknown
+    void setFeatureStatus(int feature_id, int status, double reproj_err = -1) {
         this->pts_status[feature_id] = status;
+        if (reproj_err >= 0) {
+            pts_reproj_err[feature_id] = reproj_err;
+        }
         if (status < 0) {
             removed_pts.insert(feature_id);
         }
@@ -73,6 +77,15 @@ public:
 
     virtual void readIntrinsicParameter(const vector<string> &calib_file) = 0;
 
+    //Id given to next new feature, restored with estimator snapshot so ids never collide
+    int getNextFeatureId() const {
+        return n_id;
+    }
+
+    void setNextFeatureId(int id) {
+        n_id = std::max(n_id, id);
+    }
+
 protected:
     bool hasPrediction = false;
     int n_id = 0;
@@ -89,6 +102,7 @@ protected:
     void drawTrackImage(cv::Mat & img, vector<cv::Point2f> pts, vector<int> ids, map<int, cv::Point2f> prev_pts, map<int, cv::Point2f> predictions = map<int, cv::Point2f>());
 
     map<int, int> pts_status;
+    map<int, double> pts_reproj_err;
     set<int> removed_pts;
 
     vector<camodocal::CameraPtr> m_camera;
@@ -417,11 +417,16 @@ template<class CvMat>
 vector<cv::Point3f> BaseFisheyeFeatureTracker<CvMat>::undistortedPtsTop(vector<cv::Point2f> &pts, FisheyeUndist & fisheye) {
     auto & cam = fisheye.cam_top;
     vector<cv::Point3f> un_pts;
+    Eigen::Matrix2Xd a(2, pts.size());
+    Eigen::Matrix3Xd lifted(3, pts.size());
     for (unsigned int i = 0; i < pts.size(); i++)
     {
-        Eigen::Vector2d a(pts[i].x, pts[i].y);
-        Eigen::Vector3d b;
-        cam->liftProjective(a, b);
+        a.col(i) << pts[i].x, pts[i].y;
+    }
+    cam->liftProjectiveBatch(a.data(), lifted.data(), pts.size());
+    for (unsigned int i = 0; i < pts.size(); i++)
+    {
+        Eigen::Vector3d b = lifted.col(i);
         b.normalize();
 #ifdef UNIT_SPHERE_ERROR
         un_pts.push_back(cv::Point3f(b.x(), b.y(), b.z()));
@@ -453,16 +458,20 @@ vector<cv::Point3f> BaseFisheyeFeatureTracker<CvMat>::undistortedPtsSide(vector<
     //For downward camera, additational rotate 180 deg on x is required
 
 
+    Eigen::Matrix2Xd a(2, pts.size());
+    Eigen::Matrix3Xd lifted(3, pts.size());
     for (unsigned int i = 0; i < pts.size(); i++)
     {
-        Eigen::Vector2d a(pts[i].x, pts[i].y);
-        Eigen::Vector3d b;
-        
-        int side_pos_id = floor(a.x() / WIDTH) + 1;
-
-        a.x() = a.x() - floor(a.x() / WIDTH)*WIDTH;
+        double x = pts[i].x;
+        a.col(i) << x - floor(x / WIDTH)*WIDTH, pts[i].y;
+    }
+    cam->liftProjectiveBatch(a.data(), lifted.data(), pts.size());
 
-        cam->liftProjective(a, b);
+    for (unsigned int i = 0; i < pts.size(); i++)
+    {
+        Eigen::Vector3d b = lifted.col(i);
+        
+        int side_pos_id = floor((double)pts[i].x / WIDTH) + 1;
 
         if (side_pos_id == 1) {
             b = t1 * b;
@@ -473,7 +482,7 @@ vector<cv::Point3f> BaseFisheyeFeatureTracker<CvMat>::undistortedPtsSide(vector<
         } else if (side_pos_id == 4) {
             b = t4 * b;
         } else {
-            ROS_ERROR("Err pts img position; i %d side_pos_id %d!! x %f width %d", i, side_pos_id, a.x(), top_size.width);
+            ROS_ERROR("Err pts img position; i %d side_pos_id %d!! x %f width %d", i, side_pos_id, a(0, i), top_size.width);
             assert(false &&"ERROR Pts img position");
         }
 
@@ -77,15 +77,19 @@ template<class CvMat>
 vector<cv::Point2f> PinholeFeatureTracker<CvMat>::undistortedPts(vector<cv::Point2f> &pts, camodocal::CameraPtr cam)
 {
     vector<cv::Point2f> un_pts;
+    Eigen::Matrix2Xd a(2, pts.size());
+    Eigen::Matrix3Xd b(3, pts.size());
     for (unsigned int i = 0; i < pts.size(); i++)
     {
-        Eigen::Vector2d a(pts[i].x, pts[i].y);
-        Eigen::Vector3d b;
-        if(ENABLE_DOWNSAMPLE) {
-            a = a*2;
-        }
-        cam->liftProjective(a, b);
-        un_pts.push_back(cv::Point2f(b.x() / b.z(), b.y() / b.z()));
+        a.col(i) << pts[i].x, pts[i].y;
+    }
+    if(ENABLE_DOWNSAMPLE) {
+        a = a*2;
+    }
+    cam->liftProjectiveBatch(a.data(), b.data(), pts.size());
+    for (unsigned int i = 0; i < pts.size(); i++)
+    {
+        un_pts.push_back(cv::Point2f(b(0, i) / b(2, i), b(1, i) / b(2, i)));
     }
     return un_pts;
 }
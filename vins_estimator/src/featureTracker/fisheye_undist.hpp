@@ -219,6 +219,7 @@ public:
         if (sideVerticalFOV < 0)
             sideVerticalFOV = 0;
         double centerFOV = fov * DEG_TO_RAD - sideVerticalFOV * 2;
+        TicToc tic;
         ROS_INFO("Build for camera %d", cam_id);
         ROS_INFO("Center FOV: %f_center", centerFOV);
 
@@ -286,6 +287,7 @@ public:
             t[4] = t[3] * Eigen::AngleAxis<double>(M_PI / 2, Eigen::Vector3d(0, 1, 0));
             maps.push_back(genOneUndistMap(4, p_cam, t[4], imgWidth, sideImgHeight, f_side));
         }
+        ROS_INFO("Undistortion maps of camera %d cost %fms", cam_id, tic.toc());
         return maps;
     }
 
@@ -359,29 +361,50 @@ public:
                 (rotation * Eigen::Vector3d(0, 0, 1))[0],
                 (rotation * Eigen::Vector3d(0, 0, 1))[1],
                 (rotation * Eigen::Vector3d(0, 0, 1))[2]);
-        for (unsigned int x = 0; x < imgWidth; x++)
-            for (unsigned int y = 0; y < imgHeight; y++)
+        //Rows are independent, project them in parallel. The fisheye pixel hit by each pixel is taken
+        //from the double projection, in the serial x then y order of the back map fill
+        std::vector<cv::Point> hits(imgWidth * imgHeight, cv::Point(-1, -1));
+#pragma omp parallel for schedule(dynamic, 16)
+        for (unsigned int y = 0; y < imgHeight; y++)
+        {
+            Eigen::Matrix3Xd objPoints(3, imgWidth);
+            Eigen::Matrix2Xd imgPoints(2, imgWidth);
+            for (unsigned int x = 0; x < imgWidth; x++)
             {
-                Eigen::Vector3d objPoint =
+                objPoints.col(x) =
                     rotation *
                     Eigen::Vector3d(
                         ((double)x - (double)imgWidth / 2),
                         ((double)y - (double)imgHeight / 2),
                         f_center);
-                Eigen::Vector2d imgPoint;
-                p_cam->spaceToPlane(objPoint, imgPoint);
+            }
+            p_cam->spaceToPlaneBatch(objPoints.data(), imgPoints.data(), imgWidth);
 
-                map.at<cv::Vec2f>(cv::Point(x, y)) = cv::Vec2f(imgPoint.x(), imgPoint.y());
+            cv::Vec2f * map_row = map.ptr<cv::Vec2f>(y);
+            for (unsigned int x = 0; x < imgWidth; x++)
+            {
+                Eigen::Vector2d imgPoint = imgPoints.col(x);
+                map_row[x] = cv::Vec2f(imgPoint.x(), imgPoint.y());
                 if(!isnan(imgPoint.x()) && !isnan(imgPoint.y()) && 
                     imgPoint.x() >=0 && imgPoint.x() <= raw_width &&
                     imgPoint.y() >=0 && imgPoint.y() <= raw_height
                 ) {
-                    auto & pt = fisheye2cam_pt.at<cv::Vec2f>(cv::Point(imgPoint.x(), imgPoint.y()));
-                    fisheye2cam_id.at<uint8_t>(cv::Point(imgPoint.x(), imgPoint.y())) = _id;
+                    hits[x * imgHeight + y] = cv::Point(imgPoint.x(), imgPoint.y());
+                }
+            }
+        }
+
+        //Several pixels may hit the same fisheye pixel, the last one in the serial order wins as before
+        for (unsigned int x = 0; x < imgWidth; x++)
+            for (unsigned int y = 0; y < imgHeight; y++)
+            {
+                const cv::Point & hit = hits[x * imgHeight + y];
+                if (hit.x >= 0) {
+                    auto & pt = fisheye2cam_pt.at<cv::Vec2f>(hit);
+                    fisheye2cam_id.at<uint8_t>(hit) = _id;
                     pt[0] = x;
                     pt[1] = y;
                 }
-                
             }
 
         ROS_DEBUG("Upper corners: (%.2f, %.2f), (%.2f, %.2f)",
@@ -503,6 +503,12 @@ void VinsNodeBaseClass::Init(ros::NodeHandle & n)
 
     estimator.setParameter();
 
+    //Only at start up, a /vins_restart or a reboot after failure starts from scratch.
+    //Nothing is subscribed yet so the estimator thread is idle while the window is restored
+    if (!SNAPSHOT_LOAD_PATH.empty()) {
+        estimator.loadSnapshot(SNAPSHOT_LOAD_PATH);
+    }
+
     ROS_INFO("Will %d GPU", USE_GPU);
     if (ENABLE_DEPTH) {
         FisheyeUndist *fun = nullptr;
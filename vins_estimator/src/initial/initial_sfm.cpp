@@ -10,6 +10,7 @@
  *******************************************************/
 
 #include "initial_sfm.h"
+#include "../estimator/parameters.h"
 
 GlobalSFM::GlobalSFM(){}
 
@@ -206,6 +207,7 @@ bool GlobalSFM::construct(int frame_num, Quaterniond* q, Vector3d* T, int l,
 		triangulateTwoFrames(i, Pose[i], l, Pose[l], sfm_f);
 	}
 	//5: triangulate all other points
+#pragma omp parallel for schedule(static)
 	for (int j = 0; j < feature_num; j++)
 	{
 		if (sfm_f[j].state == true)
@@ -285,8 +287,9 @@ bool GlobalSFM::construct(int frame_num, Quaterniond* q, Vector3d* T, int l,
 	ceres::Solver::Options options;
 	options.linear_solver_type = ceres::DENSE_SCHUR;
 	//options.minimizer_progress_to_stdout = true;
-	options.max_solver_time_in_seconds = 0.2;
-	ceres::Solver::Summary summary;
+	options.max_solver_time_in_seconds = SFM_BA_MAX_TIME;
+	options.max_num_iterations = SFM_BA_MAX_ITERATIONS;
+	options.num_threads = SOLVER_THREADS;
 	ceres::Solve(options, &problem, &summary);
 	//std::cout << summary.BriefReport() << "\n";
 	if (summary.termination_type == ceres::CONVERGENCE || summary.final_cost < 5e-03)
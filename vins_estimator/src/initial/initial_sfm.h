@@ -22,6 +22,10 @@
 using namespace Eigen;
 using namespace std;
 
+//Bounds of the vision only BA, initialization is retried on next frame when not converged.
+//Starting from PnP and triangulation it converges in a few iterations, more only delay the retry
+#define SFM_BA_MAX_TIME 0.2
+#define SFM_BA_MAX_ITERATIONS 10
 
 
 struct SFMFeature
@@ -71,6 +75,8 @@ public:
 	bool construct(int frame_num, Quaterniond* q, Vector3d* T, int l,
 			  const Matrix3d relative_R, const Vector3d relative_T,
 			  vector<SFMFeature> &sfm_f, map<int, Vector3d> &sfm_tracked_points);
+	//Summary of the last vision only BA
+	ceres::Solver::Summary summary;
 
 private:
 	bool solveFrameByPnP(Matrix3d &R_initial, Vector3d &P_initial, int i, vector<SFMFeature> &sfm_f);
@@ -0,0 +1,133 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+//Replay benchmark of the monocular initial structure on simulated takeoff windows: a camera
+//leaving rest with growing speed over a textured scene. GlobalSFM::construct is timed on each
+//window with one solver thread and with all of them, and the vision only BA iterations are
+//reported against SFM_BA_MAX_ITERATIONS. Returns non-zero if a window fails or its poses are off
+//the ground truth.
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <thread>
+#include "initial_sfm.h"
+#include "../estimator/parameters.h"
+#include "../utility/tic_toc.h"
+
+#define BENCH_WINDOWS 20
+#define BENCH_FRAMES 11
+#define BENCH_LANDMARKS 300
+//Frames a landmark is tracked in at least, half the landmarks are tracked from the first frame
+//and half until the last
+#define BENCH_MIN_TRACK 3
+//Noise of the normalized observations, about half a pixel
+#define BENCH_OBS_NOISE (0.5 / FOCAL_LENGTH)
+//Max error of the poses in the frame l, relative to the baseline l to last
+#define CHECK_POS_TOLERANCE 0.05
+//Degrees
+#define CHECK_ROT_TOLERANCE 0.5
+
+struct SFMWindow
+{
+    Quaterniond q[BENCH_FRAMES];
+    Vector3d T[BENCH_FRAMES];
+    vector<SFMFeature> sfm_f;
+};
+
+//Camera poses of a takeoff from rest, in the frame of the first camera, and the features it tracks
+static SFMWindow simulate(int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    std::normal_distribution<double> noise(0, BENCH_OBS_NOISE);
+    SFMWindow window;
+    Vector3d direction = Vector3d(uniform(rng), 0.3 * uniform(rng), 0.3 * uniform(rng)).normalized();
+    for (int i = 0; i < BENCH_FRAMES; i++)
+    {
+        double s = (double)i / (BENCH_FRAMES - 1);
+        window.T[i] = 0.5 * s * s * direction;
+        window.q[i] = AngleAxisd(0.1 * s * uniform(rng), Vector3d::UnitY()) * AngleAxisd(0.05 * s * uniform(rng), Vector3d::UnitX());
+    }
+
+    std::uniform_int_distribution<int> start_frame(0, BENCH_FRAMES - BENCH_MIN_TRACK);
+    for (int f = 0; f < BENCH_LANDMARKS; f++)
+    {
+        Vector3d pts_w(3 * uniform(rng), 2 * uniform(rng), 6 + 4 * uniform(rng));
+        int start = uniform(rng) < 0 ? 0 : start_frame(rng);
+        std::uniform_int_distribution<int> end_frame(start + BENCH_MIN_TRACK - 1, BENCH_FRAMES - 1);
+        int end = uniform(rng) < 0 ? BENCH_FRAMES - 1 : end_frame(rng);
+        SFMFeature feature;
+        feature.state = false;
+        feature.id = f;
+        for (int i = start; i <= end; i++)
+        {
+            Vector3d pts_c = window.q[i].inverse() * (pts_w - window.T[i]);
+            feature.observation.push_back(make_pair(i, Vector2d(pts_c.x() / pts_c.z() + noise(rng), pts_c.y() / pts_c.z() + noise(rng))));
+        }
+        window.sfm_f.push_back(feature);
+    }
+    return window;
+}
+
+int main(int argc, char **argv)
+{
+    const int l = 0;
+    int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<int> thread_counts = {1};
+    if (max_threads > 1)
+        thread_counts.push_back(max_threads);
+
+    int failures = 0;
+    for (int threads : thread_counts)
+    {
+        SOLVER_THREADS = threads;
+        double sum_ms = 0, max_ms = 0, max_pos_err = 0, max_rot_err = 0;
+        int sum_iterations = 0, max_iterations = 0, converged = 0, failed = 0;
+        for (int w = 0; w < BENCH_WINDOWS; w++)
+        {
+            SFMWindow window = simulate(w);
+            Matrix3d relative_R = window.q[BENCH_FRAMES - 1].toRotationMatrix();
+            Vector3d relative_T = window.T[BENCH_FRAMES - 1];
+            Quaterniond q[BENCH_FRAMES];
+            Vector3d T[BENCH_FRAMES];
+            map<int, Vector3d> sfm_tracked_points;
+            GlobalSFM sfm;
+
+            TicToc t_sfm;
+            bool ok = sfm.construct(BENCH_FRAMES, q, T, l, relative_R, relative_T, window.sfm_f, sfm_tracked_points);
+            double ms = t_sfm.toc();
+            sum_ms += ms;
+            max_ms = std::max(max_ms, ms);
+            int iterations = sfm.summary.iterations.size();
+            sum_iterations += iterations;
+            max_iterations = std::max(max_iterations, iterations);
+            converged += sfm.summary.termination_type == ceres::CONVERGENCE;
+            if (!ok)
+            {
+                failed++;
+                continue;
+            }
+            double baseline = relative_T.norm();
+            for (int i = 0; i < BENCH_FRAMES; i++)
+            {
+                max_pos_err = std::max(max_pos_err, (T[i] - window.T[i]).norm() / baseline);
+                max_rot_err = std::max(max_rot_err, q[i].angularDistance(window.q[i]) * 180 / M_PI);
+            }
+        }
+        printf("%d threads, %d windows of %d frames: %.2fms per construct, max %.2fms; "
+               "BA %.1f iterations, max %d of %d, %d converged; %d failed\n",
+               threads, BENCH_WINDOWS, BENCH_FRAMES, sum_ms / BENCH_WINDOWS, max_ms,
+               (double)sum_iterations / BENCH_WINDOWS, max_iterations, SFM_BA_MAX_ITERATIONS, converged, failed);
+        printf("max error to the ground truth: %.4f of the baseline, %.3fdeg\n", max_pos_err, max_rot_err);
+        failures += failed;
+        failures += max_pos_err > CHECK_POS_TOLERANCE || max_rot_err > CHECK_ROT_TOLERANCE;
+    }
+    return failures == 0 ? 0 : 1;
+}